@@ -5,10 +5,26 @@
 #define HEIGHT 450
 
 #define TARGETFPS 60.0
+#define TICKRATE 60.0 // Simulation ticks per second, independent of the frame rate
 
 #define DELTA 0.05 // Timestep, will probably be changed to variable later
 #define STEPS 25 // How many steps per calculation. The higher it is, the more stable but also the slower
+#define TOLERANCE 1e-6 // Error tolerance for the adaptive integrator (--integrator rk45)
 #define MAXPOINTS 1500
 #define MAXTRAIL 50
+#define TRAILEXTENT 48.0 // Trails are quantized to a box this many view units either side of the attractor's center
+#define TRAILREACH 8 // With --trail-tolerance the trail slider reaches back this many ticks per --max-trail sample
+#define THREADS 0 // Integration threads, 0 uses every core. Overridden by --threads
+#define OCCUPANCYSIZE 256 // Voxels along each side of the --occupancy grid
+#define OCCUPANCYWARMUP 120 // Ticks (headless: steps) the particles get to settle onto the attractor before --occupancy counts them
+
+// Storage type for particles, trails and vertex math. Build with -DLORENZ_SINGLE_PRECISION
+// for float, which doubles the SIMD width and halves memory traffic. Run with
+// --precision-report to see how far that drifts from the double precision path.
+#ifdef LORENZ_SINGLE_PRECISION
+typedef float real;
+#else
+typedef double real;
+#endif
 
 #endif
\ No newline at end of file
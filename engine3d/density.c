@@ -0,0 +1,234 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "density.h"
+#include "../simulation/platform.h"
+
+#define DENSITY_ALIGNMENT 64
+#define DENSITY_BLOCK 256 // Points projected per projectPointsToScreen call
+#define DENSITY_GRAIN 4096 // Particles per chunk handed to a worker
+
+// ------------------------------------------------------
+// Setup
+// ------------------------------------------------------
+
+// Black through purple, red and orange to pale yellow, roughly matplotlib's inferno
+static const float colormap[][3] = {
+    {0, 0, 4}, {40, 11, 84}, {101, 21, 110}, {159, 42, 99},
+    {212, 72, 66}, {245, 125, 21}, {250, 193, 39}, {252, 255, 164},
+};
+
+static void buildToneMap(DensityMap* density, float gamma) {
+    const int stops = sizeof(colormap) / sizeof(colormap[0]);
+    int i, c;
+    for (i = 0; i < DENSITY_LEVELS; i++) {
+        float t = powf((float) i / (DENSITY_LEVELS - 1), 1 / gamma) * (stops - 1);
+        int stop = t >= stops - 1 ? stops - 2 : (int) t;
+        float f = t - stop;
+        uint32_t color = 0xFF000000u;
+        for (c = 0; c < 3; c++) {
+            float value = colormap[stop][c] + (colormap[stop + 1][c] - colormap[stop][c]) * f;
+            color |= (uint32_t) (value + 0.5f) << (16 - 8 * c);
+        }
+        density->toneMap[i] = color;
+    }
+}
+
+DensityMap* densityMapCreate(int width, int height, int threads, float gamma) {
+    DensityMap* density = calloc(1, sizeof(DensityMap));
+    if (!density) {
+        return NULL;
+    }
+    density->pool = threadPoolCreate(threads);
+    if (!density->pool) {
+        free(density);
+        return NULL;
+    }
+    density->threads = threadPoolThreadCount(density->pool);
+    density->maxima = calloc(density->threads, sizeof(float));
+    if (!density->maxima || !densityMapResize(density, width, height)) {
+        densityMapDestroy(density);
+        return NULL;
+    }
+    buildToneMap(density, gamma > 0 ? gamma : 1);
+    return density;
+}
+
+void densityMapDestroy(DensityMap* density) {
+    if (!density) {
+        return;
+    }
+    if (density->pool) {
+        threadPoolDestroy(density->pool);
+    }
+    alignedFree(density->shards);
+    alignedFree(density->pixels);
+    free(density->maxima);
+    free(density);
+}
+
+int densityMapResize(DensityMap* density, int width, int height) {
+    if (width < 1 || height < 1) {
+        return 0;
+    }
+    if (density->pixels && width == density->width && height == density->height) {
+        return 1;
+    }
+    size_t bins = (size_t) width * height;
+    float* shards = alignedAlloc(DENSITY_ALIGNMENT, bins * density->threads * sizeof(float));
+    uint32_t* pixels = alignedAlloc(DENSITY_ALIGNMENT, bins * sizeof(uint32_t));
+    if (!shards || !pixels) {
+        alignedFree(shards);
+        alignedFree(pixels);
+        return 0;
+    }
+    memset(shards, 0, bins * density->threads * sizeof(float)); // Resolving keeps them clear from here on
+    alignedFree(density->shards);
+    alignedFree(density->pixels);
+    density->shards = shards;
+    density->pixels = pixels;
+    density->width = width;
+    density->height = height;
+    return 1;
+}
+
+// ------------------------------------------------------
+// Splatting
+// ------------------------------------------------------
+
+typedef struct SplatJob {
+    DensityMap* density;
+    const Mat4f* clipMatrix;
+    const ParticleStore* previous;
+    const ParticleStore* current;
+    float alpha;
+    const TrailStore* trails;
+} SplatJob;
+
+static void splatBlock(const SplatJob* job, float* shard, const float* x, const float* y, const float* z, int count) {
+    const int width = job->density->width, height = job->density->height;
+    float screenX[DENSITY_BLOCK], screenY[DENSITY_BLOCK];
+    unsigned char outcodes[DENSITY_BLOCK];
+    // A guard band of 1 is the screen itself, so outcode 0 means the point is on it
+    projectPointsToScreen(screenX, screenY, outcodes, x, y, z, count, job->clipMatrix, width, height, 1);
+    int k;
+    for (k = 0; k < count; k++) {
+        if (!outcodes[k]) {
+            int px = (int) screenX[k], py = (int) screenY[k];
+            if (px >= 0 && px < width && py >= 0 && py < height) { // Right on the far edges
+                shard[(size_t) py * width + px] += 1;
+            }
+        }
+    }
+}
+
+static float* workerShard(const DensityMap* density, int worker) {
+    return density->shards + (size_t) worker * density->width * density->height;
+}
+
+static void splatParticles(void* context, int start, int end, int worker) {
+    const SplatJob* job = context;
+    float* shard = workerShard(job->density, worker);
+    const real* fromX = job->previous->x, * fromY = job->previous->y, * fromZ = job->previous->z;
+    const real* toX = job->current->x, * toY = job->current->y, * toZ = job->current->z;
+    const float alpha = job->alpha;
+    float x[DENSITY_BLOCK], y[DENSITY_BLOCK], z[DENSITY_BLOCK];
+    int i, k;
+    for (i = start; i < end; i += DENSITY_BLOCK) {
+        int count = end - i < DENSITY_BLOCK ? end - i : DENSITY_BLOCK;
+        for (k = 0; k < count; k++) {
+            x[k] = fromX[i + k] + (toX[i + k] - fromX[i + k]) * alpha;
+            y[k] = fromY[i + k] + (toY[i + k] - fromY[i + k]) * alpha;
+            z[k] = fromZ[i + k] + (toZ[i + k] - fromZ[i + k]) * alpha;
+        }
+        splatBlock(job, shard, x, y, z, count);
+    }
+}
+
+void densityMapSplatParticles(DensityMap* density, const Mat4f* clipMatrix, const ParticleStore* previous, const ParticleStore* current, float alpha, int count) {
+    SplatJob job = {density, clipMatrix, previous, current, alpha, NULL};
+    threadPoolParallelFor(density->pool, 0, count, DENSITY_GRAIN, splatParticles, &job);
+}
+
+static void splatTrails(void* context, int start, int end, int worker) {
+    const SplatJob* job = context;
+    const TrailStore* trails = job->trails;
+    float* shard = workerShard(job->density, worker);
+    float x[DENSITY_BLOCK], y[DENSITY_BLOCK], z[DENSITY_BLOCK];
+    int i, k, count = 0;
+    for (i = start; i < end; i++) {
+        for (k = 0; k < trailStoreCount(trails, i); k++) {
+            const TrailSample sample = trails->samples[trailStoreSlot(trails, i, k)];
+            x[count] = sample.x;
+            y[count] = sample.y;
+            z[count] = sample.z;
+            if (++count == DENSITY_BLOCK) {
+                splatBlock(job, shard, x, y, z, count);
+                count = 0;
+            }
+        }
+    }
+    if (count) {
+        splatBlock(job, shard, x, y, z, count);
+    }
+}
+
+void densityMapSplatTrails(DensityMap* density, const Mat4f* clipMatrix, const TrailStore* trails, int count) {
+    SplatJob job = {density, clipMatrix, NULL, NULL, 0, trails};
+    int grain = DENSITY_GRAIN / trails->length > 0 ? DENSITY_GRAIN / trails->length : 1;
+    threadPoolParallelFor(density->pool, 0, count, grain, splatTrails, &job);
+}
+
+// ------------------------------------------------------
+// Resolving
+// ------------------------------------------------------
+
+// Sums every shard into shard 0, clearing the rest, and notes the densest bin
+static void sumRows(void* context, int start, int end, int worker) {
+    DensityMap* density = context;
+    const size_t bins = (size_t) density->width * density->height;
+    const size_t from = (size_t) start * density->width, to = (size_t) end * density->width;
+    float* total = density->shards;
+    float densest = density->maxima[worker];
+    size_t b;
+    int w;
+    for (w = 1; w < density->threads; w++) {
+        float* shard = density->shards + w * bins;
+        for (b = from; b < to; b++) {
+            total[b] += shard[b];
+            shard[b] = 0;
+        }
+    }
+    for (b = from; b < to; b++) {
+        densest = total[b] > densest ? total[b] : densest;
+    }
+    density->maxima[worker] = densest;
+}
+
+static void toneRows(void* context, int start, int end, int worker) {
+    DensityMap* density = context;
+    const size_t from = (size_t) start * density->width, to = (size_t) end * density->width;
+    (void) worker;
+    float* total = density->shards;
+    const float scale = density->scale;
+    size_t b;
+    for (b = from; b < to; b++) {
+        int level = (int) (log1pf(total[b]) * scale);
+        density->pixels[b] = density->toneMap[level < DENSITY_LEVELS ? level : DENSITY_LEVELS - 1];
+        total[b] = 0;
+    }
+}
+
+void densityMapResolve(DensityMap* density) {
+    int w;
+    memset(density->maxima, 0, density->threads * sizeof(float));
+    threadPoolParallelFor(density->pool, 0, density->height, 8, sumRows, density);
+    float densest = 0;
+    for (w = 0; w < density->threads; w++) {
+        densest = density->maxima[w] > densest ? density->maxima[w] : densest;
+    }
+    // The densest bin lands on the last level, an empty frame stays at the first
+    density->scale = densest > 0 ? (DENSITY_LEVELS - 1) / log1pf(densest) : 0;
+    threadPoolParallelFor(density->pool, 0, density->height, 8, toneRows, density);
+}
\ No newline at end of file
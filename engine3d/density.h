@@ -0,0 +1,55 @@
+#ifndef LORENZ_DENSITY_H
+#define LORENZ_DENSITY_H
+
+#include <stdint.h>
+
+#include "mat4f.h"
+#include "../simulation/particles.h"
+#include "../simulation/trails.h"
+#include "../simulation/threadpool.h"
+
+#define DENSITY_LEVELS 1024 // Entries in the tone map table
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+/*
+Renders huge ensembles as a 2D histogram instead of primitives. Every point is projected in
+SIMD batches and adds one to the bin it lands in, so a point costs a few nanoseconds however
+many there are. Each worker splats into its own shard, which needs no atomics and no
+ordering, and the shards are summed when the frame is resolved. Counts are then shown through
+log scaling, normalized to the densest bin, and a colormap with the gamma baked in.
+*/
+typedef struct DensityMap {
+    float* shards;    // threads * width * height counts, worker w's shard starts at w * width * height
+    uint32_t* pixels; // ARGB8888, width * height, ready for SDL_UpdateTexture
+    int width;
+    int height;
+    int threads;
+
+    uint32_t toneMap[DENSITY_LEVELS]; // Color for each normalized log density
+    float* maxima;    // Densest bin each worker saw while resolving
+    float scale;      // Maps log density to a toneMap index, set while resolving
+
+    ThreadPool* pool;
+} DensityMap;
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+// threads <= 0 uses every core. gamma > 1 brightens sparse regions. Returns NULL on failure.
+DensityMap* densityMapCreate(int width, int height, int threads, float gamma);
+void densityMapDestroy(DensityMap* density);
+// Returns 0 if the buffers couldn't grow, the old ones are kept
+int densityMapResize(DensityMap* density, int width, int height);
+
+// Adds count particles, interpolated alpha of the way from previous to current
+void densityMapSplatParticles(DensityMap* density, const Mat4f* clipMatrix, const ParticleStore* previous, const ParticleStore* current, float alpha, int count);
+// Adds every stored sample of the first count trails. clipMatrix takes fixed point samples to clip space.
+void densityMapSplatTrails(DensityMap* density, const Mat4f* clipMatrix, const TrailStore* trails, int count);
+// Sums the shards into pixels and clears them for the next frame
+void densityMapResolve(DensityMap* density);
+
+#endif
\ No newline at end of file
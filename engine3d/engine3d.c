@@ -260,10 +260,10 @@ void Vec3Divide(Vec3* out, const Vec3 a, const Vec3 b) {
     out->y = a.y / b.y;
     out->z = a.z / b.z;
 }
-double Vec3Dot(const Vec3 a, const Vec3 b) {
+real Vec3Dot(const Vec3 a, const Vec3 b) {
     return (a.x * b.x) + (a.y * b.y) + (a.z * b.z);
 }
-double Vec3Magnitude(const Vec3 v) {
+real Vec3Magnitude(const Vec3 v) {
     return sqrt(v.x*v.x + v.y*v.y + v.z*v.z);
 }
 void Vec3Normalize(Vec3* v) {
@@ -331,4 +331,63 @@ int clipWithinPlane(const Plane plane, Vec3* a, Vec3* b) {
     }
 
     return 1;
+}
+
+int isWithinClipSpace(const Vec4 point) {
+    return point.x >= -point.w && point.x <= point.w &&
+        point.y >= -point.w && point.y <= point.w &&
+        point.z >= 0 && point.z <= point.w;
+}
+
+/*
+Liang-Barsky in homogeneous coordinates. Each plane is a linear function that is non-negative
+inside, so a line either stays inside it, leaves it at one parameter or misses it entirely.
+Nearly every trail segment is inside all six, which costs a dozen multiply-adds and compares
+and no divisions. The sides are clipped to a guard band rather than the screen, since the
+rasterizer discards offscreen pixels anyway and only needs the coordinates kept in range.
+*/
+int clipLineHomogeneous(Vec4* a, Vec4* b, real guardBand) {
+    // Both ends outside the same edge of the view
+    if ((a->x < -a->w && b->x < -b->w) || (a->x > a->w && b->x > b->w) ||
+        (a->y < -a->w && b->y < -b->w) || (a->y > a->w && b->y > b->w) ||
+        (a->z < 0 && b->z < 0) || (a->z > a->w && b->z > b->w)) {
+        return 0;
+    }
+
+    const real aGuard = guardBand * a->w, bGuard = guardBand * b->w;
+    const real aDistance[6] = {a->z, a->w - a->z, aGuard + a->x, aGuard - a->x, aGuard + a->y, aGuard - a->y};
+    const real bDistance[6] = {b->z, b->w - b->z, bGuard + b->x, bGuard - b->x, bGuard + b->y, bGuard - b->y};
+    real enter = 0, leave = 1;
+    int p;
+    for (p = 0; p < 6; p++) {
+        if (aDistance[p] < 0) {
+            if (bDistance[p] < 0) {
+                return 0;
+            }
+            real t = aDistance[p] / (aDistance[p] - bDistance[p]);
+            enter = t > enter ? t : enter;
+        } else if (bDistance[p] < 0) {
+            real t = aDistance[p] / (aDistance[p] - bDistance[p]);
+            leave = t < leave ? t : leave;
+        }
+    }
+    if (enter > leave) {
+        return 0;
+    }
+
+    const Vec4 start = *a, delta = {b->x - a->x, b->y - a->y, b->z - a->z, b->w - a->w};
+    if (enter > 0) {
+        *a = (Vec4){start.x + delta.x * enter, start.y + delta.y * enter, start.z + delta.z * enter, start.w + delta.w * enter};
+    }
+    if (leave < 1) {
+        *b = (Vec4){start.x + delta.x * leave, start.y + delta.y * leave, start.z + delta.z * leave, start.w + delta.w * leave};
+    }
+    return 1;
+}
+
+void clipToScreen(Vec3* out, const Vec4 point, const int width, const int height) {
+    real inverseW = 1 / point.w;
+    out->x = ((point.x * inverseW + 1.0) / 2) * width;
+    out->y = height - ((point.y * inverseW + 1.0) / 2) * height;
+    out->z = ((point.z * inverseW + 1.0) / 2);
 }
\ No newline at end of file
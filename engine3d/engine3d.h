@@ -1,25 +1,27 @@
 #ifndef LORENZ_ENGINE_3D_H
 #define LORENZ_ENGINE_3D_H
 
+#include "../constants.h"
+
 // ------------------------------------------------------
 // Structs
 // ------------------------------------------------------
 
 typedef struct Vector3 {
-    double x;
-    double y;
-    double z;
+    real x;
+    real y;
+    real z;
 } Vec3;
 
 typedef struct Vector4 {
-    double x;
-    double y;
-    double z;
-    double w;
+    real x;
+    real y;
+    real z;
+    real w;
 } Vec4;
 
 typedef struct Matrix4x4 {
-    double mat[4][4]; // [row][column]
+    real mat[4][4]; // [row][column]
 } Mat4;
 
 typedef struct Plane3 {
@@ -61,8 +63,8 @@ void Vec3Add(Vec3* out, const Vec3 a, const Vec3 b); // a + b
 void Vec3Subtract(Vec3* out, const Vec3 a, const Vec3 b); // a - b
 void Vec3Multiply(Vec3* out, const Vec3 a, const Vec3 b); // a * b
 void Vec3Multiply(Vec3* out, const Vec3 a, const Vec3 b); // a / b
-double Vec3Dot(const Vec3 a, const Vec3 b); // a • b
-double Vec3Magnitude(const Vec3 v); // |v|
+real Vec3Dot(const Vec3 a, const Vec3 b); // a • b
+real Vec3Magnitude(const Vec3 v); // |v|
 void Vec3Normalize(Vec3* v); // v / |v|
 void Vec3Negative(Vec3* v); // -v
 void Vec3Cross(Vec3* out, const Vec3 a, const Vec3 b); // a × b
@@ -71,4 +73,14 @@ void Vec3Cross(Vec3* out, const Vec3 a, const Vec3 b); // a × b
 int isWithinPlane(const Plane plane, const Vec3 point);
 int clipWithinPlane(const Plane plane, Vec3* a, Vec3* b);
 
+// -- Clip Space --
+// Clip space is what the combined object to projection matrix gives, before the divide by w.
+// The view volume is -w <= x <= w, -w <= y <= w and 0 <= z <= w.
+int isWithinClipSpace(const Vec4 point);
+// Clips a line to the near and far planes and to a guard band guardBand times wider than the
+// view, leaving the exact screen edges to the rasterizer. Returns 0 if the line isn't visible.
+int clipLineHomogeneous(Vec4* a, Vec4* b, real guardBand);
+// Divides by w and maps to pixels, y pointing down
+void clipToScreen(Vec3* out, const Vec4 point, const int width, const int height);
+
 #endif
\ No newline at end of file
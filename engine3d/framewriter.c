@@ -0,0 +1,425 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "framewriter.h"
+#include "../simulation/platform.h"
+
+#define DEFLATE_WINDOW 32768
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_HASH_BITS 15
+
+typedef enum SlotState { SLOT_FREE, SLOT_FILLING, SLOT_QUEUED, SLOT_WRITING } SlotState;
+
+typedef struct FrameSlot {
+    unsigned char* pixels;
+    SlotState state;
+} FrameSlot;
+
+// Each encoder's own buffers, sized once for the frame
+typedef struct FrameEncoder {
+    FrameWriter* writer;
+    pthread_t thread;
+    int started;
+    unsigned char* filtered; // PNG scanlines, a filter byte then the row
+    unsigned char* encoded;
+    int* hashHeads;          // Latest position of every 3 byte hash, -1 if none
+} FrameEncoder;
+
+struct FrameWriter {
+    FrameWriterSettings settings;
+    FILE* stream; // FRAME_RAW only
+    uint32_t crcTable[256];
+
+    // Slots are filled and taken in ring order: produced counts submitted frames, taken the
+    // ones an encoder has claimed. An encoder finishing early frees its slot out of order,
+    // which is fine, the renderer just waits for the one it needs next.
+    FrameSlot* slots;
+    int slotCount;
+    unsigned long long produced;
+    unsigned long long taken;
+    int closing;
+    int failed;
+    pthread_mutex_t lock;
+    pthread_cond_t queued; // A frame was submitted, or the writer is closing
+    pthread_cond_t freed;
+
+    FrameEncoder encoders[FRAME_WRITER_MAX_THREADS];
+    int encoderCount;
+};
+
+// ------------------------------------------------------
+// PNG
+// ------------------------------------------------------
+
+/*
+A small deflate encoder, so there's no zlib to link: greedy LZ77 with one candidate per 3 byte
+hash, coded with the fixed Huffman tables. That gives up some ratio to a real encoder, but the
+frames are mostly black with thin lines and shrink a lot either way, and it's fast.
+*/
+
+typedef struct BitWriter {
+    unsigned char* out;
+    size_t at;
+    uint32_t bits;
+    int count;
+} BitWriter;
+
+static const unsigned short lengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const unsigned char lengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const unsigned short distanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+    4097, 6145, 8193, 12289, 16385, 24577,
+};
+static const unsigned char distanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+static void putBits(BitWriter* writer, uint32_t value, int length) {
+    writer->bits |= value << writer->count;
+    writer->count += length;
+    while (writer->count >= 8) {
+        writer->out[writer->at++] = (unsigned char) writer->bits;
+        writer->bits >>= 8;
+        writer->count -= 8;
+    }
+}
+
+// Huffman codes are packed starting from their most significant bit
+static void putCode(BitWriter* writer, uint32_t code, int length) {
+    uint32_t reversed = 0;
+    int b;
+    for (b = 0; b < length; b++) {
+        reversed |= ((code >> b) & 1) << (length - 1 - b);
+    }
+    putBits(writer, reversed, length);
+}
+
+static void putSymbol(BitWriter* writer, int symbol) {
+    if (symbol < 144) {
+        putCode(writer, 0x30 + symbol, 8);
+    } else if (symbol < 256) {
+        putCode(writer, 0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+        putCode(writer, symbol - 256, 7);
+    } else {
+        putCode(writer, 0xC0 + symbol - 280, 8);
+    }
+}
+
+static void putMatch(BitWriter* writer, int length, int distance) {
+    int code = 28;
+    while (lengthBase[code] > length) {
+        code--;
+    }
+    putSymbol(writer, 257 + code);
+    putBits(writer, length - lengthBase[code], lengthExtra[code]);
+    code = 29;
+    while (distanceBase[code] > distance) {
+        code--;
+    }
+    putCode(writer, code, 5);
+    putBits(writer, distance - distanceBase[code], distanceExtra[code]);
+}
+
+// zlib stream of one fixed Huffman block. out needs size + size / 8 + 64 bytes.
+static size_t deflateFixed(unsigned char* out, const unsigned char* data, size_t size, int* hashHeads) {
+    BitWriter writer = {out, 0, 0, 0};
+    putBits(&writer, 0x78, 8);
+    putBits(&writer, 0x01, 8);
+    putBits(&writer, 1, 1); // Final block
+    putBits(&writer, 1, 2); // Fixed Huffman codes
+    memset(hashHeads, 0xFF, sizeof(int) << DEFLATE_HASH_BITS);
+    size_t i = 0;
+    while (i < size) {
+        if (i + 3 <= size) {
+            uint32_t hash = ((data[i] << 16 | data[i + 1] << 8 | data[i + 2]) * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+            int candidate = hashHeads[hash];
+            hashHeads[hash] = (int) i;
+            if (candidate >= 0 && i - candidate <= DEFLATE_WINDOW && !memcmp(data + candidate, data + i, 3)) {
+                size_t limit = size - i < DEFLATE_MAX_MATCH ? size - i : DEFLATE_MAX_MATCH;
+                size_t length = 3;
+                while (length < limit && data[candidate + length] == data[i + length]) {
+                    length++;
+                }
+                putMatch(&writer, (int) length, (int) (i - candidate));
+                i += length;
+                continue;
+            }
+        }
+        putSymbol(&writer, data[i++]);
+    }
+    putSymbol(&writer, 256);
+    putBits(&writer, 0, 7); // Flushes the last partial byte
+
+    uint32_t a = 1, b = 0;
+    for (i = 0; i < size; i++) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    uint32_t adler = b << 16 | a;
+    unsigned char* end = out + writer.at;
+    end[0] = adler >> 24;
+    end[1] = adler >> 16;
+    end[2] = adler >> 8;
+    end[3] = adler;
+    return writer.at + 4;
+}
+
+static void putBigEndian(unsigned char* out, uint32_t value) {
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static uint32_t crc32(const uint32_t* table, const unsigned char* data, size_t size) {
+    uint32_t crc = 0xFFFFFFFFu;
+    size_t i;
+    for (i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// Writes a chunk around the size bytes already at out + 8, returns the chunk's total size
+static size_t finishChunk(const uint32_t* table, unsigned char* out, const char* type, size_t size) {
+    putBigEndian(out, (uint32_t) size);
+    memcpy(out + 4, type, 4);
+    putBigEndian(out + 8 + size, crc32(table, out + 4, size + 4));
+    return size + 12;
+}
+
+static size_t encodePng(const FrameWriter* writer, FrameEncoder* encoder, const unsigned char* pixels) {
+    static const unsigned char signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+    const int width = writer->settings.width, height = writer->settings.height;
+    const size_t stride = (size_t) width * 3;
+    unsigned char* out = encoder->encoded;
+    int y;
+    // No filtering, the black background already compresses to almost nothing
+    for (y = 0; y < height; y++) {
+        encoder->filtered[y * (stride + 1)] = 0;
+        memcpy(encoder->filtered + y * (stride + 1) + 1, pixels + y * stride, stride);
+    }
+
+    size_t at = sizeof(signature);
+    memcpy(out, signature, sizeof(signature));
+    unsigned char* header = out + at + 8;
+    putBigEndian(header, width);
+    putBigEndian(header + 4, height);
+    header[8] = 8;  // Bits per channel
+    header[9] = 2;  // RGB
+    header[10] = 0; // Deflate
+    header[11] = 0; // Adaptive filtering
+    header[12] = 0; // Not interlaced
+    at += finishChunk(writer->crcTable, out + at, "IHDR", 13);
+    size_t compressed = deflateFixed(out + at + 8, encoder->filtered, (stride + 1) * height, encoder->hashHeads);
+    at += finishChunk(writer->crcTable, out + at, "IDAT", compressed);
+    at += finishChunk(writer->crcTable, out + at, "IEND", 0);
+    return at;
+}
+
+// ------------------------------------------------------
+// Encoders
+// ------------------------------------------------------
+
+static int writeFrame(FrameWriter* writer, FrameEncoder* encoder, const unsigned char* pixels, unsigned long long frame) {
+    const FrameWriterSettings* settings = &writer->settings;
+    const size_t bytes = (size_t) settings->width * settings->height * 3;
+    if (settings->format == FRAME_RAW) {
+        return fwrite(pixels, 1, bytes, writer->stream) == bytes;
+    }
+    char path[1024];
+    snprintf(path, sizeof(path), settings->path, (int) frame);
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return 0;
+    }
+    int ok;
+    if (settings->format == FRAME_PNG) {
+        size_t size = encodePng(writer, encoder, pixels);
+        ok = fwrite(encoder->encoded, 1, size, file) == size;
+    } else {
+        ok = fprintf(file, "P6\n%d %d\n255\n", settings->width, settings->height) > 0 && fwrite(pixels, 1, bytes, file) == bytes;
+    }
+    return fclose(file) == 0 && ok;
+}
+
+static void* encoderMain(void* data) {
+    FrameEncoder* encoder = data;
+    FrameWriter* writer = encoder->writer;
+    for (;;) {
+        pthread_mutex_lock(&writer->lock);
+        while (!(writer->taken < writer->produced) && !writer->closing) {
+            pthread_cond_wait(&writer->queued, &writer->lock);
+        }
+        if (!(writer->taken < writer->produced)) {
+            pthread_mutex_unlock(&writer->lock); // Closing and nothing left
+            break;
+        }
+        unsigned long long frame = writer->taken++;
+        FrameSlot* slot = &writer->slots[frame % writer->slotCount];
+        slot->state = SLOT_WRITING;
+        pthread_mutex_unlock(&writer->lock);
+
+        int ok = writeFrame(writer, encoder, slot->pixels, frame);
+
+        pthread_mutex_lock(&writer->lock);
+        slot->state = SLOT_FREE;
+        writer->failed |= !ok;
+        pthread_cond_broadcast(&writer->freed);
+        pthread_mutex_unlock(&writer->lock);
+    }
+    return NULL;
+}
+
+// ------------------------------------------------------
+// Setup
+// ------------------------------------------------------
+
+FrameFormat frameFormatFromPath(const char* path) {
+    size_t length = strlen(path);
+    if (!strcmp(path, "-")) {
+        return FRAME_RAW;
+    }
+    if (length >= 4 && !strcmp(path + length - 4, ".png")) {
+        return FRAME_PNG;
+    }
+    return FRAME_PPM;
+}
+
+static void destroyWriter(FrameWriter* writer) {
+    int i;
+    for (i = 0; i < writer->encoderCount; i++) {
+        free(writer->encoders[i].filtered);
+        free(writer->encoders[i].encoded);
+        free(writer->encoders[i].hashHeads);
+    }
+    for (i = 0; writer->slots && i < writer->slotCount; i++) {
+        free(writer->slots[i].pixels);
+    }
+    free(writer->slots);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->queued);
+    pthread_cond_destroy(&writer->freed);
+    free(writer);
+}
+
+FrameWriter* frameWriterCreate(const FrameWriterSettings* settings) {
+    if (settings->width < 1 || settings->height < 1) {
+        return NULL;
+    }
+    FrameWriter* writer = calloc(1, sizeof(FrameWriter));
+    if (!writer) {
+        return NULL;
+    }
+    writer->settings = *settings;
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->queued, NULL);
+    pthread_cond_init(&writer->freed, NULL);
+
+    int threads = settings->threads;
+    if (settings->format == FRAME_RAW) {
+        threads = 1;
+    } else if (threads <= 0) {
+        // PNG is all compression, PPM is all disk
+        threads = settings->format == FRAME_PNG ? platformCpuCount() / 2 : 2;
+    }
+    threads = threads < 1 ? 1 : threads > FRAME_WRITER_MAX_THREADS ? FRAME_WRITER_MAX_THREADS : threads;
+    writer->encoderCount = threads;
+
+    int i;
+    uint32_t c;
+    for (i = 0; i < 256; i++) {
+        int k;
+        for (c = i, k = 0; k < 8; k++) {
+            c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        writer->crcTable[i] = c;
+    }
+
+    const size_t bytes = (size_t) settings->width * settings->height * 3;
+    int ok = 1;
+    writer->slotCount = threads * FRAME_WRITER_SLOTS_PER_THREAD;
+    writer->slots = calloc(writer->slotCount, sizeof(FrameSlot));
+    ok = ok && writer->slots;
+    for (i = 0; ok && i < writer->slotCount; i++) {
+        ok = (writer->slots[i].pixels = malloc(bytes)) != NULL;
+    }
+    for (i = 0; ok && settings->format == FRAME_PNG && i < threads; i++) {
+        const size_t filtered = bytes + settings->height;
+        FrameEncoder* encoder = &writer->encoders[i];
+        encoder->filtered = malloc(filtered);
+        encoder->encoded = malloc(filtered + filtered / 8 + 1024);
+        encoder->hashHeads = malloc(sizeof(int) << DEFLATE_HASH_BITS);
+        ok = encoder->filtered && encoder->encoded && encoder->hashHeads;
+    }
+    if (ok && settings->format == FRAME_RAW) {
+        ok = (writer->stream = platformTakeStdout()) != NULL;
+    }
+    if (!ok) {
+        destroyWriter(writer);
+        return NULL;
+    }
+
+    for (i = 0; i < threads; i++) {
+        writer->encoders[i].writer = writer;
+        writer->encoders[i].started = !pthread_create(&writer->encoders[i].thread, NULL, encoderMain, &writer->encoders[i]);
+        if (!writer->encoders[i].started) {
+            frameWriterClose(writer);
+            return NULL;
+        }
+    }
+    return writer;
+}
+
+int frameWriterClose(FrameWriter* writer) {
+    if (!writer) {
+        return 1;
+    }
+    pthread_mutex_lock(&writer->lock);
+    writer->closing = 1;
+    pthread_cond_broadcast(&writer->queued);
+    pthread_mutex_unlock(&writer->lock);
+    int i;
+    for (i = 0; i < writer->encoderCount; i++) {
+        if (writer->encoders[i].started) {
+            pthread_join(writer->encoders[i].thread, NULL);
+        }
+    }
+    int ok = !writer->failed;
+    if (writer->stream) {
+        ok = fclose(writer->stream) == 0 && ok;
+    }
+    destroyWriter(writer);
+    return ok;
+}
+
+// ------------------------------------------------------
+// Producing
+// ------------------------------------------------------
+
+unsigned char* frameWriterAcquire(FrameWriter* writer) {
+    FrameSlot* slot = &writer->slots[writer->produced % writer->slotCount];
+    pthread_mutex_lock(&writer->lock);
+    while (slot->state != SLOT_FREE) {
+        pthread_cond_wait(&writer->freed, &writer->lock);
+    }
+    slot->state = SLOT_FILLING;
+    pthread_mutex_unlock(&writer->lock);
+    return slot->pixels;
+}
+
+void frameWriterSubmit(FrameWriter* writer) {
+    pthread_mutex_lock(&writer->lock);
+    writer->slots[writer->produced % writer->slotCount].state = SLOT_QUEUED;
+    writer->produced++;
+    pthread_cond_signal(&writer->queued);
+    pthread_mutex_unlock(&writer->lock);
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef LORENZ_FRAMEWRITER_H
+#define LORENZ_FRAMEWRITER_H
+
+#define FRAME_WRITER_MAX_THREADS 16
+#define FRAME_WRITER_SLOTS_PER_THREAD 2 // Frames that can wait for each encoder before the renderer stalls
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+typedef enum FrameFormat {
+    FRAME_PPM, // Binary P6, one file per frame
+    FRAME_PNG, // One file per frame, 8 bit RGB
+    FRAME_RAW, // Bare RGB24 frames back to back on stdout, for piping into an encoder
+} FrameFormat;
+
+typedef struct FrameWriterSettings {
+    const char* path; // printf pattern given the frame number as an int (frames/%05d.png), unused for FRAME_RAW
+    FrameFormat format;
+    int width;
+    int height;
+    int threads;      // Encoder threads, 0 picks for the format. FRAME_RAW always uses one to keep the order.
+} FrameWriterSettings;
+
+// Writes rendered frames on background threads. The renderer fills a free buffer in place and
+// submits it, and only waits when every buffer is still queued, so an offline render never drops
+// a frame and never waits on the disk while there's room.
+typedef struct FrameWriter FrameWriter;
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+// "-" is FRAME_RAW, a .png extension FRAME_PNG and anything else FRAME_PPM
+FrameFormat frameFormatFromPath(const char* path);
+
+// Starts the encoders. For FRAME_RAW it takes over stdout (see platformTakeStdout). Returns NULL on failure.
+FrameWriter* frameWriterCreate(const FrameWriterSettings* settings);
+// Writes everything submitted and stops the encoders. Returns 1 if every frame was written.
+int frameWriterClose(FrameWriter* writer);
+
+// Waits for a free buffer and returns it: height rows of width * 3 bytes of RGB, top to bottom
+unsigned char* frameWriterAcquire(FrameWriter* writer);
+// Queues the acquired buffer as the next frame
+void frameWriterSubmit(FrameWriter* writer);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,262 @@
+#include <float.h>
+#include <math.h>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+#include "mat4f.h"
+
+// ------------------------------------------------------
+// Conversion
+// ------------------------------------------------------
+
+void Mat4fFromMat4(Mat4f* out, const Mat4* m) {
+    int r, c;
+    for (r = 0; r < 4; r++) {
+        for (c = 0; c < 4; c++) {
+            out->mat[r][c] = (float) m->mat[r][c];
+        }
+    }
+}
+
+void Mat4FromMat4f(Mat4* out, const Mat4f* m) {
+    int r, c;
+    for (r = 0; r < 4; r++) {
+        for (c = 0; c < 4; c++) {
+            out->mat[r][c] = m->mat[r][c];
+        }
+    }
+}
+
+// ------------------------------------------------------
+// Matrix math
+// ------------------------------------------------------
+
+// Row r of the product is row r of b transformed by a, so each row is 4 broadcasts and 4
+// multiply-adds of a's rows. With AVX two rows go through at once.
+void Mat4fMultiplyMat4f(Mat4f* out, const Mat4f* a, const Mat4f* b) {
+    Mat4f result;
+#if defined(__AVX__)
+    __m256 a0 = _mm256_broadcast_ps((const __m128*) a->mat[0]);
+    __m256 a1 = _mm256_broadcast_ps((const __m128*) a->mat[1]);
+    __m256 a2 = _mm256_broadcast_ps((const __m128*) a->mat[2]);
+    __m256 a3 = _mm256_broadcast_ps((const __m128*) a->mat[3]);
+    int r;
+    for (r = 0; r < 4; r += 2) {
+        const float* top = b->mat[r];
+        const float* bottom = b->mat[r + 1];
+        __m256 v = _mm256_mul_ps(_mm256_setr_ps(top[0], top[0], top[0], top[0], bottom[0], bottom[0], bottom[0], bottom[0]), a0);
+        v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_setr_ps(top[1], top[1], top[1], top[1], bottom[1], bottom[1], bottom[1], bottom[1]), a1));
+        v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_setr_ps(top[2], top[2], top[2], top[2], bottom[2], bottom[2], bottom[2], bottom[2]), a2));
+        v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_setr_ps(top[3], top[3], top[3], top[3], bottom[3], bottom[3], bottom[3], bottom[3]), a3));
+        _mm256_store_ps(result.mat[r], v);
+    }
+#else
+    int r;
+    for (r = 0; r < 4; r++) {
+        const Vec4f* row = (const Vec4f*) b->mat[r];
+        Mat4fMultiplyVec4f((Vec4f*) result.mat[r], a, row);
+    }
+#endif
+    *out = result;
+}
+
+/*
+Gauss-Jordan elimination with partial pivoting on [m | identity]. Every step is a whole row
+scaled or a multiple of one row subtracted from another, and an augmented row is 8 floats, so
+with AVX each of those is a single vector operation. A pivot that elimination only brought down to
+a few rounding errors counts as zero, or a matrix with a repeated row would pass as invertible.
+*/
+typedef struct AugmentedRow {
+    _Alignas(32) float v[8];
+} AugmentedRow;
+
+static inline void rowScale(AugmentedRow* row, float s) {
+#if defined(__AVX__)
+    _mm256_store_ps(row->v, _mm256_mul_ps(_mm256_load_ps(row->v), _mm256_set1_ps(s)));
+#elif defined(__SSE2__)
+    _mm_store_ps(row->v, _mm_mul_ps(_mm_load_ps(row->v), _mm_set1_ps(s)));
+    _mm_store_ps(row->v + 4, _mm_mul_ps(_mm_load_ps(row->v + 4), _mm_set1_ps(s)));
+#else
+    int k;
+    for (k = 0; k < 8; k++) {
+        row->v[k] *= s;
+    }
+#endif
+}
+
+// row -= s * source
+static inline void rowSubtractScaled(AugmentedRow* row, const AugmentedRow* source, float s) {
+#if defined(__AVX__)
+    _mm256_store_ps(row->v, _mm256_sub_ps(_mm256_load_ps(row->v), _mm256_mul_ps(_mm256_load_ps(source->v), _mm256_set1_ps(s))));
+#elif defined(__SSE2__)
+    _mm_store_ps(row->v, _mm_sub_ps(_mm_load_ps(row->v), _mm_mul_ps(_mm_load_ps(source->v), _mm_set1_ps(s))));
+    _mm_store_ps(row->v + 4, _mm_sub_ps(_mm_load_ps(row->v + 4), _mm_mul_ps(_mm_load_ps(source->v + 4), _mm_set1_ps(s))));
+#else
+    int k;
+    for (k = 0; k < 8; k++) {
+        row->v[k] -= s * source->v[k];
+    }
+#endif
+}
+
+int Mat4fInverse(Mat4f* out, const Mat4f* m) {
+    AugmentedRow rows[4];
+    float largest = 0;
+    int r, c, k;
+    for (r = 0; r < 4; r++) {
+        for (c = 0; c < 4; c++) {
+            rows[r].v[c] = m->mat[r][c];
+            rows[r].v[c + 4] = r == c;
+            largest = fmaxf(largest, fabsf(m->mat[r][c]));
+        }
+    }
+    const float smallest = largest * 16 * FLT_EPSILON;
+    for (c = 0; c < 4; c++) {
+        int pivot = c;
+        for (r = c + 1; r < 4; r++) {
+            if (fabsf(rows[r].v[c]) > fabsf(rows[pivot].v[c])) {
+                pivot = r;
+            }
+        }
+        if (fabsf(rows[pivot].v[c]) <= smallest) {
+            return 0;
+        }
+        if (pivot != c) {
+            AugmentedRow swap = rows[c];
+            rows[c] = rows[pivot];
+            rows[pivot] = swap;
+        }
+        rowScale(&rows[c], 1 / rows[c].v[c]);
+        for (r = 0; r < 4; r++) {
+            if (r != c && rows[r].v[c] != 0) {
+                rowSubtractScaled(&rows[r], &rows[c], rows[r].v[c]);
+            }
+        }
+    }
+    for (r = 0; r < 4; r++) {
+        for (k = 0; k < 4; k++) {
+            out->mat[r][k] = rows[r].v[k + 4];
+        }
+    }
+    return 1;
+}
+
+// ------------------------------------------------------
+// Batched projection
+// ------------------------------------------------------
+
+/*
+Float lanes for projectPointsToScreen, as wide as the -m flags allow, one point per lane. The
+lane* names in simulation/simd.h follow `real`, while screen positions never need more than float.
+*/
+#if defined(__AVX__)
+
+#define PROJECT_WIDTH 8
+typedef __m256 ProjectLane;
+static inline ProjectLane projectLoad(const float* p) { return _mm256_loadu_ps(p); }
+static inline void projectStore(float* p, ProjectLane v) { _mm256_storeu_ps(p, v); }
+static inline ProjectLane projectSet(float v) { return _mm256_set1_ps(v); }
+static inline ProjectLane projectAdd(ProjectLane a, ProjectLane b) { return _mm256_add_ps(a, b); }
+static inline ProjectLane projectMul(ProjectLane a, ProjectLane b) { return _mm256_mul_ps(a, b); }
+static inline ProjectLane projectDiv(ProjectLane a, ProjectLane b) { return _mm256_div_ps(a, b); }
+// bit where a < b, else 0, as integer lanes
+static inline ProjectLane projectBitIfLess(ProjectLane a, ProjectLane b, int bit) {
+    return _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ), _mm256_castsi256_ps(_mm256_set1_epi32(bit)));
+}
+static inline ProjectLane projectOr(ProjectLane a, ProjectLane b) { return _mm256_or_ps(a, b); }
+static inline void projectStoreBits(int* p, ProjectLane v) { _mm256_storeu_si256((__m256i*) p, _mm256_castps_si256(v)); }
+
+#elif defined(__SSE2__)
+
+#define PROJECT_WIDTH 4
+typedef __m128 ProjectLane;
+static inline ProjectLane projectLoad(const float* p) { return _mm_loadu_ps(p); }
+static inline void projectStore(float* p, ProjectLane v) { _mm_storeu_ps(p, v); }
+static inline ProjectLane projectSet(float v) { return _mm_set1_ps(v); }
+static inline ProjectLane projectAdd(ProjectLane a, ProjectLane b) { return _mm_add_ps(a, b); }
+static inline ProjectLane projectMul(ProjectLane a, ProjectLane b) { return _mm_mul_ps(a, b); }
+static inline ProjectLane projectDiv(ProjectLane a, ProjectLane b) { return _mm_div_ps(a, b); }
+static inline ProjectLane projectBitIfLess(ProjectLane a, ProjectLane b, int bit) {
+    return _mm_and_ps(_mm_cmplt_ps(a, b), _mm_castsi128_ps(_mm_set1_epi32(bit)));
+}
+static inline ProjectLane projectOr(ProjectLane a, ProjectLane b) { return _mm_or_ps(a, b); }
+static inline void projectStoreBits(int* p, ProjectLane v) { _mm_storeu_si128((__m128i*) p, _mm_castps_si128(v)); }
+
+#endif
+
+static inline unsigned char outcodeOf(float x, float y, float z, float w, float guard) {
+    return (z < 0 ? CLIP_NEAR : 0) | (w < z ? CLIP_FAR : 0) |
+        (x < -guard * w ? CLIP_LEFT : 0) | (guard * w < x ? CLIP_RIGHT : 0) |
+        (y < -guard * w ? CLIP_BOTTOM : 0) | (guard * w < y ? CLIP_TOP : 0);
+}
+
+void projectPointsToScreen(float* screenX, float* screenY, unsigned char* outcodes, const float* x, const float* y, const float* z, int count, const Mat4f* clipMatrix, int width, int height, float guardBand) {
+    const float (*m)[4] = clipMatrix->mat;
+    int c, i = 0;
+    const float halfWidth = width * 0.5f, halfHeight = height * 0.5f, guard = guardBand;
+
+#ifdef PROJECT_WIDTH
+    ProjectLane column[4][4];
+    int r;
+    for (r = 0; r < 4; r++) {
+        for (c = 0; c < 4; c++) {
+            column[r][c] = projectSet(m[r][c]);
+        }
+    }
+    const ProjectLane one = projectSet(1), zero = projectSet(0);
+    const ProjectLane laneHalfWidth = projectSet(halfWidth), laneHalfHeight = projectSet(halfHeight);
+    const ProjectLane laneNegativeHalfHeight = projectSet(-halfHeight);
+    const ProjectLane laneGuard = projectSet(guard), laneNegativeGuard = projectSet(-guard);
+    int bits[PROJECT_WIDTH], lane;
+    for (; i + PROJECT_WIDTH <= count; i += PROJECT_WIDTH) {
+        ProjectLane px = projectLoad(x + i), py = projectLoad(y + i), pz = projectLoad(z + i);
+        ProjectLane clip[4];
+        for (c = 0; c < 4; c++) {
+            clip[c] = projectAdd(projectAdd(projectMul(px, column[0][c]), projectMul(py, column[1][c])), projectAdd(projectMul(pz, column[2][c]), column[3][c]));
+        }
+        ProjectLane inverseW = projectDiv(one, clip[3]);
+        projectStore(screenX + i, projectAdd(projectMul(projectMul(clip[0], inverseW), laneHalfWidth), laneHalfWidth));
+        projectStore(screenY + i, projectAdd(projectMul(projectMul(clip[1], inverseW), laneNegativeHalfHeight), laneHalfHeight));
+
+        ProjectLane guardW = projectMul(laneGuard, clip[3]), negativeGuardW = projectMul(laneNegativeGuard, clip[3]);
+        ProjectLane code = projectBitIfLess(clip[2], zero, CLIP_NEAR);
+        code = projectOr(code, projectBitIfLess(clip[3], clip[2], CLIP_FAR));
+        code = projectOr(code, projectBitIfLess(clip[0], negativeGuardW, CLIP_LEFT));
+        code = projectOr(code, projectBitIfLess(guardW, clip[0], CLIP_RIGHT));
+        code = projectOr(code, projectBitIfLess(clip[1], negativeGuardW, CLIP_BOTTOM));
+        code = projectOr(code, projectBitIfLess(guardW, clip[1], CLIP_TOP));
+        projectStoreBits(bits, code);
+        for (lane = 0; lane < PROJECT_WIDTH; lane++) {
+            outcodes[i + lane] = (unsigned char) bits[lane];
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        float clip[4];
+        for (c = 0; c < 4; c++) {
+            clip[c] = (x[i] * m[0][c] + y[i] * m[1][c]) + (z[i] * m[2][c] + m[3][c]); // Same order as the lanes
+        }
+        float inverseW = 1 / clip[3];
+        screenX[i] = clip[0] * inverseW * halfWidth + halfWidth;
+        screenY[i] = clip[1] * inverseW * -halfHeight + halfHeight;
+        outcodes[i] = outcodeOf(clip[0], clip[1], clip[2], clip[3], guard);
+    }
+}
+
+// ------------------------------------------------------
+// Culling
+// ------------------------------------------------------
+
+int Mat4fClassifyBox(const Mat4f* clipMatrix, const Vec3* min, const Vec3* max, float guardBand) {
+    unsigned char hidden = CLIP_OUTSIDE, crossing = 0;
+    int corner;
+    for (corner = 0; corner < 8; corner++) {
+        Vec4f p;
+        Mat4fMultiplyPoint(&p, clipMatrix, corner & 1 ? max->x : min->x, corner & 2 ? max->y : min->y, corner & 4 ? max->z : min->z);
+        hidden &= outcodeOf(p.x, p.y, p.z, p.w, 1); // The screen edges themselves
+        crossing |= outcodeOf(p.x, p.y, p.z, p.w, guardBand);
+    }
+    return hidden ? BOX_HIDDEN : crossing ? BOX_CROSSING : BOX_INSIDE;
+}
\ No newline at end of file
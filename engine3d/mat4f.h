@@ -0,0 +1,107 @@
+#ifndef LORENZ_MAT4F_H
+#define LORENZ_MAT4F_H
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "engine3d.h"
+
+/*
+Single precision twin of the engine3d math for the per-vertex hot path. Matrices are built and
+composed in double with the functions in engine3d.h, converted once per frame, and every point
+is then transformed here: 4 float lanes in one SSE register, and everything is passed by
+pointer instead of copying matrices and vectors in and out. Conventions match engine3d:
+mat[row][column], points are row vectors, and Mat4fMultiplyMat4f(out, a, b) applies b then a
+like Mat4MultiplyMat4.
+*/
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+typedef struct Vector4f {
+    _Alignas(16) float x;
+    float y;
+    float z;
+    float w;
+} Vec4f;
+
+typedef struct Matrix4x4f {
+    _Alignas(32) float mat[4][4]; // [row][column], two rows to an AVX register
+} Mat4f;
+
+// Outcode bits of projectPointsToScreen, set for each plane a clip space point is outside.
+// The sides are the guard band.
+#define CLIP_NEAR 1
+#define CLIP_FAR 2
+#define CLIP_LEFT 4
+#define CLIP_RIGHT 8
+#define CLIP_BOTTOM 16
+#define CLIP_TOP 32
+#define CLIP_OUTSIDE 63 // Every plane bit
+
+// Mat4fClassifyBox results
+#define BOX_HIDDEN 0   // Entirely outside one edge of the view, or beyond near or far
+#define BOX_CROSSING 1 // Needs clipping
+#define BOX_INSIDE 2   // Entirely between near and far and within the guard band
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+// -- Conversion --
+void Mat4fFromMat4(Mat4f* out, const Mat4* m);
+void Mat4FromMat4f(Mat4* out, const Mat4f* m);
+static inline Vec4 Vec4FromVec4f(const Vec4f* v) {
+    return (Vec4){v->x, v->y, v->z, v->w};
+}
+
+// -- Matrix Math --
+// out may be a or b
+void Mat4fMultiplyMat4f(Mat4f* out, const Mat4f* a, const Mat4f* b);
+// General inverse, not just rigid transforms like quickMatrixInverse. Returns 0 if m is singular,
+// or so nearly so that a pivot is within rounding error (16 float epsilons of m's largest entry).
+int Mat4fInverse(Mat4f* out, const Mat4f* m);
+
+// a * b for row vector b. out may be b.
+static inline void Mat4fMultiplyVec4f(Vec4f* out, const Mat4f* a, const Vec4f* b) {
+#if defined(__SSE2__)
+    __m128 v = _mm_mul_ps(_mm_set1_ps(b->x), _mm_load_ps(a->mat[0]));
+    v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(b->y), _mm_load_ps(a->mat[1])));
+    v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(b->z), _mm_load_ps(a->mat[2])));
+    v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(b->w), _mm_load_ps(a->mat[3])));
+    _mm_store_ps(&out->x, v);
+#else
+    const Vec4f v = *b;
+    out->x = v.x * a->mat[0][0] + v.y * a->mat[1][0] + v.z * a->mat[2][0] + v.w * a->mat[3][0];
+    out->y = v.x * a->mat[0][1] + v.y * a->mat[1][1] + v.z * a->mat[2][1] + v.w * a->mat[3][1];
+    out->z = v.x * a->mat[0][2] + v.y * a->mat[1][2] + v.z * a->mat[2][2] + v.w * a->mat[3][2];
+    out->w = v.x * a->mat[0][3] + v.y * a->mat[1][3] + v.z * a->mat[2][3] + v.w * a->mat[3][3];
+#endif
+}
+// The point (x, y, z, 1), straight from the caller's doubles
+static inline void Mat4fMultiplyPoint(Vec4f* out, const Mat4f* a, real x, real y, real z) {
+#if defined(__SSE2__)
+    __m128 v = _mm_mul_ps(_mm_set1_ps((float) x), _mm_load_ps(a->mat[0]));
+    v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps((float) y), _mm_load_ps(a->mat[1])));
+    v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps((float) z), _mm_load_ps(a->mat[2])));
+    _mm_store_ps(&out->x, _mm_add_ps(v, _mm_load_ps(a->mat[3])));
+#else
+    const Vec4f v = {(float) x, (float) y, (float) z, 1};
+    Mat4fMultiplyVec4f(out, a, &v);
+#endif
+}
+
+// -- Culling --
+// Classifies the axis aligned box from min to max through clipMatrix by its 8 corners. Planes
+// are linear in clip space, so corners on one side of a plane put the whole box there.
+int Mat4fClassifyBox(const Mat4f* clipMatrix, const Vec3* min, const Vec3* max, float guardBand);
+
+// -- Batched Projection --
+// Transforms count points, given as separate x, y and z arrays, by clipMatrix and projects them
+// like clipToScreen, as many at once as the vector unit allows. Screen positions are only
+// meaningful where the outcode is 0.
+void projectPointsToScreen(float* screenX, float* screenY, unsigned char* outcodes, const float* x, const float* y, const float* z, int count, const Mat4f* clipMatrix, int width, int height, float guardBand);
+
+#endif
\ No newline at end of file
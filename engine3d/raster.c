@@ -0,0 +1,290 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "raster.h"
+#include "../simulation/platform.h"
+
+#define RASTER_ALIGNMENT 64
+
+// ------------------------------------------------------
+// Setup
+// ------------------------------------------------------
+
+Rasterizer* rasterizerCreate(int width, int height, int threads) {
+    Rasterizer* raster = calloc(1, sizeof(Rasterizer));
+    if (!raster) {
+        return NULL;
+    }
+    raster->pool = threadPoolCreate(threads);
+    if (!raster->pool || !rasterizerResize(raster, width, height)) {
+        rasterizerDestroy(raster);
+        return NULL;
+    }
+    return raster;
+}
+
+void rasterizerDestroy(Rasterizer* raster) {
+    if (!raster) {
+        return;
+    }
+    if (raster->pool) {
+        threadPoolDestroy(raster->pool);
+    }
+    alignedFree(raster->pixels);
+    free(raster->primitives);
+    free(raster->binStarts);
+    free(raster->binItems);
+    free(raster);
+}
+
+int rasterizerResize(Rasterizer* raster, int width, int height) {
+    if (width < 1 || height < 1) {
+        return 0;
+    }
+    if (raster->pixels && width == raster->width && height == raster->height) {
+        return 1;
+    }
+    int tilesX = (width + RASTER_TILE - 1) / RASTER_TILE;
+    int tilesY = (height + RASTER_TILE - 1) / RASTER_TILE;
+    uint32_t* pixels = alignedAlloc(RASTER_ALIGNMENT, (size_t) width * height * sizeof(uint32_t));
+    int* binStarts = malloc((size_t) (tilesX * tilesY + 1) * sizeof(int));
+    if (!pixels || !binStarts) {
+        alignedFree(pixels);
+        free(binStarts);
+        return 0;
+    }
+    alignedFree(raster->pixels);
+    free(raster->binStarts);
+    raster->pixels = pixels;
+    raster->binStarts = binStarts;
+    raster->width = width;
+    raster->height = height;
+    raster->tilesX = tilesX;
+    raster->tilesY = tilesY;
+    return 1;
+}
+
+// ------------------------------------------------------
+// Queueing
+// ------------------------------------------------------
+
+void rasterizerBegin(Rasterizer* raster) {
+    raster->primitiveCount = 0;
+}
+
+static RasterPrimitive* queuePrimitive(Rasterizer* raster) {
+    if (raster->primitiveCount == raster->primitiveCapacity) {
+        int capacity = raster->primitiveCapacity ? raster->primitiveCapacity * 2 : 4096;
+        RasterPrimitive* grown = realloc(raster->primitives, (size_t) capacity * sizeof(RasterPrimitive));
+        if (!grown) {
+            return NULL;
+        }
+        raster->primitives = grown;
+        raster->primitiveCapacity = capacity;
+    }
+    return &raster->primitives[raster->primitiveCount++];
+}
+
+// Matches SDL's additive blend, which scales each channel by alpha before adding it
+static uint32_t premultiply(int r, int g, int b, int a) {
+    a = a < 0 ? 0 : a > 255 ? 255 : a;
+    r = (r & 255) * a / 255;
+    g = (g & 255) * a / 255;
+    b = (b & 255) * a / 255;
+    return (uint32_t) r << 16 | (uint32_t) g << 8 | (uint32_t) b;
+}
+
+void rasterizerLine(Rasterizer* raster, float x0, float y0, float x1, float y1, int r, int g, int b, int a) {
+    uint32_t color = premultiply(r, g, b, a);
+    if (!color) {
+        return; // Adds nothing
+    }
+    RasterPrimitive* primitive = queuePrimitive(raster);
+    if (primitive) {
+        *primitive = (RasterPrimitive){x0, y0, x1, y1, color, RASTER_LINE};
+    }
+}
+
+void rasterizerRect(Rasterizer* raster, float x, float y, float w, float h, int r, int g, int b, int a) {
+    uint32_t color = premultiply(r, g, b, a);
+    if (!color || w <= 0 || h <= 0) {
+        return;
+    }
+    RasterPrimitive* primitive = queuePrimitive(raster);
+    if (primitive) {
+        *primitive = (RasterPrimitive){x, y, x + w, y + h, color, RASTER_RECT};
+    }
+}
+
+// ------------------------------------------------------
+// Binning
+// ------------------------------------------------------
+
+// Tile range a primitive's bounds touch, returns 0 if it's entirely off screen
+static int tileBounds(const Rasterizer* raster, const RasterPrimitive* primitive, int* fromX, int* fromY, int* toX, int* toY) {
+    float left = fminf(primitive->x0, primitive->x1), right = fmaxf(primitive->x0, primitive->x1);
+    float top = fminf(primitive->y0, primitive->y1), bottom = fmaxf(primitive->y0, primitive->y1);
+    // Lines light the pixels their rounded coordinates land on, so pad by half a pixel
+    if (primitive->kind == RASTER_LINE) {
+        left -= 0.5f; right += 0.5f; top -= 0.5f; bottom += 0.5f;
+    }
+    if (!(right >= 0 && bottom >= 0 && left < raster->width && top < raster->height)) {
+        return 0; // Also rejects NaN
+    }
+    *fromX = left <= 0 ? 0 : (int) left / RASTER_TILE;
+    *fromY = top <= 0 ? 0 : (int) top / RASTER_TILE;
+    *toX = right >= raster->width ? raster->tilesX - 1 : (int) right / RASTER_TILE;
+    *toY = bottom >= raster->height ? raster->tilesY - 1 : (int) bottom / RASTER_TILE;
+    return 1;
+}
+
+// Counting pass then a filling pass, so every tile's list is contiguous and in submission order
+static int binPrimitives(Rasterizer* raster) {
+    const int tileCount = raster->tilesX * raster->tilesY;
+    int* starts = raster->binStarts;
+    int p, x, y, t;
+    memset(starts, 0, (size_t) (tileCount + 1) * sizeof(int));
+    for (p = 0; p < raster->primitiveCount; p++) {
+        int fromX, fromY, toX, toY;
+        if (tileBounds(raster, &raster->primitives[p], &fromX, &fromY, &toX, &toY)) {
+            for (y = fromY; y <= toY; y++) {
+                for (x = fromX; x <= toX; x++) {
+                    starts[y * raster->tilesX + x + 1]++;
+                }
+            }
+        }
+    }
+    for (t = 0; t < tileCount; t++) {
+        starts[t + 1] += starts[t];
+    }
+
+    int total = starts[tileCount];
+    if (total > raster->binCapacity) {
+        int* grown = realloc(raster->binItems, (size_t) total * sizeof(int));
+        if (!grown) {
+            return 0;
+        }
+        raster->binItems = grown;
+        raster->binCapacity = total;
+    }
+    // starts[t] is used as tile t's write cursor, which leaves it at tile t + 1's start
+    for (p = 0; p < raster->primitiveCount; p++) {
+        int fromX, fromY, toX, toY;
+        if (tileBounds(raster, &raster->primitives[p], &fromX, &fromY, &toX, &toY)) {
+            for (y = fromY; y <= toY; y++) {
+                for (x = fromX; x <= toX; x++) {
+                    raster->binItems[starts[y * raster->tilesX + x]++] = p;
+                }
+            }
+        }
+    }
+    memmove(starts + 1, starts, (size_t) tileCount * sizeof(int));
+    starts[0] = 0;
+    return 1;
+}
+
+// ------------------------------------------------------
+// Rasterizing
+// ------------------------------------------------------
+
+typedef struct TileRect {
+    int x0, y0; // Inclusive
+    int x1, y1; // Exclusive
+} TileRect;
+
+static inline void addPixel(uint32_t* pixel, uint32_t color) {
+    uint32_t d = *pixel;
+    uint32_t r = ((d >> 16) & 255) + ((color >> 16) & 255);
+    uint32_t g = ((d >> 8) & 255) + ((color >> 8) & 255);
+    uint32_t b = (d & 255) + (color & 255);
+    r = r > 255 ? 255 : r;
+    g = g > 255 ? 255 : g;
+    b = b > 255 ? 255 : b;
+    *pixel = 0xFF000000u | r << 16 | g << 8 | b;
+}
+
+/*
+Lines step one pixel at a time along their major axis and round the minor coordinate. Which
+pixels a line lights depends only on the line, never on the tile, so a line crossing tiles is
+drawn exactly once with no seams: each tile just walks the part of the major axis it owns.
+*/
+static void drawLine(Rasterizer* raster, const RasterPrimitive* line, const TileRect* tile) {
+    float x0 = line->x0, y0 = line->y0, x1 = line->x1, y1 = line->y1;
+    float dx = x1 - x0, dy = y1 - y0;
+    int xMajor = fabsf(dx) >= fabsf(dy);
+    if (xMajor ? x0 > x1 : y0 > y1) {
+        float swap;
+        swap = x0; x0 = x1; x1 = swap;
+        swap = y0; y0 = y1; y1 = swap;
+    }
+    float along0 = xMajor ? x0 : y0, along1 = xMajor ? x1 : y1;
+    float across0 = xMajor ? y0 : x0;
+    float slope = xMajor ? (dx != 0 ? dy / dx : 0) : (dy != 0 ? dx / dy : 0);
+    int from = (int) floorf(along0 + 0.5f), to = (int) floorf(along1 + 0.5f);
+    int ownFrom = xMajor ? tile->x0 : tile->y0, ownTo = xMajor ? tile->x1 : tile->y1;
+    int acrossFrom = xMajor ? tile->y0 : tile->x0, acrossTo = xMajor ? tile->y1 : tile->x1;
+    from = from < ownFrom ? ownFrom : from;
+    to = to >= ownTo ? ownTo - 1 : to;
+
+    int k;
+    for (k = from; k <= to; k++) {
+        int across = (int) floorf(across0 + (k - along0) * slope + 0.5f);
+        if (across >= acrossFrom && across < acrossTo) {
+            int x = xMajor ? k : across, y = xMajor ? across : k;
+            addPixel(&raster->pixels[(size_t) y * raster->width + x], line->color);
+        }
+    }
+}
+
+static void drawRect(Rasterizer* raster, const RasterPrimitive* rect, const TileRect* tile) {
+    int x0 = (int) floorf(rect->x0), y0 = (int) floorf(rect->y0);
+    int x1 = (int) floorf(rect->x1), y1 = (int) floorf(rect->y1);
+    x0 = x0 < tile->x0 ? tile->x0 : x0;
+    y0 = y0 < tile->y0 ? tile->y0 : y0;
+    x1 = x1 > tile->x1 ? tile->x1 : x1;
+    y1 = y1 > tile->y1 ? tile->y1 : y1;
+    int x, y;
+    for (y = y0; y < y1; y++) {
+        uint32_t* row = raster->pixels + (size_t) y * raster->width;
+        for (x = x0; x < x1; x++) {
+            addPixel(&row[x], rect->color);
+        }
+    }
+}
+
+static void rasterizeTiles(void* context, int start, int end, int worker) {
+    Rasterizer* raster = context;
+    int t, i, y;
+    (void) worker;
+    for (t = start; t < end; t++) {
+        TileRect tile;
+        tile.x0 = (t % raster->tilesX) * RASTER_TILE;
+        tile.y0 = (t / raster->tilesX) * RASTER_TILE;
+        tile.x1 = tile.x0 + RASTER_TILE > raster->width ? raster->width : tile.x0 + RASTER_TILE;
+        tile.y1 = tile.y0 + RASTER_TILE > raster->height ? raster->height : tile.y0 + RASTER_TILE;
+
+        for (y = tile.y0; y < tile.y1; y++) {
+            uint32_t* row = raster->pixels + (size_t) y * raster->width;
+            for (i = tile.x0; i < tile.x1; i++) {
+                row[i] = 0xFF000000u;
+            }
+        }
+        for (i = raster->binStarts[t]; i < raster->binStarts[t + 1]; i++) {
+            const RasterPrimitive* primitive = &raster->primitives[raster->binItems[i]];
+            if (primitive->kind == RASTER_LINE) {
+                drawLine(raster, primitive, &tile);
+            } else {
+                drawRect(raster, primitive, &tile);
+            }
+        }
+    }
+}
+
+void rasterizerFinish(Rasterizer* raster) {
+    if (!binPrimitives(raster)) {
+        // Out of memory for the bins, draw a black frame rather than a stale one
+        memset(raster->binStarts, 0, (size_t) (raster->tilesX * raster->tilesY + 1) * sizeof(int));
+    }
+    threadPoolParallelFor(raster->pool, 0, raster->tilesX * raster->tilesY, 1, rasterizeTiles, raster);
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#ifndef LORENZ_RASTER_H
+#define LORENZ_RASTER_H
+
+#include <stdint.h>
+
+#include "../simulation/threadpool.h"
+
+#define RASTER_TILE 64 // Tiles are RASTER_TILE pixels square
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+typedef enum RasterKind { RASTER_LINE, RASTER_RECT } RasterKind;
+
+typedef struct RasterPrimitive {
+    float x0, y0;   // Line endpoints, or a rect's top left
+    float x1, y1;   // and bottom right (exclusive)
+    uint32_t color; // 0x00RRGGBB, already multiplied by alpha
+    RasterKind kind;
+} RasterPrimitive;
+
+/*
+A CPU framebuffer drawn in parallel. Primitives are queued for the frame, binned into the
+tiles their bounds touch, and every tile is then cleared and drawn by one worker, so no two
+threads ever write the same pixel. Blending is additive with saturation like
+SDL_BLENDMODE_ADD, which doesn't depend on order, so the image is the same for any thread count.
+*/
+typedef struct Rasterizer {
+    uint32_t* pixels; // ARGB8888, width * height, ready for SDL_UpdateTexture
+    int width;
+    int height;
+    int tilesX;
+    int tilesY;
+
+    RasterPrimitive* primitives;
+    int primitiveCount;
+    int primitiveCapacity;
+
+    int* binStarts; // Tile t's primitives are binItems[binStarts[t]] to binItems[binStarts[t + 1] - 1]
+    int* binItems;
+    int binCapacity;
+
+    ThreadPool* pool;
+} Rasterizer;
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+// threads <= 0 uses every core. Returns NULL on failure.
+Rasterizer* rasterizerCreate(int width, int height, int threads);
+void rasterizerDestroy(Rasterizer* raster);
+// Returns 0 if the framebuffer couldn't grow, the old one is kept
+int rasterizerResize(Rasterizer* raster, int width, int height);
+
+// Drops the queued primitives to start a new frame
+void rasterizerBegin(Rasterizer* raster);
+// Colors are 0-255, a scales the color before it's added. Primitives that don't fit in memory are dropped.
+void rasterizerLine(Rasterizer* raster, float x0, float y0, float x1, float y1, int r, int g, int b, int a);
+void rasterizerRect(Rasterizer* raster, float x, float y, float w, float h, int r, int g, int b, int a);
+// Clears the framebuffer to black and draws every queued primitive into it
+void rasterizerFinish(Rasterizer* raster);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,116 @@
+#include <math.h>
+
+#include "trailview.h"
+
+int projectLine3D(int width, int height, const Vec3 p1, const Vec3 p2, const Mat4f* clipMatrix, real guardBand, Vec3* out1, Vec3* out2) {
+    Vec4f p1Transformed, p2Transformed;
+    Mat4fMultiplyPoint(&p1Transformed, clipMatrix, p1.x, p1.y, p1.z);
+    Mat4fMultiplyPoint(&p2Transformed, clipMatrix, p2.x, p2.y, p2.z);
+    Vec4 p1Clip = Vec4FromVec4f(&p1Transformed), p2Clip = Vec4FromVec4f(&p2Transformed);
+    if (!clipLineHomogeneous(&p1Clip, &p2Clip, guardBand)) {
+        return 0;
+    }
+    clipToScreen(out1, p1Clip, width, height);
+    clipToScreen(out2, p2Clip, width, height);
+    return 1;
+}
+
+int projectPoint3D(int width, int height, const Vec3 point, const Mat4f* clipMatrix, Vec3* out) {
+    Vec4f pointTransformed;
+    Mat4fMultiplyPoint(&pointTransformed, clipMatrix, point.x, point.y, point.z);
+    Vec4 pointClip = Vec4FromVec4f(&pointTransformed);
+    if (!isWithinClipSpace(pointClip)) {
+        return 0;
+    }
+    clipToScreen(out, pointClip, width, height);
+    return 1;
+}
+
+void trailFadeInit(unsigned char fade[TRAIL_FADE_STEPS + 1]) {
+    int i;
+    for (i = 0; i <= TRAIL_FADE_STEPS; i++) {
+        fade[i] = powf((float)i / TRAIL_FADE_STEPS, 5) * 255;
+    }
+}
+
+int trailWindowStart(const TrailStore* trails, int i, int trailLength, int timed, uint32_t tick, uint32_t window) {
+    int count = trailStoreCount(trails, i);
+    if (!timed) {
+        return count > trailLength ? count - trailLength : 0;
+    }
+    int start;
+    for (start = count; start > 0 && tick - trailStoreTick(trails, i, start - 1) <= window; start--);
+    return start;
+}
+
+void trailViewProject(TrailView* view, int count) {
+    // Replays keep no store to cache
+    view->cached = count && view->cache && !view->replayFrames &&
+        vertexCacheBegin(view->cache, view->trails, view->trailToClip, view->width, view->height, view->guardBand);
+    if (!view->cached) {
+        return;
+    }
+    int i;
+    for (i = 0; i < count; i++) {
+        vertexCacheRequest(view->cache, view->trails, i, trailWindowStart(view->trails, i, view->trailLength, view->timed, view->tick, view->window));
+    }
+    vertexCacheProject(view->cache, view->trails);
+}
+
+void trailViewDrawTrail(const TrailView* view, int i, const Vec3 point, TrailColor color) {
+    const TrailStore* trails = view->trails;
+    int replay = view->replayFrames != NULL;
+    int trailCount = replay ? view->replayCount : trailStoreCount(trails, i);
+    int offset = replay ? (trailCount > view->trailLength ? trailCount - view->trailLength : 0) :
+        view->cached ? view->cache->starts[i] : trailWindowStart(trails, i, view->trailLength, view->timed, view->tick, view->window);
+    int trueTrailLength = trailCount - offset; // Bad naming, but is the actual length of the trail (to account for when there are less particles than trail length)
+    if (!trueTrailLength) {
+        return;
+    }
+    // A trail whose bounds are off screen is skipped but for its last segment's color, one
+    // inside the view needs no clipping
+    int visibility = view->cached ? view->cache->visibility[i] : BOX_CROSSING;
+    color.a = 0; // A lone sample has no segment to take its fade from
+    Vec3 a, b;
+    int j;
+    for (j = visibility == BOX_HIDDEN ? (trueTrailLength > 2 ? trueTrailLength - 2 : 0) : 0; j < trueTrailLength - 1; j++) {
+        color.a = view->fade[j * TRAIL_FADE_STEPS / trueTrailLength];
+        if (view->timed) {
+            // Fade by age instead, so a sample dims at the same pace however long its segment is
+            uint32_t age = view->tick - trailStoreTick(trails, i, offset + j);
+            color.a = view->fade[(uint64_t) (view->window - age) * TRAIL_FADE_STEPS / view->window];
+        }
+        if (visibility == BOX_HIDDEN) {
+            continue;
+        }
+        if (view->cached) {
+            const ProjectedVertex* v1 = vertexCacheGet(view->cache, trails, i, offset + j);
+            const ProjectedVertex* v2 = vertexCacheGet(view->cache, trails, i, offset + j + 1);
+            if (visibility == BOX_INSIDE || !(v1->outcode | v2->outcode)) {
+                view->sink.line(view->sink.target, (Vec3){v1->x, v1->y, 0}, (Vec3){v2->x, v2->y, 0}, color);
+                continue;
+            }
+            if (v1->outcode & v2->outcode & CLIP_OUTSIDE) {
+                continue; // Both ends outside the same plane
+            }
+        }
+        // Crosses a plane (or wasn't cached), so it's clipped properly
+        Vec3 p1 = replay ? view->replayFrames[offset + j][i] : trailStoreGetFixed(trails, i, offset + j);
+        Vec3 p2 = replay ? view->replayFrames[offset + j + 1][i] : trailStoreGetFixed(trails, i, offset + j + 1);
+        if (projectLine3D(view->width, view->height, p1, p2, replay ? view->objectToClip : view->trailToClip, view->guardBand, &a, &b)) {
+            view->sink.line(view->sink.target, a, b, color);
+        }
+    }
+    // Final line to connect last point in trail with current, in the last segment's color
+    Vec3 last = replay ? view->replayFrames[offset + trueTrailLength - 1][i] : trailStoreGet(trails, i, offset + trueTrailLength - 1);
+    if (projectLine3D(view->width, view->height, last, point, view->objectToClip, view->guardBand, &a, &b)) {
+        view->sink.line(view->sink.target, a, b, color);
+    }
+}
+
+void trailViewDrawTip(const TrailView* view, const Vec3 point, TrailColor color) {
+    Vec3 a;
+    if (projectPoint3D(view->width, view->height, point, view->objectToClip, &a)) {
+        view->sink.rect(view->sink.target, (int)a.x - 1, (int)a.y - 1, 2, 2, color);
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef LORENZ_TRAILVIEW_H
+#define LORENZ_TRAILVIEW_H
+
+#include <stdint.h>
+
+#include "mat4f.h"
+#include "vertexcache.h"
+#include "../simulation/trails.h"
+
+#define TRAIL_FADE_STEPS 1024 // Resolution of the trail opacity ramp
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+typedef struct TrailColor {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    uint8_t a;
+} TrailColor;
+
+// Where the screen space primitives of trails and tips go, the viewer's draw batch or a rasterizer
+typedef struct TrailSink {
+    void (*line)(void* target, const Vec3 a, const Vec3 b, TrailColor color);
+    void (*rect)(void* target, float x, float y, float w, float h, TrailColor color);
+    void* target;
+} TrailSink;
+
+/*
+Everything a frame's trails are drawn with, shared by the viewer and the scene benchmark so they
+draw the same thing. Segments fade in along the trail, or by age for timed stores, whose samples
+are spaced unevenly. With a cache, trails whose bounds are off screen are skipped and segments
+with both ends inside the view need no clipping, the rest are clipped from the samples.
+*/
+typedef struct TrailView {
+    const TrailStore* trails;
+    const Vec3* const* replayFrames; // Replay positions standing in for the store when set, oldest first
+    int replayCount;
+    VertexCache* cache;      // NULL projects every segment from its samples
+    int cached;              // Set by trailViewProject, the cache holds this frame's windows
+    const Mat4f* objectToClip;
+    const Mat4f* trailToClip; // Takes the store's fixed point samples to clip space
+    int width;
+    int height;
+    float guardBand;
+    const unsigned char* fade; // TRAIL_FADE_STEPS + 1 opacities, see trailFadeInit
+    int trailLength;         // Samples drawn per trail
+    int timed;               // Draw the samples within window ticks of tick instead
+    uint32_t tick;
+    uint32_t window;
+    TrailSink sink;
+} TrailView;
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+// Transforms, clips and projects a line to screen space. Returns 0 if none of it is visible.
+// clipMatrix takes p1 and p2 straight to clip space, projection included.
+int projectLine3D(int width, int height, const Vec3 p1, const Vec3 p2, const Mat4f* clipMatrix, real guardBand, Vec3* out1, Vec3* out2);
+// Transforms and projects a point to screen space. Returns 0 if it's outside the view.
+int projectPoint3D(int width, int height, const Vec3 point, const Mat4f* clipMatrix, Vec3* out);
+
+// Fills the opacity ramp, indexed by how far along its trail a segment is
+void trailFadeInit(unsigned char fade[TRAIL_FADE_STEPS + 1]);
+// First sample of particle i's trail that gets drawn. Decimated trails space their samples
+// unevenly, so for timed stores it's the oldest sample within window ticks of tick instead.
+int trailWindowStart(const TrailStore* trails, int i, int trailLength, int timed, uint32_t tick, uint32_t window);
+
+// Projects the windows of the first count trails through the cache, if the view has one and it
+// could be sized. Call once a frame before drawing.
+void trailViewProject(TrailView* view, int count);
+// Draws particle i's trail and the line from its newest sample to point, in color with the fade as alpha
+void trailViewDrawTrail(const TrailView* view, int i, const Vec3 point, TrailColor color);
+// Draws a particle's tip at point
+void trailViewDrawTip(const TrailView* view, const Vec3 point, TrailColor color);
+
+#endif
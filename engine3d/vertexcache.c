@@ -0,0 +1,157 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "vertexcache.h"
+
+void vertexCacheDestroy(VertexCache* cache) {
+    free(cache->vertices);
+    free(cache->versions);
+    free(cache->writes);
+    free(cache->covered);
+    free(cache->starts);
+    free(cache->visibility);
+    free(cache->pending);
+    free(cache->batch);
+    free(cache->outcodes);
+    memset(cache, 0, sizeof(VertexCache));
+}
+
+int vertexCacheBegin(VertexCache* cache, const TrailStore* store, const Mat4f* clipMatrix, int width, int height, float guardBand) {
+    cache->pendingCount = 0;
+    if (!cache->vertices || cache->capacity != store->capacity || cache->length != store->length) {
+        vertexCacheDestroy(cache);
+        cache->vertices = malloc((size_t) store->capacity * store->length * sizeof(ProjectedVertex));
+        cache->versions = calloc(store->capacity, sizeof(uint32_t)); // Version 0 is never current
+        cache->writes = malloc((size_t) store->capacity * sizeof(uint32_t));
+        cache->covered = malloc((size_t) store->capacity * sizeof(int));
+        cache->starts = malloc((size_t) store->capacity * sizeof(int));
+        cache->visibility = malloc((size_t) store->capacity);
+        if (!cache->vertices || !cache->versions || !cache->writes || !cache->covered || !cache->starts || !cache->visibility) {
+            vertexCacheDestroy(cache);
+            return 0;
+        }
+        cache->capacity = store->capacity;
+        cache->length = store->length;
+    } else if (cache->width == width && cache->height == height && cache->guardBand == guardBand && !memcmp(&cache->clipMatrix, clipMatrix, sizeof(Mat4f))) {
+        return 1;
+    }
+    cache->clipMatrix = *clipMatrix;
+    cache->width = width;
+    cache->height = height;
+    cache->guardBand = guardBand;
+    if (++cache->version == 0) {
+        // Wrapped, so an old tag could look current again
+        memset(cache->versions, 0, (size_t) cache->capacity * sizeof(uint32_t));
+        cache->version = 1;
+    }
+    return 1;
+}
+
+static int growPending(VertexCache* cache) {
+    int capacity = cache->pendingCapacity ? cache->pendingCapacity * 2 : 4096;
+    size_t* pending = realloc(cache->pending, (size_t) capacity * sizeof(size_t));
+    if (!pending) {
+        return 0;
+    }
+    cache->pending = pending;
+    float* batch = realloc(cache->batch, (size_t) capacity * 5 * sizeof(float));
+    if (!batch) {
+        return 0;
+    }
+    cache->batch = batch;
+    unsigned char* outcodes = realloc(cache->outcodes, (size_t) capacity);
+    if (!outcodes) {
+        return 0;
+    }
+    cache->outcodes = outcodes;
+    cache->pendingCapacity = capacity;
+    return 1;
+}
+
+static void requestSlots(VertexCache* cache, const TrailStore* store, int i, int from, int to) {
+    int k;
+    for (k = from; k < to; k++) {
+        size_t slot = trailStoreSlot(store, i, k);
+        ProjectedVertex* vertex = &cache->vertices[slot];
+        const TrailSample* sample = &store->samples[slot];
+        if (vertex->outcode != VERTEX_STALE && vertex->source.x == sample->x && vertex->source.y == sample->y && vertex->source.z == sample->z) {
+            continue;
+        }
+        if (cache->pendingCount == cache->pendingCapacity && !growPending(cache)) {
+            vertex->outcode = VERTEX_STALE;
+            cache->visibility[i] = BOX_CROSSING; // So its outcodes are still checked
+            cache->covered[i] = 0;               // And the whole window is looked at again next frame
+            continue;
+        }
+        cache->pending[cache->pendingCount++] = slot;
+    }
+}
+
+/*
+Ranks count back from the newest sample. Every slot the store wrote since the last request ranks
+below the ring's writes since then, as appends, rewrites of the newest sample and drops each count
+one. The newest covered samples were projected then and have moved by at most as many ranks, so
+ranks from writes up to covered less writes are still current and only the rest of the window is
+checked.
+*/
+void vertexCacheRequest(VertexCache* cache, const TrailStore* store, int i, int from) {
+    const TrailRing* ring = &store->rings[i];
+    const int count = ring->count, wanted = count - from;
+    const uint32_t writes = ring->writes - cache->writes[i];
+    int k;
+    cache->starts[i] = from;
+    cache->writes[i] = ring->writes;
+    if (cache->versions[i] != cache->version || writes) {
+        // Unwritten under the same view the bounds, and so the visibility, are last frame's
+        if (cache->versions[i] != cache->version) {
+            cache->versions[i] = cache->version;
+            cache->covered[i] = -1; // Its slots still hold another view's projections
+        }
+        TrailBox box;
+        cache->visibility[i] = BOX_HIDDEN;
+        if (trailStoreBounds(store, i, &box)) {
+            const Vec3 min = {box.min.x, box.min.y, box.min.z}, max = {box.max.x, box.max.y, box.max.z};
+            cache->visibility[i] = Mat4fClassifyBox(&cache->clipMatrix, &min, &max, cache->guardBand);
+        }
+    }
+    if (cache->visibility[i] == BOX_HIDDEN) {
+        if (cache->covered[i] > 0) {
+            cache->covered[i] = 0; // Writes go unwatched while it's hidden
+        }
+        return;
+    }
+    if (cache->covered[i] < 0) {
+        ProjectedVertex* vertices = cache->vertices + (size_t) i * cache->length;
+        for (k = 0; k < cache->length; k++) {
+            vertices[k].outcode = VERTEX_STALE;
+        }
+        cache->covered[i] = 0;
+    }
+    const int fresh = writes < (uint32_t) wanted ? (int) writes : wanted;
+    const int known = cache->covered[i] - fresh > fresh ? cache->covered[i] - fresh : fresh;
+    cache->covered[i] = wanted;
+    requestSlots(cache, store, i, from, count - known);
+    requestSlots(cache, store, i, count - fresh, count);
+}
+
+void vertexCacheProject(VertexCache* cache, const TrailStore* store) {
+    const int count = cache->pendingCount, stride = cache->pendingCapacity;
+    float* x = cache->batch;
+    float* y = x + stride;
+    float* z = y + stride;
+    float* screenX = z + stride;
+    float* screenY = screenX + stride;
+    int n;
+    for (n = 0; n < count; n++) {
+        const TrailSample sample = store->samples[cache->pending[n]];
+        x[n] = sample.x;
+        y[n] = sample.y;
+        z[n] = sample.z;
+    }
+    projectPointsToScreen(screenX, screenY, cache->outcodes, x, y, z, count, &cache->clipMatrix, cache->width, cache->height, cache->guardBand);
+    for (n = 0; n < count; n++) {
+        size_t slot = cache->pending[n];
+        cache->vertices[slot] = (ProjectedVertex){screenX[n], screenY[n], store->samples[slot], cache->outcodes[n]};
+    }
+    cache->pendingCount = 0;
+}
\ No newline at end of file
@@ -0,0 +1,77 @@
+#ifndef LORENZ_VERTEXCACHE_H
+#define LORENZ_VERTEXCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mat4f.h"
+#include "../simulation/trails.h"
+
+#define VERTEX_STALE 128 // Outcode of a slot not projected under the current view, outside CLIP_OUTSIDE
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+typedef struct ProjectedVertex {
+    float x; // Screen position, only meaningful when outcode is 0
+    float y;
+    TrailSample source; // The sample it was projected from, a rewritten slot no longer matches
+    uint8_t outcode;    // CLIP_* bits, or VERTEX_STALE
+} ProjectedVertex;
+
+/*
+Screen positions of trail samples, kept across frames in the same slot layout as the TrailStore.
+Every view change (matrix, window size or guard band) bumps the version, and a particle's ring
+is only trusted while it was projected under the current one. Within a version each ring keeps a
+watermark, the ring's write count and how many of its newest samples were projected, so only
+slots the store wrote since the last frame (or that just came into the window) are looked at: a
+still camera projects one or two samples per particle instead of the whole trail twice over.
+Whatever does need projecting is gathered across every particle and done in one
+projectPointsToScreen batch.
+*/
+typedef struct VertexCache {
+    ProjectedVertex* vertices;
+    uint32_t* versions; // View version each particle's ring was last projected under
+    uint32_t* writes;   // The ring's write count when it was last requested
+    int* covered;       // How many of the ring's newest samples were projected then
+    int* starts;        // First sample of the window each particle requested this frame
+    unsigned char* visibility; // BOX_* of each particle's trail bounds this frame
+    int capacity;
+    int length;
+
+    Mat4f clipMatrix;
+    int width;
+    int height;
+    float guardBand;
+    uint32_t version;
+
+    size_t* pending; // Slots queued for the batch
+    float* batch;    // Inputs x, y, z then outputs x, y, pendingCapacity floats each
+    unsigned char* outcodes;
+    int pendingCount;
+    int pendingCapacity;
+} VertexCache;
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+void vertexCacheDestroy(VertexCache* cache);
+
+// Starts a frame for store, drawn through clipMatrix (fixed point samples to clip space) into
+// a width by height window, with outcodes against guardBand like clipLineHomogeneous. Returns 0
+// if the cache couldn't be sized to the store.
+int vertexCacheBegin(VertexCache* cache, const TrailStore* store, const Mat4f* clipMatrix, int width, int height, float guardBand);
+// Culls particle i's trail by its bounds, then queues its samples from from on wherever the
+// cached ones are stale. Hidden trails queue nothing. Samples that don't fit in the queue stay
+// stale, so draw them without the cache.
+void vertexCacheRequest(VertexCache* cache, const TrailStore* store, int i, int from);
+// Projects everything queued this frame
+void vertexCacheProject(VertexCache* cache, const TrailStore* store);
+
+static inline const ProjectedVertex* vertexCacheGet(const VertexCache* cache, const TrailStore* store, int i, int k) {
+    return &cache->vertices[trailStoreSlot(store, i, k)];
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include <stdatomic.h>
+#include <ctype.h>
+
+#include "attractors.h"
+#include "kernels.h"
+#include "simd.h"
+
+// ------------------------------------------------------
+// Kernel instantiation
+// ------------------------------------------------------
+
+#define KERNEL_NAME lorenz
+#define KERNEL_DERIVATIVE LORENZ_DERIVATIVE
+#define KERNEL_TANGENT LORENZ_TANGENT
+#include "kernel_template.h"
+
+#define KERNEL_NAME rossler
+#define KERNEL_DERIVATIVE ROSSLER_DERIVATIVE
+#define KERNEL_TANGENT ROSSLER_TANGENT
+#include "kernel_template.h"
+
+#define KERNEL_NAME chen
+#define KERNEL_DERIVATIVE CHEN_DERIVATIVE
+#define KERNEL_TANGENT CHEN_TANGENT
+#include "kernel_template.h"
+
+#define KERNEL_NAME thomas
+#define KERNEL_DERIVATIVE THOMAS_DERIVATIVE
+#define KERNEL_TANGENT THOMAS_TANGENT
+#include "kernel_template.h"
+
+#define KERNEL_NAME aizawa
+#define KERNEL_DERIVATIVE AIZAWA_DERIVATIVE
+#define KERNEL_TANGENT AIZAWA_TANGENT
+#include "kernel_template.h"
+
+#define KERNEL_NAME halvorsen
+#define KERNEL_DERIVATIVE HALVORSEN_DERIVATIVE
+#define KERNEL_TANGENT HALVORSEN_TANGENT
+#include "kernel_template.h"
+
+// ------------------------------------------------------
+// Registry
+// ------------------------------------------------------
+
+const Attractor attractors[ATTRACTOR_COUNT] = {
+    [ATTRACTOR_LORENZ] = {
+        "Lorenz", 3, {"sigma", "rho", "beta"}, {{10, 28, 8.0 / 3.0}},
+        {0.01, 0.01, 25.01}, 1.0, {0, 0, 25}, 0.7, 1.0,
+        lorenzRK4Batch, lorenzRK45Batch, lorenzRK4Reference, lorenzRK4Tangent,
+    },
+    [ATTRACTOR_ROSSLER] = {
+        "Rossler", 3, {"a", "b", "c"}, {{0.2, 0.2, 5.7}},
+        {1, 1, 0}, 0.5, {0, 0, 4}, 1.3, 5.0,
+        rosslerRK4Batch, rosslerRK45Batch, rosslerRK4Reference, rosslerRK4Tangent,
+    },
+    [ATTRACTOR_CHEN] = {
+        "Chen", 3, {"a", "b", "c"}, {{35, 3, 28}},
+        {-3, 2, 20}, 1.0, {0, 0, 27}, 0.7, 0.5,
+        chenRK4Batch, chenRK45Batch, chenRK4Reference, chenRK4Tangent,
+    },
+    [ATTRACTOR_THOMAS] = {
+        "Thomas", 1, {"b"}, {{0.208186}},
+        {0.1, 0, 0}, 0.2, {1, 1, 1}, 5.0, 8.0,
+        thomasRK4Batch, thomasRK45Batch, thomasRK4Reference, thomasRK4Tangent,
+    },
+    [ATTRACTOR_AIZAWA] = {
+        "Aizawa", 6, {"a", "b", "c", "d", "e", "f"}, {{0.95, 0.7, 0.6, 3.5, 0.25, 0.1}},
+        {0.1, 0, 0}, 0.05, {0, 0, 0.7}, 12.0, 3.0,
+        aizawaRK4Batch, aizawaRK45Batch, aizawaRK4Reference, aizawaRK4Tangent,
+    },
+    [ATTRACTOR_HALVORSEN] = {
+        "Halvorsen", 1, {"a"}, {{1.89}},
+        {-1.48, -1.51, 2.04}, 0.3, {-3, -3, -3}, 1.5, 1.5,
+        halvorsenRK4Batch, halvorsenRK45Batch, halvorsenRK4Reference, halvorsenRK4Tangent,
+    },
+};
+
+int attractorFromName(const char* name) {
+    int i;
+    for (i = 0; i < ATTRACTOR_COUNT; i++) {
+        const char* a = attractors[i].name;
+        const char* b = name;
+        while (*a && *b && tolower((unsigned char) *a) == tolower((unsigned char) *b)) {
+            a++;
+            b++;
+        }
+        if (!*a && !*b) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// ------------------------------------------------------
+// Parallel dispatch
+// ------------------------------------------------------
+
+typedef struct IntegrationJob {
+    const Attractor* attractor;
+    RK45Integrator* integrator;
+    ParticleStore* store;
+    TangentStore* tangent;
+    LyapunovStats* stats;
+    OccupancyGrid* occupancy;
+    const AttractorParams* params;
+    double delta; // RK4 step, or RK45 start time
+    double to;    // RK45 end time
+    int steps;
+    _Atomic long long evaluations;
+} IntegrationJob;
+
+static void rk4Task(void* context, int start, int end, int worker) {
+    IntegrationJob* job = context;
+    if (job->occupancy) {
+        // One step at a time so every step is counted while the chunk is still in cache
+        int s;
+        for (s = 0; s < job->steps; s++) {
+            job->attractor->rk4Batch(job->store, start, end, job->params, job->delta, 1);
+            occupancyAccumulate(job->occupancy, worker, job->store, start, end);
+        }
+        return;
+    }
+    job->attractor->rk4Batch(job->store, start, end, job->params, job->delta, job->steps);
+}
+
+static void rk4TangentTask(void* context, int start, int end, int worker) {
+    IntegrationJob* job = context;
+    if (job->occupancy) {
+        // Renormalizing after every step changes nothing but the cost
+        int s;
+        for (s = 0; s < job->steps; s++) {
+            job->attractor->rk4Tangent(job->store, job->tangent, start, end, job->params, job->delta, 1);
+            occupancyAccumulate(job->occupancy, worker, job->store, start, end);
+        }
+    } else {
+        job->attractor->rk4Tangent(job->store, job->tangent, start, end, job->params, job->delta, job->steps);
+    }
+    if (job->stats) {
+        lyapunovAccumulate(&job->stats->shards[worker], job->store, job->tangent, start, end);
+    }
+}
+
+static void rk45Task(void* context, int start, int end, int worker) {
+    IntegrationJob* job = context;
+    long long evaluations = job->attractor->rk45Batch(job->integrator, job->store, start, end, job->params, job->delta, job->to);
+    atomic_fetch_add(&job->evaluations, evaluations);
+    if (job->occupancy) {
+        occupancyAccumulate(job->occupancy, worker, job->store, start, end);
+    }
+}
+
+void integrateRK4Parallel(ThreadPool* pool, const Attractor* attractor, ParticleStore* store, int start, int end, const AttractorParams* params, double delta, int steps, OccupancyGrid* occupancy) {
+    IntegrationJob job = {attractor, NULL, store, NULL, NULL, occupancy, params, delta, 0, steps, 0};
+    threadPoolParallelFor(pool, start, end, INTEGRATION_GRAIN, rk4Task, &job);
+}
+
+void integrateRK4TangentParallel(ThreadPool* pool, const Attractor* attractor, ParticleStore* store, TangentStore* tangent, int start, int end, const AttractorParams* params, double delta, int steps, LyapunovStats* stats, OccupancyGrid* occupancy) {
+    IntegrationJob job = {attractor, NULL, store, tangent, stats, occupancy, params, delta, 0, steps, 0};
+    // Accumulation reads the time the chunk has just reached
+    tangent->time += delta * steps;
+    threadPoolParallelFor(pool, start, end, INTEGRATION_GRAIN, rk4TangentTask, &job);
+}
+
+long long integrateRK45Parallel(ThreadPool* pool, const Attractor* attractor, RK45Integrator* integrator, ParticleStore* store, int start, int end, const AttractorParams* params, double duration, OccupancyGrid* occupancy) {
+    IntegrationJob job = {attractor, integrator, store, NULL, NULL, occupancy, params, integrator->time, integrator->time + duration, 0, 0};
+    threadPoolParallelFor(pool, start, end, INTEGRATION_GRAIN, rk45Task, &job);
+    integrator->time += duration;
+    return atomic_load(&job.evaluations);
+}
@@ -0,0 +1,191 @@
+#ifndef LORENZ_ATTRACTORS_H
+#define LORENZ_ATTRACTORS_H
+
+#include "../engine3d/engine3d.h"
+#include "particles.h"
+#include "integrators.h"
+#include "threadpool.h"
+#include "lyapunov.h"
+#include "occupancy.h"
+
+#define ATTRACTOR_MAX_PARAMS 6
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+typedef enum AttractorSystem {
+    ATTRACTOR_LORENZ,
+    ATTRACTOR_ROSSLER,
+    ATTRACTOR_CHEN,
+    ATTRACTOR_THOMAS,
+    ATTRACTOR_AIZAWA,
+    ATTRACTOR_HALVORSEN,
+    ATTRACTOR_COUNT
+} AttractorSystem;
+
+typedef struct AttractorParameters {
+    double values[ATTRACTOR_MAX_PARAMS];
+} AttractorParams;
+
+// Kernels are generated once per system from the derivative macros below, so the derivative
+// is inlined into the integration loop. The registry only dispatches per chunk of particles.
+typedef void (*RK4BatchKernel)(ParticleStore* store, int start, int end, const AttractorParams* params, double delta, int steps);
+// Plain double precision RK4 over separate arrays, used to measure the error of the batched path
+typedef void (*RK4ReferenceKernel)(double* x, double* y, double* z, int count, const AttractorParams* params, double delta, int steps);
+// RK4 for the particles and their tangent vectors together, see lyapunov.h
+typedef void (*RK4TangentKernel)(ParticleStore* store, TangentStore* tangent, int start, int end, const AttractorParams* params, double delta, int steps);
+typedef long long (*RK45BatchKernel)(RK45Integrator* integrator, ParticleStore* store, int start, int end, const AttractorParams* params, double from, double to);
+
+typedef struct Attractor {
+    const char* name;
+    int paramCount;
+    const char* paramNames[ATTRACTOR_MAX_PARAMS];
+    AttractorParams defaults;
+
+    // Seeding and framing
+    Vec3 seedOrigin;  // Particles start in the cube [seedOrigin, seedOrigin + seedSize)
+    double seedSize;
+    Vec3 center;      // Moved to the world origin for viewing
+    double scale;     // Uniform scale that makes the attractor roughly Lorenz sized on screen
+    double timeScale; // Multiplies the timestep so every system moves at a watchable pace
+
+    RK4BatchKernel rk4Batch;
+    RK45BatchKernel rk45Batch;
+    RK4ReferenceKernel rk4Reference;
+    RK4TangentKernel rk4Tangent;
+} Attractor;
+
+// ------------------------------------------------------
+// Derivatives
+// ------------------------------------------------------
+
+/*
+Each derivative is written once against the lane/scalar function names in simd.h. O is the
+prefix (lane or scalar), p is an indexable list of parameters of the matching type, x y z
+are the state and dx dy dz receive the derivative.
+*/
+
+// sigma, rho, beta
+#define LORENZ_DERIVATIVE(O, p, x, y, z, dx, dy, dz) { \
+    dx = O##Mul(p[0], O##Sub(y, x)); \
+    dy = O##Sub(O##Mul(x, O##Sub(p[1], z)), y); \
+    dz = O##Sub(O##Mul(x, y), O##Mul(p[2], z)); \
+}
+
+// a, b, c
+#define ROSSLER_DERIVATIVE(O, p, x, y, z, dx, dy, dz) { \
+    dx = O##Sub(O##Set(0.0), O##Add(y, z)); \
+    dy = O##MulAdd(p[0], y, x); \
+    dz = O##MulAdd(z, O##Sub(x, p[2]), p[1]); \
+}
+
+// a, b, c
+#define CHEN_DERIVATIVE(O, p, x, y, z, dx, dy, dz) { \
+    dx = O##Mul(p[0], O##Sub(y, x)); \
+    dy = O##Sub(O##MulAdd(p[2], y, O##Mul(O##Sub(p[2], p[0]), x)), O##Mul(x, z)); \
+    dz = O##Sub(O##Mul(x, y), O##Mul(p[1], z)); \
+}
+
+// b
+#define THOMAS_DERIVATIVE(O, p, x, y, z, dx, dy, dz) { \
+    dx = O##Sub(O##Sin(y), O##Mul(p[0], x)); \
+    dy = O##Sub(O##Sin(z), O##Mul(p[0], y)); \
+    dz = O##Sub(O##Sin(x), O##Mul(p[0], z)); \
+}
+
+// a, b, c, d, e, f
+#define AIZAWA_DERIVATIVE(O, p, x, y, z, dx, dy, dz) { \
+    __typeof__(x) zb = O##Sub(z, p[1]); \
+    __typeof__(x) xx = O##Mul(x, x); \
+    dx = O##Sub(O##Mul(zb, x), O##Mul(p[3], y)); \
+    dy = O##MulAdd(p[3], x, O##Mul(zb, y)); \
+    dz = O##MulAdd(p[0], z, p[2]); \
+    dz = O##Sub(dz, O##Mul(O##Mul(O##Mul(z, z), z), O##Set(1.0 / 3.0))); \
+    dz = O##Sub(dz, O##Mul(O##MulAdd(y, y, xx), O##MulAdd(p[4], z, O##Set(1.0)))); \
+    dz = O##MulAdd(O##Mul(p[5], z), O##Mul(xx, x), dz); \
+}
+
+// a
+#define HALVORSEN_DERIVATIVE(O, p, x, y, z, dx, dy, dz) { \
+    __typeof__(x) four = O##Set(4.0); \
+    dx = O##Sub(O##Sub(O##Sub(O##Set(0.0), O##Mul(p[0], x)), O##Mul(four, O##Add(y, z))), O##Mul(y, y)); \
+    dy = O##Sub(O##Sub(O##Sub(O##Set(0.0), O##Mul(p[0], y)), O##Mul(four, O##Add(z, x))), O##Mul(z, z)); \
+    dz = O##Sub(O##Sub(O##Sub(O##Set(0.0), O##Mul(p[0], z)), O##Mul(four, O##Add(x, y))), O##Mul(x, x)); \
+}
+
+// ------------------------------------------------------
+// Tangent derivatives
+// ------------------------------------------------------
+
+/*
+Jacobian of each derivative above applied to a tangent vector, written out analytically in the
+same style. u v w is the tangent at state x y z and du dv dw receives J(x, y, z) * (u, v, w).
+*/
+
+#define LORENZ_TANGENT(O, p, x, y, z, u, v, w, du, dv, dw) { \
+    du = O##Mul(p[0], O##Sub(v, u)); \
+    dv = O##Sub(O##Sub(O##Mul(O##Sub(p[1], z), u), v), O##Mul(x, w)); \
+    dw = O##Sub(O##MulAdd(y, u, O##Mul(x, v)), O##Mul(p[2], w)); \
+}
+
+#define ROSSLER_TANGENT(O, p, x, y, z, u, v, w, du, dv, dw) { \
+    du = O##Sub(O##Set(0.0), O##Add(v, w)); \
+    dv = O##MulAdd(p[0], v, u); \
+    dw = O##MulAdd(z, u, O##Mul(O##Sub(x, p[2]), w)); \
+}
+
+#define CHEN_TANGENT(O, p, x, y, z, u, v, w, du, dv, dw) { \
+    du = O##Mul(p[0], O##Sub(v, u)); \
+    dv = O##Sub(O##MulAdd(p[2], v, O##Mul(O##Sub(O##Sub(p[2], p[0]), z), u)), O##Mul(x, w)); \
+    dw = O##Sub(O##MulAdd(y, u, O##Mul(x, v)), O##Mul(p[1], w)); \
+}
+
+#define THOMAS_TANGENT(O, p, x, y, z, u, v, w, du, dv, dw) { \
+    du = O##Sub(O##Mul(O##Cos(y), v), O##Mul(p[0], u)); \
+    dv = O##Sub(O##Mul(O##Cos(z), w), O##Mul(p[0], v)); \
+    dw = O##Sub(O##Mul(O##Cos(x), u), O##Mul(p[0], w)); \
+}
+
+#define AIZAWA_TANGENT(O, p, x, y, z, u, v, w, du, dv, dw) { \
+    __typeof__(x) zb = O##Sub(z, p[1]); \
+    __typeof__(x) ez = O##MulAdd(p[4], z, O##Set(1.0)); \
+    __typeof__(x) xx = O##Mul(x, x); \
+    __typeof__(x) jx = O##MulAdd(O##Mul(O##Set(3.0), p[5]), O##Mul(z, xx), O##Mul(O##Set(-2.0), O##Mul(x, ez))); \
+    __typeof__(x) jy = O##Mul(O##Set(-2.0), O##Mul(y, ez)); \
+    __typeof__(x) jz = O##Sub(O##Sub(p[0], O##Mul(z, z)), O##Mul(p[4], O##MulAdd(y, y, xx))); \
+    jz = O##MulAdd(p[5], O##Mul(xx, x), jz); \
+    du = O##MulAdd(x, w, O##Sub(O##Mul(zb, u), O##Mul(p[3], v))); \
+    dv = O##MulAdd(y, w, O##MulAdd(p[3], u, O##Mul(zb, v))); \
+    dw = O##MulAdd(jz, w, O##MulAdd(jy, v, O##Mul(jx, u))); \
+}
+
+#define HALVORSEN_TANGENT(O, p, x, y, z, u, v, w, du, dv, dw) { \
+    __typeof__(x) four = O##Set(4.0); \
+    __typeof__(x) two = O##Set(2.0); \
+    du = O##Sub(O##Sub(O##Sub(O##Set(0.0), O##Mul(p[0], u)), O##Mul(O##MulAdd(two, y, four), v)), O##Mul(four, w)); \
+    dv = O##Sub(O##Sub(O##Sub(O##Set(0.0), O##Mul(p[0], v)), O##Mul(O##MulAdd(two, z, four), w)), O##Mul(four, u)); \
+    dw = O##Sub(O##Sub(O##Sub(O##Set(0.0), O##Mul(p[0], w)), O##Mul(O##MulAdd(two, x, four), u)), O##Mul(four, v)); \
+}
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+extern const Attractor attractors[ATTRACTOR_COUNT];
+
+// Case-insensitive lookup, returns -1 if there's no system by that name
+int attractorFromName(const char* name);
+
+// Split [start, end) across the pool and run the system's specialized kernels. When occupancy
+// isn't NULL every worker integrates its chunk a step at a time and counts each step into its
+// shard of the grid, call occupancyTick after.
+void integrateRK4Parallel(ThreadPool* pool, const Attractor* attractor, ParticleStore* store, int start, int end, const AttractorParams* params, double delta, int steps, OccupancyGrid* occupancy);
+// Same as integrateRK4Parallel but also evolves the tangent vectors and advances tangent->time.
+// When stats isn't NULL every worker folds the chunks it just integrated into its own shard.
+void integrateRK4TangentParallel(ThreadPool* pool, const Attractor* attractor, ParticleStore* store, TangentStore* tangent, int start, int end, const AttractorParams* params, double delta, int steps, LyapunovStats* stats, OccupancyGrid* occupancy);
+// Advances the integrator's time by duration, returns the number of derivative evaluations.
+// Adaptive steps happen inside the kernel, so occupancy only sees the position at the end.
+long long integrateRK45Parallel(ThreadPool* pool, const Attractor* attractor, RK45Integrator* integrator, ParticleStore* store, int start, int end, const AttractorParams* params, double duration, OccupancyGrid* occupancy);
+
+#endif
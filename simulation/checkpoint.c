@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "checkpoint.h"
+#include "platform.h"
+
+static const char checkpointMagic[8] = {'L', 'O', 'R', 'E', 'N', 'Z', 'C', 'K'};
+
+// ------------------------------------------------------
+// Writing
+// ------------------------------------------------------
+
+typedef struct CheckpointContents {
+    const CheckpointState* state;
+    const void* particles; // Particle store block
+    const void* trails;    // Trail arena
+    int trailLength;
+    int trailTimed;
+    const RK45Particle* rk45;
+} CheckpointContents;
+
+static uint64_t alignOffset(uint64_t offset) {
+    return (offset + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT * CHECKPOINT_ALIGNMENT;
+}
+
+// Pads the file with zeros up to offset
+static int padTo(FILE* file, uint64_t* position, uint64_t offset) {
+    static const char zeros[CHECKPOINT_ALIGNMENT];
+    while (*position < offset) {
+        uint64_t chunk = offset - *position < sizeof(zeros) ? offset - *position : sizeof(zeros);
+        if (fwrite(zeros, 1, (size_t) chunk, file) != chunk) {
+            return 0;
+        }
+        *position += chunk;
+    }
+    return 1;
+}
+
+static int writeContents(const char* path, const CheckpointContents* contents) {
+    const int capacity = contents->state->capacity;
+    const void* data[CHECKPOINT_SECTION_COUNT] = {
+        contents->state, contents->particles, contents->trails, contents->rk45,
+    };
+    const uint64_t sizes[CHECKPOINT_SECTION_COUNT] = {
+        sizeof(CheckpointState),
+        particleStoreBytes(capacity),
+        contents->trails ? trailStoreBytes(capacity, contents->trailLength, contents->trailTimed) : 0,
+        (uint64_t) capacity * sizeof(RK45Particle),
+    };
+
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, checkpointMagic, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.realSize = sizeof(real);
+    header.trailLength = contents->trails ? contents->trailLength : 0;
+    header.trailTimed = contents->trails ? contents->trailTimed : 0;
+
+    uint64_t offset = sizeof(CheckpointHeader);
+    int s;
+    for (s = 0; s < CHECKPOINT_SECTION_COUNT; s++) {
+        if (data[s]) {
+            offset = alignOffset(offset);
+            header.sections[s].offset = offset;
+            header.sections[s].size = sizes[s];
+            offset += sizes[s];
+        }
+    }
+
+    // Write next to the target and swap it in, so a crash never leaves a torn checkpoint
+    char temporary[CHECKPOINT_PATH_MAX + 8];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    FILE* file = fopen(temporary, "wb");
+    if (!file) {
+        return 0;
+    }
+
+    uint64_t position = 0;
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    position += sizeof(header);
+    for (s = 0; s < CHECKPOINT_SECTION_COUNT && ok; s++) {
+        if (data[s]) {
+            ok = padTo(file, &position, header.sections[s].offset);
+            ok = ok && fwrite(data[s], 1, (size_t) sizes[s], file) == sizes[s];
+            position += sizes[s];
+        }
+    }
+    ok = (fclose(file) == 0) && ok;
+
+    if (!ok || !platformReplaceFile(temporary, path)) {
+        remove(temporary);
+        return 0;
+    }
+    return 1;
+}
+
+int checkpointWrite(const char* path, const CheckpointState* state, const ParticleStore* particles,
+    const TrailStore* trails, const RK45Particle* rk45) {
+    // The x array and the samples start their blocks, views included
+    CheckpointContents contents = {
+        state, particles->x, trails ? trails->samples : NULL, trails ? trails->length : 0,
+        trails && trails->ticks, rk45,
+    };
+    return writeContents(path, &contents);
+}
+
+// ------------------------------------------------------
+// Background writer
+// ------------------------------------------------------
+
+struct CheckpointWriter {
+    pthread_t thread;
+    int started;          // A thread has been created and not joined yet
+    _Atomic int busy;
+    int result;
+
+    // Private copies, grown as needed and reused between writes
+    char path[CHECKPOINT_PATH_MAX];
+    CheckpointState state;
+    void* particles;
+    size_t particleBytes;
+    void* trails;
+    size_t trailBytes;
+    int trailLength;
+    int trailTimed;
+    RK45Particle* rk45;
+    size_t rk45Bytes;
+    int hasTrails;
+    int hasRK45;
+};
+
+static void* writerMain(void* data) {
+    CheckpointWriter* writer = data;
+    CheckpointContents contents = {
+        &writer->state,
+        writer->particles,
+        writer->hasTrails ? writer->trails : NULL,
+        writer->trailLength,
+        writer->trailTimed,
+        writer->hasRK45 ? writer->rk45 : NULL,
+    };
+    writer->result = writeContents(writer->path, &contents);
+    atomic_store(&writer->busy, 0);
+    return NULL;
+}
+
+// Grows buffer to at least bytes, returns 0 on failure
+static int reserve(void** buffer, size_t* capacity, size_t bytes) {
+    if (*capacity >= bytes) {
+        return 1;
+    }
+    void* grown = realloc(*buffer, bytes);
+    if (!grown) {
+        return 0;
+    }
+    *buffer = grown;
+    *capacity = bytes;
+    return 1;
+}
+
+CheckpointWriter* checkpointWriterCreate() {
+    CheckpointWriter* writer = calloc(1, sizeof(CheckpointWriter));
+    if (!writer) {
+        return NULL;
+    }
+    atomic_init(&writer->busy, 0);
+    writer->result = 1;
+    return writer;
+}
+
+int checkpointWriterWait(CheckpointWriter* writer) {
+    if (writer->started) {
+        pthread_join(writer->thread, NULL);
+        writer->started = 0;
+    }
+    return writer->result;
+}
+
+void checkpointWriterDestroy(CheckpointWriter* writer) {
+    if (!writer) {
+        return;
+    }
+    checkpointWriterWait(writer);
+    free(writer->particles);
+    free(writer->trails);
+    free(writer->rk45);
+    free(writer);
+}
+
+int checkpointWriterSubmit(CheckpointWriter* writer, const char* path, const CheckpointState* state,
+    const ParticleStore* particles, const TrailStore* trails, const RK45Particle* rk45) {
+    if (atomic_load(&writer->busy) || strlen(path) >= CHECKPOINT_PATH_MAX) {
+        return 0;
+    }
+    checkpointWriterWait(writer);
+
+    size_t particleBytes = particleStoreBytes(state->capacity);
+    size_t trailBytes = trails ? trailStoreBytes(state->capacity, trails->length, trails->ticks != NULL) : 0;
+    size_t rk45Bytes = (size_t) state->capacity * sizeof(RK45Particle);
+    if (!reserve(&writer->particles, &writer->particleBytes, particleBytes) ||
+        (trails && !reserve(&writer->trails, &writer->trailBytes, trailBytes)) ||
+        (rk45 && !reserve((void**) &writer->rk45, &writer->rk45Bytes, rk45Bytes))) {
+        return 0;
+    }
+
+    strcpy(writer->path, path);
+    writer->state = *state;
+    memcpy(writer->particles, particles->x, particleBytes);
+    writer->hasTrails = trails != NULL;
+    if (trails) {
+        memcpy(writer->trails, trails->samples, trailBytes);
+        writer->trailLength = trails->length;
+        writer->trailTimed = trails->ticks != NULL;
+    }
+    writer->hasRK45 = rk45 != NULL;
+    if (rk45) {
+        memcpy(writer->rk45, rk45, rk45Bytes);
+    }
+
+    atomic_store(&writer->busy, 1);
+    if (pthread_create(&writer->thread, NULL, writerMain, writer)) {
+        atomic_store(&writer->busy, 0);
+        return 0;
+    }
+    writer->started = 1;
+    return 1;
+}
+
+// ------------------------------------------------------
+// Reading
+// ------------------------------------------------------
+
+static int sectionValid(const CheckpointSection* section, uint64_t expected, size_t fileSize) {
+    return section->offset % CHECKPOINT_ALIGNMENT == 0 && section->size == expected &&
+        section->offset + section->size <= fileSize;
+}
+
+static int ringsValid(void* memory, int capacity, int length, int timed) {
+    TrailStore trails;
+    trailStoreView(&trails, memory, capacity, length, timed);
+    int i;
+    for (i = 0; i < capacity; i++) {
+        if (trails.rings[i].start < 0 || trails.rings[i].start >= length ||
+            trails.rings[i].count < 0 || trails.rings[i].count > length ||
+            trails.rings[i].appended < 0 || trails.rings[i].appended > length) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int checkpointOpen(Checkpoint* checkpoint, const char* path) {
+    memset(checkpoint, 0, sizeof(*checkpoint));
+    size_t size;
+    char* mapping = platformMapFile(path, &size);
+    if (!mapping) {
+        printf("Can't map checkpoint %s\n", path);
+        return 0;
+    }
+
+    const CheckpointHeader* header = (const CheckpointHeader*) mapping;
+    const char* problem = NULL;
+    if (size < sizeof(CheckpointHeader) || memcmp(header->magic, checkpointMagic, sizeof(checkpointMagic))) {
+        problem = "not a checkpoint";
+    } else if (header->version != CHECKPOINT_VERSION) {
+        problem = "written by a different version";
+    } else if (header->realSize != sizeof(real)) {
+        problem = "precision doesn't match this build (LORENZ_SINGLE_PRECISION)";
+    } else if (!sectionValid(&header->sections[CHECKPOINT_STATE], sizeof(CheckpointState), size)) {
+        problem = "state is damaged";
+    }
+
+    const CheckpointState* state = NULL;
+    if (!problem) {
+        state = (const CheckpointState*) (mapping + header->sections[CHECKPOINT_STATE].offset);
+        const CheckpointSection* sections = header->sections;
+        if (state->capacity <= 0 || state->pointCount > state->capacity ||
+            state->system < 0 || state->system >= ATTRACTOR_COUNT) {
+            problem = "state is damaged";
+        } else if (!sectionValid(&sections[CHECKPOINT_PARTICLES], particleStoreBytes(state->capacity), size)) {
+            problem = "particles are damaged";
+        } else if (sections[CHECKPOINT_TRAILS].offset && (header->trailLength == 0 || header->trailTimed > 1 ||
+            !sectionValid(&sections[CHECKPOINT_TRAILS], trailStoreBytes(state->capacity, header->trailLength, header->trailTimed), size) ||
+            !ringsValid(mapping + sections[CHECKPOINT_TRAILS].offset, state->capacity, header->trailLength, header->trailTimed))) {
+            problem = "trails are damaged";
+        } else if (sections[CHECKPOINT_RK45].offset &&
+            !sectionValid(&sections[CHECKPOINT_RK45], (uint64_t) state->capacity * sizeof(RK45Particle), size)) {
+            problem = "RK45 state is damaged";
+        }
+    }
+    if (problem) {
+        printf("Can't load checkpoint %s: %s\n", path, problem);
+        platformUnmapFile(mapping, size);
+        return 0;
+    }
+
+    const CheckpointSection* sections = header->sections;
+    checkpoint->state = *state;
+    particleStoreView(&checkpoint->particles, mapping + sections[CHECKPOINT_PARTICLES].offset, state->capacity);
+    if (sections[CHECKPOINT_TRAILS].offset) {
+        trailStoreView(&checkpoint->trails, mapping + sections[CHECKPOINT_TRAILS].offset, state->capacity,
+            header->trailLength, header->trailTimed);
+    }
+    if (sections[CHECKPOINT_RK45].offset) {
+        checkpoint->rk45 = (RK45Particle*) (mapping + sections[CHECKPOINT_RK45].offset);
+    }
+    checkpoint->mapping = mapping;
+    checkpoint->size = size;
+    return 1;
+}
+
+void checkpointClose(Checkpoint* checkpoint) {
+    if (checkpoint->mapping) {
+        platformUnmapFile(checkpoint->mapping, checkpoint->size);
+    }
+    memset(checkpoint, 0, sizeof(*checkpoint));
+}
@@ -0,0 +1,115 @@
+#ifndef LORENZ_CHECKPOINT_H
+#define LORENZ_CHECKPOINT_H
+
+#include <stdint.h>
+
+#include "particles.h"
+#include "attractors.h"
+#include "integrators.h"
+#include "trails.h"
+
+#define CHECKPOINT_VERSION 6
+#define CHECKPOINT_ALIGNMENT 4096 // Sections start on page boundaries so they can be used in place
+#define CHECKPOINT_PATH_MAX 1024
+
+/*
+File layout, all native endian:
+
+    CheckpointHeader   magic, version, sizeof(real), section table
+    CheckpointState    settings, counters and camera
+    particles          the particle store block exactly as particleStoreBytes lays it out
+    trails             the trail arena exactly as trailStoreBytes lays it out, trailLength samples per
+                       particle, with ticks and directions when trailTimed
+    rk45               capacity RK45Particles, only for adaptive runs
+
+Any change to these structs or to the layout bumps CHECKPOINT_VERSION.
+*/
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+typedef enum CheckpointSectionId {
+    CHECKPOINT_STATE,
+    CHECKPOINT_PARTICLES,
+    CHECKPOINT_TRAILS,
+    CHECKPOINT_RK45,
+    CHECKPOINT_SECTION_COUNT
+} CheckpointSectionId;
+
+typedef struct CheckpointSection {
+    uint64_t offset; // 0 when the section is absent
+    uint64_t size;
+} CheckpointSection;
+
+typedef struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t realSize;    // sizeof(real) of the build that wrote it
+    uint32_t trailLength; // Samples per trail, 0 without trails
+    uint32_t trailTimed;  // 1 if the trails carry ticks (decimated runs)
+    CheckpointSection sections[CHECKPOINT_SECTION_COUNT];
+} CheckpointHeader;
+
+typedef struct CheckpointCamera {
+    double position[3];
+    double rotation[3];
+    int mode;
+} CheckpointCamera;
+
+typedef struct CheckpointState {
+    int system;
+    int integrator;     // IntegratorKind
+    int capacity;       // Particles stored
+    int pointCount;     // Particles being simulated
+    AttractorParams params;
+    double delta;
+    int steps;
+    double tolerance;
+    double rk45Time;
+    unsigned long long tick;
+    uint32_t seed;
+    uint32_t seedStream;
+    int seedShape;
+    int hasCamera;
+    CheckpointCamera camera;
+} CheckpointState;
+
+// A mapped checkpoint. The arrays point straight into the mapping, which is copy-on-write, so
+// they can be integrated in place without touching the file.
+typedef struct Checkpoint {
+    CheckpointState state;
+    ParticleStore particles; // View, never destroy it
+    TrailStore trails;       // View, samples is NULL if the file has none
+    RK45Particle* rk45;      // NULL if the file has none
+    void* mapping;
+    size_t size;
+} Checkpoint;
+
+typedef struct CheckpointWriter CheckpointWriter;
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+// -- Reading --
+// Maps and validates path. Returns 1 on success, otherwise prints why and returns 0.
+int checkpointOpen(Checkpoint* checkpoint, const char* path);
+void checkpointClose(Checkpoint* checkpoint);
+
+// -- Writing --
+// Writes path atomically (through a temporary file). trails and rk45 may be NULL. Returns 1 on success.
+int checkpointWrite(const char* path, const CheckpointState* state, const ParticleStore* particles,
+    const TrailStore* trails, const RK45Particle* rk45);
+
+// Background writer. Submit copies everything it needs before returning, so the caller can
+// keep simulating while the file is written. Returns NULL on failure.
+CheckpointWriter* checkpointWriterCreate();
+void checkpointWriterDestroy(CheckpointWriter* writer); // Waits for the write in flight
+// Returns 0 without doing anything if the previous write hasn't finished or a copy failed
+int checkpointWriterSubmit(CheckpointWriter* writer, const char* path, const CheckpointState* state,
+    const ParticleStore* particles, const TrailStore* trails, const RK45Particle* rk45);
+// Blocks until the write in flight finishes, returns 1 if the last write succeeded
+int checkpointWriterWait(CheckpointWriter* writer);
+
+#endif
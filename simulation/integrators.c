@@ -0,0 +1,87 @@
+#include <stdlib.h>
+
+#include "integrators.h"
+#include "kernels.h"
+
+void eulerLorenzAttractor(Vec3* point, const Vec3 params, double delta) {
+    double dxdt = params.x * (point->y - point->x);
+    dxdt *= delta;
+
+    double dydt = point->x * (params.y - point->z) - point->y;
+    dydt *= delta;
+
+    double dzdt = (point->x * point->y) - (params.z * point->z);
+    dzdt *= delta;
+
+    point->x += dxdt;
+    point->y += dydt;
+    point->z += dzdt;
+}
+
+void rk4LorenzAttractor(Vec3* point, Vec3* velocityOut, const Vec3 params, double delta) {
+    // Not the cleanest code, but it works
+    double dxk1 = (params.x * (point->y - point->x));               double x1 = point->x + delta * dxk1 / 2;
+    double dxk2 = (params.x * (point->y - x1));                     double x2 = point->x + delta * dxk2 / 2;
+    double dxk3 = (params.x * (point->y - x2));                     double x3 = point->x + delta * dxk3;
+    double dxk4 = (params.x * (point->y - x3));
+
+    double dxdt = (1.0 / 6.0) * (dxk1 + 2 * dxk2 + 2 * dxk3 + dxk4) * delta;
+
+    double dyk1 = (point->x * (params.y - point->z) - point->y);    double y1 = point->y + delta * dyk1 / 2;
+    double dyk2 = (point->x * (params.y - point->z) - y1);          double y2 = point->y + delta * dyk2 / 2;
+    double dyk3 = (point->x * (params.y - point->z) - y2);          double y3 = point->y + delta * dyk3;
+    double dyk4 = (point->x * (params.y - point->z) - y3);
+
+    double dydt = (1.0 / 6.0) * (dyk1 + 2 * dyk2 + 2 * dyk3 + dyk4) * delta;
+
+    double dzk1 = (point->x * point->y) - (params.z * point->z);    double z1 = point->z + delta * dzk1 / 2;
+    double dzk2 = (point->x * point->y) - (params.z * z1);          double z2 = point->z + delta * dzk2 / 2;
+    double dzk3 = (point->x * point->y) - (params.z * z2);          double z3 = point->z + delta * dzk3;
+    double dzk4 = (point->x * point->y) - (params.z * z3);
+
+    double dzdt = (1.0 / 6.0) * (dzk1 + 2 * dzk2 + 2 * dzk3 + dzk4) * delta;
+
+    point->x += dxdt;
+    point->y += dydt;
+    point->z += dzdt;
+
+    // For visualization purposes
+    velocityOut->x += dxdt;
+    velocityOut->y += dydt;
+    velocityOut->z += dzdt;
+}
+
+// ------------------------------------------------------
+// Adaptive Dormand-Prince 5(4)
+// ------------------------------------------------------
+
+// The per-system stepping kernels are generated in attractors.c from kernel_template.h
+
+int rk45Init(RK45Integrator* integrator, int capacity, double tolerance) {
+    integrator->particles = calloc(capacity, sizeof(RK45Particle));
+    if (!integrator->particles) {
+        return 0;
+    }
+    integrator->capacity = capacity;
+    integrator->time = 0;
+    integrator->tolerance = tolerance;
+    return 1;
+}
+
+void rk45Destroy(RK45Integrator* integrator) {
+    free(integrator->particles);
+    integrator->particles = NULL;
+    integrator->capacity = 0;
+}
+
+void rk45Reset(RK45Integrator* integrator, const ParticleStore* store, int start, int end) {
+    int i;
+    for (i = start; i < end; i++) {
+        RK45Particle* p = &integrator->particles[i];
+        p->y[0] = store->x[i];
+        p->y[1] = store->y[i];
+        p->y[2] = store->z[i];
+        rk45RestartParticle(p, integrator->time);
+    }
+}
+
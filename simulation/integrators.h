@@ -0,0 +1,57 @@
+#ifndef LORENZ_INTEGRATORS_H
+#define LORENZ_INTEGRATORS_H
+
+#include "../engine3d/engine3d.h"
+#include "particles.h"
+
+// Particles per thread pool chunk, a multiple of every LANE_WIDTH
+#define INTEGRATION_GRAIN 256
+
+#define RK45_MAX_STEP 0.1 // Upper bound on adaptive steps, keeps dense output smooth on the lobes
+#define RK45_INITIAL_STEP 0.001
+#define RK45_MIN_STEP 1e-9       // Steps this small are taken whatever their error, so stiff stretches still advance
+#define RK45_MAX_ATTEMPTS 10000  // Steps a particle may try per output interval before it's held where it is
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+// Per-particle Dormand-Prince state. Each particle runs on its own clock, usually a little
+// ahead of the frame time, and the visible position is read off the dense output polynomial
+// of its last accepted step.
+typedef struct RK45Particle {
+    double y[3];        // State at time t
+    double k1[3];       // Derivative at y (first same as last)
+    double dense[5][3]; // Continuous extension of the last accepted step
+    double t;           // Particle time
+    double tOld;        // Start of the last accepted step
+    double hOld;        // Length of the last accepted step, 0 before the first one
+    double h;           // Proposed next step
+} RK45Particle;
+
+typedef struct RK45Integrator {
+    RK45Particle* particles;
+    int capacity;
+    double time;      // Time the positions in the particle store currently show
+    double tolerance; // Used as both the absolute and relative error tolerance
+} RK45Integrator;
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+// -- Single point --
+// Point is used for x, y, and z values
+// Params is used for o, p, and B values
+void eulerLorenzAttractor(Vec3* point, const Vec3 params, double delta);
+void rk4LorenzAttractor(Vec3* point, Vec3* velocityOut, const Vec3 params, double delta);
+
+// -- Adaptive (Dormand-Prince 5(4)) --
+// Returns 1 on success, 0 if the allocation failed
+int rk45Init(RK45Integrator* integrator, int capacity, double tolerance);
+void rk45Destroy(RK45Integrator* integrator);
+// Restarts particles [start, end) from whatever is currently in the store
+void rk45Reset(RK45Integrator* integrator, const ParticleStore* store, int start, int end);
+// Stepping is done by the per-system kernels, see integrateRK45Parallel in attractors.h
+
+#endif
@@ -0,0 +1,321 @@
+/*
+Integration kernel template, deliberately without an include guard. Define KERNEL_NAME (a bare
+identifier), KERNEL_DERIVATIVE and KERNEL_TANGENT (the matching *_DERIVATIVE and *_TANGENT
+macros in attractors.h) and include this file to get the specialized functions:
+
+    static void KERNEL_NAME##RK4Batch(...)        matches RK4BatchKernel
+    static long long KERNEL_NAME##RK45Batch(...)  matches RK45BatchKernel
+    static void KERNEL_NAME##RK4Reference(...)    matches RK4ReferenceKernel
+    static void KERNEL_NAME##RK4Tangent(...)      matches RK4TangentKernel
+
+The macros are undefined again at the end so the next system can be instantiated.
+*/
+
+#if !defined(KERNEL_NAME) || !defined(KERNEL_DERIVATIVE) || !defined(KERNEL_TANGENT)
+#error "Define KERNEL_NAME, KERNEL_DERIVATIVE and KERNEL_TANGENT before including kernel_template.h"
+#endif
+
+#define KERNEL_JOIN_(a, b) a##b
+#define KERNEL_JOIN(a, b) KERNEL_JOIN_(a, b)
+#define KERNEL_RK4 KERNEL_JOIN(KERNEL_NAME, RK4Batch)
+#define KERNEL_RK45 KERNEL_JOIN(KERNEL_NAME, RK45Batch)
+#define KERNEL_RK4_SCALAR KERNEL_JOIN(KERNEL_NAME, RK4Scalar)
+#define KERNEL_RK4_REFERENCE KERNEL_JOIN(KERNEL_NAME, RK4Reference)
+#define KERNEL_RK4_TANGENT KERNEL_JOIN(KERNEL_NAME, RK4Tangent)
+#define KERNEL_RK4_TANGENT_SCALAR KERNEL_JOIN(KERNEL_NAME, RK4TangentScalar)
+
+// One point, always in double precision
+static inline void KERNEL_RK4_SCALAR(double* px, double* py, double* pz, const double* sp, double delta, int steps) {
+    double x = *px, y = *py, z = *pz;
+    int s;
+
+    for (s = 0; s < steps; s++) {
+        double k1x, k1y, k1z, k2x, k2y, k2z, k3x, k3y, k3z, k4x, k4y, k4z, sx, sy, sz;
+        KERNEL_DERIVATIVE(scalar, sp, x, y, z, k1x, k1y, k1z);
+        sx = x + delta / 2 * k1x; sy = y + delta / 2 * k1y; sz = z + delta / 2 * k1z;
+        KERNEL_DERIVATIVE(scalar, sp, sx, sy, sz, k2x, k2y, k2z);
+        sx = x + delta / 2 * k2x; sy = y + delta / 2 * k2y; sz = z + delta / 2 * k2z;
+        KERNEL_DERIVATIVE(scalar, sp, sx, sy, sz, k3x, k3y, k3z);
+        sx = x + delta * k3x; sy = y + delta * k3y; sz = z + delta * k3z;
+        KERNEL_DERIVATIVE(scalar, sp, sx, sy, sz, k4x, k4y, k4z);
+
+        x += delta / 6 * (k1x + k4x + 2 * (k2x + k3x));
+        y += delta / 6 * (k1y + k4y + 2 * (k2y + k3y));
+        z += delta / 6 * (k1z + k4z + 2 * (k2z + k3z));
+    }
+
+    *px = x;
+    *py = y;
+    *pz = z;
+}
+
+static void KERNEL_RK4_REFERENCE(double* x, double* y, double* z, int count, const AttractorParams* params, double delta, int steps) {
+    int i;
+    for (i = 0; i < count; i++) {
+        KERNEL_RK4_SCALAR(&x[i], &y[i], &z[i], params->values, delta, steps);
+    }
+}
+
+static void KERNEL_RK4(ParticleStore* store, int start, int end, const AttractorParams* params, double delta, int steps) {
+    int i, s, n;
+
+    Lane p[ATTRACTOR_MAX_PARAMS];
+    for (n = 0; n < ATTRACTOR_MAX_PARAMS; n++) {
+        p[n] = laneSet(params->values[n]);
+    }
+    Lane half = laneSet(delta / 2);
+    Lane full = laneSet(delta);
+    Lane sixth = laneSet(delta / 6);
+    Lane two = laneSet(2);
+
+    for (i = start; i + LANE_WIDTH <= end; i += LANE_WIDTH) {
+        Lane x0 = laneLoad(store->x + i);
+        Lane y0 = laneLoad(store->y + i);
+        Lane z0 = laneLoad(store->z + i);
+        Lane x = x0, y = y0, z = z0;
+
+        for (s = 0; s < steps; s++) {
+            Lane k1x, k1y, k1z, k2x, k2y, k2z, k3x, k3y, k3z, k4x, k4y, k4z, sx, sy, sz;
+            KERNEL_DERIVATIVE(lane, p, x, y, z, k1x, k1y, k1z);
+            sx = laneMulAdd(half, k1x, x); sy = laneMulAdd(half, k1y, y); sz = laneMulAdd(half, k1z, z);
+            KERNEL_DERIVATIVE(lane, p, sx, sy, sz, k2x, k2y, k2z);
+            sx = laneMulAdd(half, k2x, x); sy = laneMulAdd(half, k2y, y); sz = laneMulAdd(half, k2z, z);
+            KERNEL_DERIVATIVE(lane, p, sx, sy, sz, k3x, k3y, k3z);
+            sx = laneMulAdd(full, k3x, x); sy = laneMulAdd(full, k3y, y); sz = laneMulAdd(full, k3z, z);
+            KERNEL_DERIVATIVE(lane, p, sx, sy, sz, k4x, k4y, k4z);
+
+            // x += delta / 6 * (k1 + 2 * k2 + 2 * k3 + k4)
+            x = laneMulAdd(sixth, laneAdd(laneAdd(k1x, k4x), laneMul(two, laneAdd(k2x, k3x))), x);
+            y = laneMulAdd(sixth, laneAdd(laneAdd(k1y, k4y), laneMul(two, laneAdd(k2y, k3y))), y);
+            z = laneMulAdd(sixth, laneAdd(laneAdd(k1z, k4z), laneMul(two, laneAdd(k2z, k3z))), z);
+        }
+
+        laneStore(store->x + i, x);
+        laneStore(store->y + i, y);
+        laneStore(store->z + i, z);
+        laneStore(store->vx + i, laneSub(x, x0));
+        laneStore(store->vy + i, laneSub(y, y0));
+        laneStore(store->vz + i, laneSub(z, z0));
+    }
+
+    // Scalar remainder when the range doesn't end on a lane boundary. Each step is rounded to real
+    // like the lanes are, so these particles get the same precision whatever the batch size.
+    for (; i < end; i++) {
+        real x = store->x[i], y = store->y[i], z = store->z[i];
+        for (s = 0; s < steps; s++) {
+            double px = x, py = y, pz = z;
+            KERNEL_RK4_SCALAR(&px, &py, &pz, params->values, delta, 1);
+            x = (real) px;
+            y = (real) py;
+            z = (real) pz;
+        }
+
+        store->vx[i] = x - store->x[i];
+        store->vy[i] = y - store->y[i];
+        store->vz[i] = z - store->z[i];
+        store->x[i] = x;
+        store->y[i] = y;
+        store->z[i] = z;
+    }
+}
+
+// One step of a point and its tangent, always in double precision. The tangent goes through the
+// same stages as the point, linearized at each stage's state.
+static inline void KERNEL_RK4_TANGENT_SCALAR(double* state, double* tangent, const double* sp, double delta) {
+    double x = state[0], y = state[1], z = state[2];
+    double u = tangent[0], v = tangent[1], w = tangent[2];
+
+    double k1x, k1y, k1z, k2x, k2y, k2z, k3x, k3y, k3z, k4x, k4y, k4z, sx, sy, sz;
+    double k1u, k1v, k1w, k2u, k2v, k2w, k3u, k3v, k3w, k4u, k4v, k4w, su, sv, sw;
+    KERNEL_DERIVATIVE(scalar, sp, x, y, z, k1x, k1y, k1z);
+    KERNEL_TANGENT(scalar, sp, x, y, z, u, v, w, k1u, k1v, k1w);
+    sx = x + delta / 2 * k1x; sy = y + delta / 2 * k1y; sz = z + delta / 2 * k1z;
+    su = u + delta / 2 * k1u; sv = v + delta / 2 * k1v; sw = w + delta / 2 * k1w;
+    KERNEL_DERIVATIVE(scalar, sp, sx, sy, sz, k2x, k2y, k2z);
+    KERNEL_TANGENT(scalar, sp, sx, sy, sz, su, sv, sw, k2u, k2v, k2w);
+    sx = x + delta / 2 * k2x; sy = y + delta / 2 * k2y; sz = z + delta / 2 * k2z;
+    su = u + delta / 2 * k2u; sv = v + delta / 2 * k2v; sw = w + delta / 2 * k2w;
+    KERNEL_DERIVATIVE(scalar, sp, sx, sy, sz, k3x, k3y, k3z);
+    KERNEL_TANGENT(scalar, sp, sx, sy, sz, su, sv, sw, k3u, k3v, k3w);
+    sx = x + delta * k3x; sy = y + delta * k3y; sz = z + delta * k3z;
+    su = u + delta * k3u; sv = v + delta * k3v; sw = w + delta * k3w;
+    KERNEL_DERIVATIVE(scalar, sp, sx, sy, sz, k4x, k4y, k4z);
+    KERNEL_TANGENT(scalar, sp, sx, sy, sz, su, sv, sw, k4u, k4v, k4w);
+
+    x += delta / 6 * (k1x + k4x + 2 * (k2x + k3x));
+    y += delta / 6 * (k1y + k4y + 2 * (k2y + k3y));
+    z += delta / 6 * (k1z + k4z + 2 * (k2z + k3z));
+    u += delta / 6 * (k1u + k4u + 2 * (k2u + k3u));
+    v += delta / 6 * (k1v + k4v + 2 * (k2v + k3v));
+    w += delta / 6 * (k1w + k4w + 2 * (k2w + k3w));
+
+    state[0] = x; state[1] = y; state[2] = z;
+    tangent[0] = u; tangent[1] = v; tangent[2] = w;
+}
+
+static void KERNEL_RK4_TANGENT(ParticleStore* store, TangentStore* tangent, int start, int end, const AttractorParams* params, double delta, int steps) {
+    int i, s, n;
+
+    Lane p[ATTRACTOR_MAX_PARAMS];
+    for (n = 0; n < ATTRACTOR_MAX_PARAMS; n++) {
+        p[n] = laneSet(params->values[n]);
+    }
+    Lane half = laneSet(delta / 2);
+    Lane full = laneSet(delta);
+    Lane sixth = laneSet(delta / 6);
+    Lane two = laneSet(2);
+
+    for (i = start; i + LANE_WIDTH <= end; i += LANE_WIDTH) {
+        Lane x0 = laneLoad(store->x + i);
+        Lane y0 = laneLoad(store->y + i);
+        Lane z0 = laneLoad(store->z + i);
+        Lane x = x0, y = y0, z = z0;
+        Lane u = laneLoad(tangent->x + i);
+        Lane v = laneLoad(tangent->y + i);
+        Lane w = laneLoad(tangent->z + i);
+
+        for (s = 0; s < steps; s++) {
+            Lane k1x, k1y, k1z, k2x, k2y, k2z, k3x, k3y, k3z, k4x, k4y, k4z, sx, sy, sz;
+            Lane k1u, k1v, k1w, k2u, k2v, k2w, k3u, k3v, k3w, k4u, k4v, k4w, su, sv, sw;
+            KERNEL_DERIVATIVE(lane, p, x, y, z, k1x, k1y, k1z);
+            KERNEL_TANGENT(lane, p, x, y, z, u, v, w, k1u, k1v, k1w);
+            sx = laneMulAdd(half, k1x, x); sy = laneMulAdd(half, k1y, y); sz = laneMulAdd(half, k1z, z);
+            su = laneMulAdd(half, k1u, u); sv = laneMulAdd(half, k1v, v); sw = laneMulAdd(half, k1w, w);
+            KERNEL_DERIVATIVE(lane, p, sx, sy, sz, k2x, k2y, k2z);
+            KERNEL_TANGENT(lane, p, sx, sy, sz, su, sv, sw, k2u, k2v, k2w);
+            sx = laneMulAdd(half, k2x, x); sy = laneMulAdd(half, k2y, y); sz = laneMulAdd(half, k2z, z);
+            su = laneMulAdd(half, k2u, u); sv = laneMulAdd(half, k2v, v); sw = laneMulAdd(half, k2w, w);
+            KERNEL_DERIVATIVE(lane, p, sx, sy, sz, k3x, k3y, k3z);
+            KERNEL_TANGENT(lane, p, sx, sy, sz, su, sv, sw, k3u, k3v, k3w);
+            sx = laneMulAdd(full, k3x, x); sy = laneMulAdd(full, k3y, y); sz = laneMulAdd(full, k3z, z);
+            su = laneMulAdd(full, k3u, u); sv = laneMulAdd(full, k3v, v); sw = laneMulAdd(full, k3w, w);
+            KERNEL_DERIVATIVE(lane, p, sx, sy, sz, k4x, k4y, k4z);
+            KERNEL_TANGENT(lane, p, sx, sy, sz, su, sv, sw, k4u, k4v, k4w);
+
+            x = laneMulAdd(sixth, laneAdd(laneAdd(k1x, k4x), laneMul(two, laneAdd(k2x, k3x))), x);
+            y = laneMulAdd(sixth, laneAdd(laneAdd(k1y, k4y), laneMul(two, laneAdd(k2y, k3y))), y);
+            z = laneMulAdd(sixth, laneAdd(laneAdd(k1z, k4z), laneMul(two, laneAdd(k2z, k3z))), z);
+            u = laneMulAdd(sixth, laneAdd(laneAdd(k1u, k4u), laneMul(two, laneAdd(k2u, k3u))), u);
+            v = laneMulAdd(sixth, laneAdd(laneAdd(k1v, k4v), laneMul(two, laneAdd(k2v, k3v))), v);
+            w = laneMulAdd(sixth, laneAdd(laneAdd(k1w, k4w), laneMul(two, laneAdd(k2w, k3w))), w);
+
+            // Keep the tangent near unit length so it can't overflow, float especially
+            if ((s + 1) % LYAPUNOV_RENORMALIZE_STEPS == 0 || s + 1 == steps) {
+                tangentRenormalizeLanes(&u, &v, &w, tangent->logGrowth + i);
+            }
+        }
+
+        laneStore(store->x + i, x);
+        laneStore(store->y + i, y);
+        laneStore(store->z + i, z);
+        laneStore(store->vx + i, laneSub(x, x0));
+        laneStore(store->vy + i, laneSub(y, y0));
+        laneStore(store->vz + i, laneSub(z, z0));
+        laneStore(tangent->x + i, u);
+        laneStore(tangent->y + i, v);
+        laneStore(tangent->z + i, w);
+    }
+
+    // Rounded to real after every step and renormalized on the same steps as the lanes
+    for (; i < end; i++) {
+        real x = store->x[i], y = store->y[i], z = store->z[i];
+        real u = tangent->x[i], v = tangent->y[i], w = tangent->z[i];
+        for (s = 0; s < steps; s++) {
+            double state[3] = {x, y, z};
+            double direction[3] = {u, v, w};
+            KERNEL_RK4_TANGENT_SCALAR(state, direction, params->values, delta);
+            if ((s + 1) % LYAPUNOV_RENORMALIZE_STEPS == 0 || s + 1 == steps) {
+                tangentRenormalize(&direction[0], &direction[1], &direction[2], &tangent->logGrowth[i]);
+            }
+            x = (real) state[0]; y = (real) state[1]; z = (real) state[2];
+            u = (real) direction[0]; v = (real) direction[1]; w = (real) direction[2];
+        }
+
+        store->vx[i] = x - store->x[i];
+        store->vy[i] = y - store->y[i];
+        store->vz[i] = z - store->z[i];
+        store->x[i] = x;
+        store->y[i] = y;
+        store->z[i] = z;
+        tangent->x[i] = u;
+        tangent->y[i] = v;
+        tangent->z[i] = w;
+    }
+}
+
+static long long KERNEL_RK45(RK45Integrator* integrator, ParticleStore* store, int start, int end, const AttractorParams* params, double from, double to) {
+    const double tolerance = integrator->tolerance;
+    const double* sp = params->values;
+    long long evaluations = 0;
+    int i, c;
+
+    for (i = start; i < end; i++) {
+        RK45Particle* particle = &integrator->particles[i];
+        double k2[3], k3[3], k4[3], k5[3], k6[3], k7[3], stage[3], next[3];
+
+        if (particle->t < from) {
+            rk45RestartParticle(particle, from);
+        }
+        if (particle->hOld <= 0) {
+            KERNEL_DERIVATIVE(scalar, sp, particle->y[0], particle->y[1], particle->y[2], particle->k1[0], particle->k1[1], particle->k1[2]);
+            evaluations++;
+        }
+
+        int attempts = 0;
+        while (particle->t < to) {
+            if (++attempts > RK45_MAX_ATTEMPTS) {
+                // Stiff or diverged, so it's held for this interval rather than stalling the pool.
+                // Restarting at to shows y and recomputes k1 next time.
+                rk45RestartParticle(particle, to);
+                break;
+            }
+            double h = particle->h;
+            const double* y = particle->y;
+            const double* k1 = particle->k1;
+
+            for (c = 0; c < 3; c++) stage[c] = y[c] + h * (dpA21 * k1[c]);
+            KERNEL_DERIVATIVE(scalar, sp, stage[0], stage[1], stage[2], k2[0], k2[1], k2[2]);
+            for (c = 0; c < 3; c++) stage[c] = y[c] + h * (dpA31 * k1[c] + dpA32 * k2[c]);
+            KERNEL_DERIVATIVE(scalar, sp, stage[0], stage[1], stage[2], k3[0], k3[1], k3[2]);
+            for (c = 0; c < 3; c++) stage[c] = y[c] + h * (dpA41 * k1[c] + dpA42 * k2[c] + dpA43 * k3[c]);
+            KERNEL_DERIVATIVE(scalar, sp, stage[0], stage[1], stage[2], k4[0], k4[1], k4[2]);
+            for (c = 0; c < 3; c++) stage[c] = y[c] + h * (dpA51 * k1[c] + dpA52 * k2[c] + dpA53 * k3[c] + dpA54 * k4[c]);
+            KERNEL_DERIVATIVE(scalar, sp, stage[0], stage[1], stage[2], k5[0], k5[1], k5[2]);
+            for (c = 0; c < 3; c++) stage[c] = y[c] + h * (dpA61 * k1[c] + dpA62 * k2[c] + dpA63 * k3[c] + dpA64 * k4[c] + dpA65 * k5[c]);
+            KERNEL_DERIVATIVE(scalar, sp, stage[0], stage[1], stage[2], k6[0], k6[1], k6[2]);
+            for (c = 0; c < 3; c++) next[c] = y[c] + h * (dpA71 * k1[c] + dpA73 * k3[c] + dpA74 * k4[c] + dpA75 * k5[c] + dpA76 * k6[c]);
+            KERNEL_DERIVATIVE(scalar, sp, next[0], next[1], next[2], k7[0], k7[1], k7[2]);
+            evaluations += 6;
+
+            double error = rk45ErrorNorm(h, y, next, k1, k3, k4, k5, k6, k7, tolerance);
+            if (!rk45FinishStep(particle, h, error, next, k3, k4, k5, k6, k7)) {
+                rk45RestartParticle(particle, to);
+                break;
+            }
+        }
+
+        // The particle is now at or past `to`, interpolate back for display
+        double shown[3];
+        rk45DenseOutput(particle, to, shown);
+        store->vx[i] = shown[0] - store->x[i];
+        store->vy[i] = shown[1] - store->y[i];
+        store->vz[i] = shown[2] - store->z[i];
+        store->x[i] = shown[0];
+        store->y[i] = shown[1];
+        store->z[i] = shown[2];
+    }
+
+    return evaluations;
+}
+
+#undef KERNEL_RK4
+#undef KERNEL_RK45
+#undef KERNEL_RK4_SCALAR
+#undef KERNEL_RK4_REFERENCE
+#undef KERNEL_RK4_TANGENT
+#undef KERNEL_RK4_TANGENT_SCALAR
+#undef KERNEL_JOIN
+#undef KERNEL_JOIN_
+#undef KERNEL_NAME
+#undef KERNEL_DERIVATIVE
+#undef KERNEL_TANGENT
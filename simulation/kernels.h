@@ -0,0 +1,143 @@
+#ifndef LORENZ_KERNELS_H
+#define LORENZ_KERNELS_H
+
+#include <math.h>
+
+#include "integrators.h"
+#include "lyapunov.h"
+#include "simd.h"
+
+/*
+Pieces shared by every generated integration kernel (see kernel_template.h). Only included
+by the simulation sources, nothing here is part of the public interface.
+*/
+
+// ------------------------------------------------------
+// Dormand-Prince 5(4) tableau
+// ------------------------------------------------------
+
+static const double dpA21 = 1.0 / 5.0;
+static const double dpA31 = 3.0 / 40.0, dpA32 = 9.0 / 40.0;
+static const double dpA41 = 44.0 / 45.0, dpA42 = -56.0 / 15.0, dpA43 = 32.0 / 9.0;
+static const double dpA51 = 19372.0 / 6561.0, dpA52 = -25360.0 / 2187.0, dpA53 = 64448.0 / 6561.0, dpA54 = -212.0 / 729.0;
+static const double dpA61 = 9017.0 / 3168.0, dpA62 = -355.0 / 33.0, dpA63 = 46732.0 / 5247.0, dpA64 = 49.0 / 176.0, dpA65 = -5103.0 / 18656.0;
+static const double dpA71 = 35.0 / 384.0, dpA73 = 500.0 / 1113.0, dpA74 = 125.0 / 192.0, dpA75 = -2187.0 / 6784.0, dpA76 = 11.0 / 84.0;
+// Difference between the 5th and 4th order weights
+static const double dpE1 = 71.0 / 57600.0, dpE3 = -71.0 / 16695.0, dpE4 = 71.0 / 1920.0, dpE5 = -17253.0 / 339200.0, dpE6 = 22.0 / 525.0, dpE7 = -1.0 / 40.0;
+// Dense output
+static const double dpD1 = -12715105075.0 / 11282082432.0, dpD3 = 87487479700.0 / 32700410799.0, dpD4 = -10690763975.0 / 1880347072.0;
+static const double dpD5 = 701980252875.0 / 199316789632.0, dpD6 = -1453857185.0 / 822651844.0, dpD7 = 69997945.0 / 29380423.0;
+
+// ------------------------------------------------------
+// RK45 helpers
+// ------------------------------------------------------
+
+static inline void rk45RestartParticle(RK45Particle* p, double time) {
+    p->t = time;
+    p->tOld = time;
+    p->hOld = 0;
+    p->h = RK45_INITIAL_STEP;
+}
+
+static inline void rk45DenseOutput(const RK45Particle* p, double t, double* out) {
+    int c;
+    if (p->hOld <= 0) {
+        out[0] = p->y[0]; out[1] = p->y[1]; out[2] = p->y[2];
+        return;
+    }
+    double theta = (t - p->tOld) / p->hOld;
+    double theta1 = 1.0 - theta;
+    for (c = 0; c < 3; c++) {
+        out[c] = p->dense[0][c] + theta * (p->dense[1][c] + theta1 * (p->dense[2][c] + theta * (p->dense[3][c] + theta1 * p->dense[4][c])));
+    }
+}
+
+// Scaled RMS of the embedded error estimate, 1.0 means exactly on tolerance
+static inline double rk45ErrorNorm(double h, const double* y, const double* next, const double* k1, const double* k3, const double* k4,
+    const double* k5, const double* k6, const double* k7, double tolerance) {
+    double error = 0;
+    int c;
+    for (c = 0; c < 3; c++) {
+        double e = h * (dpE1 * k1[c] + dpE3 * k3[c] + dpE4 * k4[c] + dpE5 * k5[c] + dpE6 * k6[c] + dpE7 * k7[c]);
+        double scale = tolerance + tolerance * fmax(fabs(y[c]), fabs(next[c]));
+        error += (e / scale) * (e / scale);
+    }
+    return sqrt(error / 3.0);
+}
+
+// Accepts or rejects the trial step and picks the next step size. Returns 0 if the step can't be
+// taken at all: its error isn't finite even at RK45_MIN_STEP.
+static inline int rk45FinishStep(RK45Particle* p, double h, double error, const double* next, const double* k3, const double* k4,
+    const double* k5, const double* k6, const double* k7) {
+    // Standard step size controller, growth limited to [0.2, 5] per step. A NaN error (overflowed
+    // stages, or a zero tolerance) shrinks the step like a huge one.
+    double factor = isnan(error) ? 0.2 : error > 0 ? 0.9 * pow(error, -0.2) : 5.0;
+    factor = fmin(5.0, fmax(0.2, factor));
+
+    if (!(error <= 1.0)) {
+        if (h > RK45_MIN_STEP) {
+            p->h = fmax(h * factor, RK45_MIN_STEP);
+            return 1;
+        }
+        if (!isfinite(error)) {
+            return 0;
+        }
+    }
+
+    int c;
+    for (c = 0; c < 3; c++) {
+        double difference = next[c] - p->y[c];
+        double bspl = h * p->k1[c] - difference;
+        p->dense[0][c] = p->y[c];
+        p->dense[1][c] = difference;
+        p->dense[2][c] = bspl;
+        p->dense[3][c] = difference - h * k7[c] - bspl;
+        p->dense[4][c] = h * (dpD1 * p->k1[c] + dpD3 * k3[c] + dpD4 * k4[c] + dpD5 * k5[c] + dpD6 * k6[c] + dpD7 * k7[c]);
+    }
+    for (c = 0; c < 3; c++) {
+        p->y[c] = next[c];
+        p->k1[c] = k7[c];
+    }
+    p->tOld = p->t;
+    p->hOld = h;
+    p->t += h;
+    p->h = fmin(h * factor, RK45_MAX_STEP);
+    return 1;
+}
+
+// ------------------------------------------------------
+// Tangent helpers
+// ------------------------------------------------------
+
+// Scales each lane's tangent back to unit length and adds the log of the removed stretch to
+// logGrowth. There's no vector log, so the norms go through memory like laneSin.
+static inline void tangentRenormalizeLanes(Lane* u, Lane* v, Lane* w, double* logGrowth) {
+    real values[LANE_WIDTH];
+    int l;
+    laneStore(values, laneMulAdd(*u, *u, laneMulAdd(*v, *v, laneMul(*w, *w))));
+    for (l = 0; l < LANE_WIDTH; l++) {
+        double norm = sqrt((double) values[l]);
+        if (norm > 0) {
+            logGrowth[l] += log(norm);
+            values[l] = 1.0 / norm;
+        } else {
+            values[l] = 1;
+        }
+    }
+    Lane inverse = laneLoad(values);
+    *u = laneMul(*u, inverse);
+    *v = laneMul(*v, inverse);
+    *w = laneMul(*w, inverse);
+}
+
+static inline void tangentRenormalize(double* u, double* v, double* w, double* logGrowth) {
+    double norm = sqrt(*u * *u + *v * *v + *w * *w);
+    if (norm > 0) {
+        *logGrowth += log(norm);
+        *u /= norm;
+        *v /= norm;
+        *w /= norm;
+    }
+}
+
+#endif
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "lyapunov.h"
+#include "platform.h"
+#include "simd.h"
+
+// ------------------------------------------------------
+// Tangent store
+// ------------------------------------------------------
+
+int tangentStoreInit(TangentStore* tangent, int capacity) {
+    // Same layout rules as the particle store so kernels can walk both with one index
+    int padded = ((capacity + LANE_WIDTH - 1) / LANE_WIDTH) * LANE_WIDTH;
+    size_t realStride = ((padded * sizeof(real) + LANE_ALIGNMENT - 1) / LANE_ALIGNMENT) * LANE_ALIGNMENT;
+    size_t doubleStride = ((padded * sizeof(double) + LANE_ALIGNMENT - 1) / LANE_ALIGNMENT) * LANE_ALIGNMENT;
+    size_t bytes = realStride * 3 + doubleStride * 2;
+
+    char* block = alignedAlloc(LANE_ALIGNMENT, bytes);
+    if (!block) {
+        return 0;
+    }
+    memset(block, 0, bytes);
+
+    tangent->x = (real*) block;
+    tangent->y = (real*) (block + realStride);
+    tangent->z = (real*) (block + realStride * 2);
+    tangent->logGrowth = (double*) (block + realStride * 3);
+    tangent->origin = (double*) (block + realStride * 3 + doubleStride);
+    tangent->time = 0;
+    tangent->capacity = padded;
+    tangent->block = block;
+    tangentStoreReset(tangent, 0, padded);
+    return 1;
+}
+
+void tangentStoreDestroy(TangentStore* tangent) {
+    alignedFree(tangent->block);
+    memset(tangent, 0, sizeof(*tangent));
+}
+
+void tangentStoreReset(TangentStore* tangent, int start, int end) {
+    // Any direction works as long as it isn't special for the system, the stretching quickly
+    // turns it towards the most unstable one
+    const double length = sqrt(1.0 + 4.0 + 9.0);
+    int i;
+    for (i = start; i < end; i++) {
+        tangent->x[i] = 1.0 / length;
+        tangent->y[i] = 2.0 / length;
+        tangent->z[i] = 3.0 / length;
+        tangent->logGrowth[i] = 0;
+        tangent->origin[i] = tangent->time;
+    }
+}
+
+// ------------------------------------------------------
+// Statistics
+// ------------------------------------------------------
+
+int lyapunovStatsInit(LyapunovStats* stats, int shardCount) {
+    stats->shards = alignedAlloc(LANE_ALIGNMENT, shardCount * sizeof(LyapunovShard));
+    if (!stats->shards) {
+        return 0;
+    }
+    stats->shardCount = shardCount;
+    lyapunovStatsClear(stats);
+    return 1;
+}
+
+void lyapunovStatsDestroy(LyapunovStats* stats) {
+    alignedFree(stats->shards);
+    memset(stats, 0, sizeof(*stats));
+}
+
+void lyapunovStatsClear(LyapunovStats* stats) {
+    int i;
+    memset(stats->shards, 0, stats->shardCount * sizeof(LyapunovShard));
+    for (i = 0; i < stats->shardCount; i++) {
+        stats->shards[i].exponentMin = INFINITY;
+        stats->shards[i].exponentMax = -INFINITY;
+    }
+}
+
+void lyapunovAccumulate(LyapunovShard* shard, const ParticleStore* store, const TangentStore* tangent, int start, int end) {
+    const double binScale = DIVERGENCE_BINS / (DIVERGENCE_MAX_LOG - DIVERGENCE_MIN_LOG);
+    int i;
+
+    for (i = start; i < end; i++) {
+        double elapsed = tangent->time - tangent->origin[i];
+        if (elapsed <= 0) {
+            continue;
+        }
+        double exponent = tangent->logGrowth[i] / elapsed;
+        shard->exponentSum += exponent;
+        shard->exponentSquares += exponent * exponent;
+        shard->exponentMin = fmin(shard->exponentMin, exponent);
+        shard->exponentMax = fmax(shard->exponentMax, exponent);
+        shard->particles++;
+    }
+
+    // Only pairs that lie entirely inside this chunk, chunks are an even number of particles long
+    for (i = start + (start & 1); i + 1 < end; i += 2) {
+        double dx = store->x[i + 1] - store->x[i];
+        double dy = store->y[i + 1] - store->y[i];
+        double dz = store->z[i + 1] - store->z[i];
+        // Pairs can collapse onto the same value in float, so clamp to the bottom of the histogram
+        double separation = fmax(log10(sqrt(dx * dx + dy * dy + dz * dz)), DIVERGENCE_MIN_LOG);
+        int bin = (int) floor((separation - DIVERGENCE_MIN_LOG) * binScale);
+        bin = bin < 0 ? 0 : bin >= DIVERGENCE_BINS ? DIVERGENCE_BINS - 1 : bin;
+        shard->histogram[bin]++;
+        shard->pairLogSum += separation;
+        shard->pairs++;
+    }
+}
+
+void lyapunovMerge(const LyapunovStats* stats, double time, LyapunovReport* report) {
+    double sum = 0, squares = 0, pairLogSum = 0;
+    int i, b;
+
+    memset(report, 0, sizeof(*report));
+    report->time = time;
+    report->minimum = INFINITY;
+    report->maximum = -INFINITY;
+    for (i = 0; i < stats->shardCount; i++) {
+        const LyapunovShard* shard = &stats->shards[i];
+        sum += shard->exponentSum;
+        squares += shard->exponentSquares;
+        pairLogSum += shard->pairLogSum;
+        report->particles += shard->particles;
+        report->pairs += shard->pairs;
+        report->minimum = fmin(report->minimum, shard->exponentMin);
+        report->maximum = fmax(report->maximum, shard->exponentMax);
+        for (b = 0; b < DIVERGENCE_BINS; b++) {
+            report->histogram[b] += shard->histogram[b];
+        }
+    }
+
+    if (report->particles > 0) {
+        report->mean = sum / report->particles;
+        report->deviation = sqrt(fmax(0.0, squares / report->particles - report->mean * report->mean));
+    } else {
+        report->minimum = report->maximum = 0;
+    }
+    if (report->pairs > 0) {
+        report->pairLogMean = pairLogSum / report->pairs;
+    }
+}
+
+void lyapunovPrintReport(const LyapunovReport* report, const char* name, int pairs) {
+    printf("lyapunov (%s, t=%.4g, %lld particles): mean %.4f sd %.4f range [%.4f, %.4f]",
+        name, report->time, report->particles, report->mean, report->deviation, report->minimum, report->maximum);
+    if (!pairs || report->pairs == 0) {
+        printf("\n");
+        return;
+    }
+    printf(", pair log10 separation %.3f\n", report->pairLogMean);
+
+    long long largest = 1;
+    int b;
+    for (b = 0; b < DIVERGENCE_BINS; b++) {
+        largest = report->histogram[b] > largest ? report->histogram[b] : largest;
+    }
+    for (b = 0; b < DIVERGENCE_BINS; b++) {
+        const double width = (DIVERGENCE_MAX_LOG - DIVERGENCE_MIN_LOG) / DIVERGENCE_BINS;
+        char bar[41];
+        int length = (int) (40 * report->histogram[b] / largest);
+        memset(bar, '#', length);
+        bar[length] = '\0';
+        printf("  10^%+5.1f %10lld %s\n", DIVERGENCE_MIN_LOG + b * width, report->histogram[b], bar);
+    }
+}
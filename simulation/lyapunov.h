@@ -0,0 +1,85 @@
+#ifndef LORENZ_LYAPUNOV_H
+#define LORENZ_LYAPUNOV_H
+
+#include "particles.h"
+
+#define LYAPUNOV_RENORMALIZE_STEPS 8 // RK4 steps between tangent renormalizations inside a kernel
+#define DIVERGENCE_BINS 32
+#define DIVERGENCE_MIN_LOG -12.0     // log10 of the separation at the bottom of the first bin, smaller ones are clamped
+#define DIVERGENCE_MAX_LOG 4.0       // log10 of the separation at the top of the last bin
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+// One tangent (variational) vector per particle, evolved with the system's Jacobian next to the
+// particle itself. Kernels keep it at unit length and add the log of every stretch they remove
+// to logGrowth, so the largest Lyapunov exponent is logGrowth / (time - origin).
+typedef struct TangentStore {
+    real* x;
+    real* y;
+    real* z;
+    double* logGrowth;
+    double* origin; // Store time when the particle's tangent was last reset
+    double time;    // Simulated time integrated so far, advanced by the parallel dispatch
+    int capacity;
+    void* block;
+} TangentStore;
+
+// Per worker running sums, padded so neighbouring workers don't share cache lines
+typedef struct LyapunovShard {
+    _Alignas(64) double exponentSum;
+    double exponentSquares;
+    double exponentMin;
+    double exponentMax;
+    long long particles;
+    double pairLogSum;
+    long long pairs;
+    long long histogram[DIVERGENCE_BINS];
+} LyapunovShard;
+
+typedef struct LyapunovStats {
+    LyapunovShard* shards;
+    int shardCount;
+} LyapunovStats;
+
+// Ensemble summary. Exponents are per unit of simulated time. Pairs are particles 2k and 2k+1
+// (seed them close together to watch them separate) and the histogram bins the log10 of the
+// distance between them.
+typedef struct LyapunovReport {
+    double time;
+    long long particles;
+    double mean;
+    double deviation;
+    double minimum;
+    double maximum;
+    long long pairs;
+    double pairLogMean; // Mean log10 separation, its growth rate is the ensemble exponent / ln 10
+    long long histogram[DIVERGENCE_BINS];
+} LyapunovReport;
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+// -- Tangent store --
+// Returns 1 on success. Every tangent starts reset at time 0.
+int tangentStoreInit(TangentStore* tangent, int capacity);
+void tangentStoreDestroy(TangentStore* tangent);
+// Points [start, end) along a fixed unit vector and restarts their growth at the current time
+void tangentStoreReset(TangentStore* tangent, int start, int end);
+
+// -- Statistics --
+// One shard per pool worker. Returns 1 on success.
+int lyapunovStatsInit(LyapunovStats* stats, int shardCount);
+void lyapunovStatsDestroy(LyapunovStats* stats);
+void lyapunovStatsClear(LyapunovStats* stats);
+// Folds [start, end) into one shard. Called from inside the integration tasks right after a
+// chunk is integrated, while it's still in cache.
+void lyapunovAccumulate(LyapunovShard* shard, const ParticleStore* store, const TangentStore* tangent, int start, int end);
+void lyapunovMerge(const LyapunovStats* stats, double time, LyapunovReport* report);
+// Human readable summary. pairs adds the mean pair separation and an ASCII histogram of it, which
+// only mean anything when particles 2k and 2k + 1 were seeded as pairs.
+void lyapunovPrintReport(const LyapunovReport* report, const char* name, int pairs);
+
+#endif
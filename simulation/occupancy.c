@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "occupancy.h"
+#include "platform.h"
+
+#define OCCUPANCY_MERGE_GRAIN 64 // Bricks per merge task
+
+// ------------------------------------------------------
+// Layout
+// ------------------------------------------------------
+
+static inline int brickOf(const OccupancyGrid* grid, unsigned int x, unsigned int y, unsigned int z) {
+    const unsigned int sides = grid->bricksPerSide;
+    return (int) (((z / OCCUPANCY_BRICK) * sides + y / OCCUPANCY_BRICK) * sides + x / OCCUPANCY_BRICK);
+}
+
+static inline int voxelOf(unsigned int x, unsigned int y, unsigned int z) {
+    return (int) (((z % OCCUPANCY_BRICK) * OCCUPANCY_BRICK + y % OCCUPANCY_BRICK) * OCCUPANCY_BRICK + x % OCCUPANCY_BRICK);
+}
+
+// ------------------------------------------------------
+// Setup
+// ------------------------------------------------------
+
+static void freeBricks(void** bricks, int count) {
+    int b;
+    for (b = 0; b < count; b++) {
+        free(bricks[b]);
+        bricks[b] = NULL;
+    }
+}
+
+int occupancyInit(OccupancyGrid* grid, int shardCount, int size) {
+    memset(grid, 0, sizeof(*grid));
+    grid->bricksPerSide = (size + OCCUPANCY_BRICK - 1) / OCCUPANCY_BRICK;
+    if (grid->bricksPerSide < 1) {
+        return 0;
+    }
+    grid->size = grid->bricksPerSide * OCCUPANCY_BRICK;
+    grid->brickCount = grid->bricksPerSide * grid->bricksPerSide * grid->bricksPerSide;
+    grid->bricks = calloc(grid->brickCount, sizeof(uint64_t*));
+    grid->shards = alignedAlloc(64, shardCount * sizeof(OccupancyShard));
+    if (!grid->bricks || !grid->shards) {
+        occupancyDestroy(grid);
+        return 0;
+    }
+    memset(grid->shards, 0, shardCount * sizeof(OccupancyShard));
+    grid->shardCount = shardCount;
+    int s;
+    for (s = 0; s < shardCount; s++) {
+        if (!(grid->shards[s].bricks = calloc(grid->brickCount, sizeof(uint32_t*)))) {
+            occupancyDestroy(grid);
+            return 0;
+        }
+    }
+    occupancyReset(grid, (Vec3){0, 0, 0}, 1);
+    return 1;
+}
+
+void occupancyDestroy(OccupancyGrid* grid) {
+    int s;
+    for (s = 0; s < grid->shardCount; s++) {
+        if (grid->shards[s].bricks) {
+            freeBricks((void**) grid->shards[s].bricks, grid->brickCount);
+            free(grid->shards[s].bricks);
+        }
+    }
+    if (grid->bricks) {
+        freeBricks((void**) grid->bricks, grid->brickCount);
+        free(grid->bricks);
+    }
+    alignedFree(grid->shards);
+    memset(grid, 0, sizeof(*grid));
+}
+
+void occupancyReset(OccupancyGrid* grid, const Vec3 center, double extent) {
+    int s;
+    // Bricks are dropped rather than zeroed, the new box may not reach the same ones
+    freeBricks((void**) grid->bricks, grid->brickCount);
+    for (s = 0; s < grid->shardCount; s++) {
+        OccupancyShard* shard = &grid->shards[s];
+        freeBricks((void**) shard->bricks, grid->brickCount);
+        shard->samples = shard->outside = shard->lost = 0;
+    }
+    grid->samples = grid->outside = grid->lost = 0;
+    grid->ticks = 0;
+    grid->origin = (Vec3){center.x - extent, center.y - extent, center.z - extent};
+    grid->step = 2 * extent / grid->size;
+}
+
+// ------------------------------------------------------
+// Accumulation
+// ------------------------------------------------------
+
+void occupancyAccumulate(OccupancyGrid* grid, int worker, const ParticleStore* store, int start, int end) {
+    OccupancyShard* shard = &grid->shards[worker];
+    const double inverse = 1 / grid->step, size = grid->size;
+    const double originX = grid->origin.x, originY = grid->origin.y, originZ = grid->origin.z;
+    long long outside = 0, lost = 0;
+    int i;
+    for (i = start; i < end; i++) {
+        double fx = (store->x[i] - originX) * inverse;
+        double fy = (store->y[i] - originY) * inverse;
+        double fz = (store->z[i] - originZ) * inverse;
+        // Written so a NaN lands outside too
+        if (!(fx >= 0 && fx < size && fy >= 0 && fy < size && fz >= 0 && fz < size)) {
+            outside++;
+            continue;
+        }
+        unsigned int x = (unsigned int) fx, y = (unsigned int) fy, z = (unsigned int) fz;
+        int brick = brickOf(grid, x, y, z);
+        uint32_t* counts = shard->bricks[brick];
+        if (!counts && !(counts = shard->bricks[brick] = calloc(OCCUPANCY_BRICK_VOXELS, sizeof(uint32_t)))) {
+            lost++;
+            continue;
+        }
+        counts[voxelOf(x, y, z)]++;
+    }
+    shard->samples += end - start;
+    shard->outside += outside;
+    shard->lost += lost;
+}
+
+static void mergeBricks(void* context, int start, int end, int worker) {
+    OccupancyGrid* grid = context;
+    int b, s, v;
+    (void) worker;
+    for (b = start; b < end; b++) {
+        uint64_t* total = grid->bricks[b];
+        for (s = 0; s < grid->shardCount; s++) {
+            uint32_t* counts = grid->shards[s].bricks[b];
+            if (!counts) {
+                continue;
+            }
+            if (!total && !(total = grid->bricks[b] = calloc(OCCUPANCY_BRICK_VOXELS, sizeof(uint64_t)))) {
+                break; // Left in the shards for the next merge
+            }
+            for (v = 0; v < OCCUPANCY_BRICK_VOXELS; v++) {
+                total[v] += counts[v];
+                counts[v] = 0;
+            }
+        }
+    }
+}
+
+void occupancyMerge(OccupancyGrid* grid, ThreadPool* pool) {
+    // Every task owns its range of bricks across all shards, so nothing is shared
+    threadPoolParallelFor(pool, 0, grid->brickCount, OCCUPANCY_MERGE_GRAIN, mergeBricks, grid);
+    int s;
+    for (s = 0; s < grid->shardCount; s++) {
+        OccupancyShard* shard = &grid->shards[s];
+        grid->samples += shard->samples;
+        grid->outside += shard->outside;
+        grid->lost += shard->lost;
+        shard->samples = shard->outside = shard->lost = 0;
+    }
+    grid->ticks = 0;
+}
+
+void occupancyTick(OccupancyGrid* grid, ThreadPool* pool) {
+    int due = ++grid->ticks >= OCCUPANCY_MERGE_TICKS;
+    int s;
+    // A shard's busiest voxel has at most its sample count, so this keeps every count below 2^32
+    for (s = 0; s < grid->shardCount && !due; s++) {
+        due = grid->shards[s].samples >= OCCUPANCY_SHARD_LIMIT;
+    }
+    if (due) {
+        occupancyMerge(grid, pool);
+    }
+}
+
+// ------------------------------------------------------
+// Reading
+// ------------------------------------------------------
+
+uint64_t occupancyCount(const OccupancyGrid* grid, int x, int y, int z) {
+    if ((unsigned int) x >= (unsigned int) grid->size || (unsigned int) y >= (unsigned int) grid->size || (unsigned int) z >= (unsigned int) grid->size) {
+        return 0;
+    }
+    const uint64_t* counts = grid->bricks[brickOf(grid, x, y, z)];
+    return counts ? counts[voxelOf(x, y, z)] : 0;
+}
+
+void occupancySlice(const OccupancyGrid* grid, int axis, int index, uint64_t* out) {
+    const int size = grid->size;
+    int u, v;
+    for (v = 0; v < size; v++) {
+        for (u = 0; u < size; u++) {
+            int at[3];
+            at[axis] = index;
+            at[axis == 0 ? 1 : 0] = u;
+            at[axis == 2 ? 1 : 2] = v;
+            out[(size_t) v * size + u] = occupancyCount(grid, at[0], at[1], at[2]);
+        }
+    }
+}
+
+void occupancyMarginal(const OccupancyGrid* grid, int axis, uint64_t* out) {
+    const int size = grid->size, sides = grid->bricksPerSide;
+    memset(out, 0, (size_t) size * size * sizeof(uint64_t));
+    int b, v;
+    // Only allocated bricks can add anything
+    for (b = 0; b < grid->brickCount; b++) {
+        const uint64_t* counts = grid->bricks[b];
+        if (!counts) {
+            continue;
+        }
+        const int base[3] = {b % sides * OCCUPANCY_BRICK, b / sides % sides * OCCUPANCY_BRICK, b / sides / sides * OCCUPANCY_BRICK};
+        for (v = 0; v < OCCUPANCY_BRICK_VOXELS; v++) {
+            if (!counts[v]) {
+                continue;
+            }
+            const int at[3] = {
+                base[0] + v % OCCUPANCY_BRICK,
+                base[1] + v / OCCUPANCY_BRICK % OCCUPANCY_BRICK,
+                base[2] + v / OCCUPANCY_BRICK / OCCUPANCY_BRICK,
+            };
+            int u = at[axis == 0 ? 1 : 0], w = at[axis == 2 ? 1 : 2];
+            out[(size_t) w * size + u] += counts[v];
+        }
+    }
+}
+
+int occupancyExportRaw(const OccupancyGrid* grid, const char* path) {
+    const int size = grid->size;
+    float* row = malloc(size * sizeof(float));
+    FILE* file = row ? fopen(path, "wb") : NULL;
+    if (!file) {
+        free(row);
+        return 0;
+    }
+    const double scale = grid->samples > 0 ? 1.0 / grid->samples : 0;
+    int x, y, z, ok = 1;
+    for (z = 0; z < size && ok; z++) {
+        for (y = 0; y < size && ok; y++) {
+            for (x = 0; x < size; x++) {
+                row[x] = (float) (occupancyCount(grid, x, y, z) * scale);
+            }
+            ok = fwrite(row, sizeof(float), size, file) == (size_t) size;
+        }
+    }
+    free(row);
+    return fclose(file) == 0 && ok;
+}
+
+void occupancyPrintReport(const OccupancyGrid* grid, const char* name) {
+    const long long inside = grid->samples - grid->outside - grid->lost;
+    long long occupied = 0;
+    int b, v, bricks = 0, shardBricks = 0;
+    double entropy = 0;
+    for (b = 0; b < grid->brickCount; b++) {
+        int s;
+        for (s = 0; s < grid->shardCount; s++) {
+            shardBricks += grid->shards[s].bricks[b] != NULL;
+        }
+        if (!grid->bricks[b]) {
+            continue;
+        }
+        bricks++;
+        for (v = 0; v < OCCUPANCY_BRICK_VOXELS; v++) {
+            if (grid->bricks[b][v]) {
+                double p = (double) grid->bricks[b][v] / inside;
+                entropy -= p * log2(p);
+                occupied++;
+            }
+        }
+    }
+    double megabytes = (bricks * sizeof(uint64_t) + shardBricks * sizeof(uint32_t)) * OCCUPANCY_BRICK_VOXELS / 1048576.0;
+    printf("occupancy (%s, %d^3 voxels of %.4g): %lld samples, %.3g%% outside the box, %lld voxels occupied in %d of %d bricks (%.1f MB), entropy %.3f bits\n",
+        name, grid->size, grid->step, grid->samples, grid->samples ? 100.0 * grid->outside / grid->samples : 0.0,
+        occupied, bricks, grid->brickCount, megabytes, entropy);
+    if (grid->lost) {
+        printf("  %lld samples lost to failed brick allocations\n", grid->lost);
+    }
+}
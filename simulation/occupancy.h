@@ -0,0 +1,84 @@
+#ifndef LORENZ_OCCUPANCY_H
+#define LORENZ_OCCUPANCY_H
+
+#include <stdint.h>
+
+#include "../engine3d/engine3d.h"
+#include "particles.h"
+#include "threadpool.h"
+
+#define OCCUPANCY_BRICK 8            // Voxels along each side of a brick
+#define OCCUPANCY_BRICK_VOXELS 512   // OCCUPANCY_BRICK cubed
+#define OCCUPANCY_MERGE_TICKS 64     // occupancyTick calls between merges
+#define OCCUPANCY_SHARD_LIMIT 0x80000000LL // Samples a shard may take before it's merged early, so no count can overflow
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+// Per worker counts since the last merge, padded so neighbouring workers don't share cache lines.
+// Bricks are allocated the first time the worker lands in them and kept, zeroed, across merges.
+typedef struct OccupancyShard {
+    _Alignas(64) uint32_t** bricks; // brickCount pointers, NULL where the worker hasn't been
+    long long samples;              // Every sample, inside the box or not
+    long long outside;
+    long long lost;                 // Landed in a brick that couldn't be allocated
+} OccupancyShard;
+
+/*
+Histogram of every position the ensemble has passed through, so the attractor's invariant measure
+builds up over billions of samples in a fixed amount of memory. The box is cut into size^3 voxels
+stored as 8x8x8 bricks, and only bricks the attractor reaches are ever allocated, which is a small
+fraction of the box for every system here. Integration workers count into their own shard without
+atomics, and the shards are folded into the 64 bit totals every OCCUPANCY_MERGE_TICKS ticks.
+Everything that reads counts sees the totals as of the last merge.
+*/
+typedef struct OccupancyGrid {
+    int size;          // Voxels along each side, a multiple of OCCUPANCY_BRICK
+    int bricksPerSide;
+    int brickCount;
+    Vec3 origin;       // Corner of voxel (0, 0, 0)
+    double step;       // Voxel side
+    uint64_t** bricks; // Merged counts, NULL bricks are empty
+    long long samples;
+    long long outside;
+    long long lost;
+
+    OccupancyShard* shards;
+    int shardCount;
+    int ticks;         // occupancyTick calls since the last merge
+} OccupancyGrid;
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+// One shard per pool worker, size is rounded up to a whole number of bricks. Returns 1 on success.
+int occupancyInit(OccupancyGrid* grid, int shardCount, int size);
+void occupancyDestroy(OccupancyGrid* grid);
+// Empties the grid and fits it to the box center +- extent
+void occupancyReset(OccupancyGrid* grid, const Vec3 center, double extent);
+
+// Counts the positions of [start, end) into worker's shard. Called from inside the integration
+// tasks right after a chunk is integrated, while it's still in cache.
+void occupancyAccumulate(OccupancyGrid* grid, int worker, const ParticleStore* store, int start, int end);
+// Call once after every parallel pass that accumulated. Merges every OCCUPANCY_MERGE_TICKS calls,
+// or sooner once a shard nears OCCUPANCY_SHARD_LIMIT, so a pass may add at most that many samples.
+void occupancyTick(OccupancyGrid* grid, ThreadPool* pool);
+// Folds every shard into the totals now
+void occupancyMerge(OccupancyGrid* grid, ThreadPool* pool);
+
+// -- Reading the totals --
+uint64_t occupancyCount(const OccupancyGrid* grid, int x, int y, int z);
+// The plane at index along axis (0 x, 1 y, 2 z) as size * size counts. The other two axes keep
+// their x y z order, the first one varying fastest.
+void occupancySlice(const OccupancyGrid* grid, int axis, int index, uint64_t* out);
+// Same layout as occupancySlice, summed along axis instead of cut
+void occupancyMarginal(const OccupancyGrid* grid, int axis, uint64_t* out);
+// Writes size^3 float32 probabilities (count over every sample), x fastest then y then z, with no
+// header. Returns 1 on success.
+int occupancyExportRaw(const OccupancyGrid* grid, const char* path);
+// Sample count, occupied voxels, memory and the Shannon entropy of the voxel distribution
+void occupancyPrintReport(const OccupancyGrid* grid, const char* name);
+
+#endif
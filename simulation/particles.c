@@ -0,0 +1,61 @@
+#include <string.h>
+
+#include "particles.h"
+#include "platform.h"
+#include "simd.h"
+
+#define PARTICLE_ARRAYS 6
+
+static int paddedCapacity(int capacity) {
+    return ((capacity + LANE_WIDTH - 1) / LANE_WIDTH) * LANE_WIDTH;
+}
+
+static size_t arrayStride(int capacity) {
+    // Round up so every array holds whole vectors and starts on a cache line
+    size_t bytes = paddedCapacity(capacity) * sizeof(real);
+    return ((bytes + LANE_ALIGNMENT - 1) / LANE_ALIGNMENT) * LANE_ALIGNMENT;
+}
+
+size_t particleStoreBytes(int capacity) {
+    return arrayStride(capacity) * PARTICLE_ARRAYS;
+}
+
+void particleStoreView(ParticleStore* store, void* memory, int capacity) {
+    size_t realsPerArray = arrayStride(capacity) / sizeof(real);
+    real* base = memory;
+    store->x  = base;
+    store->y  = base + realsPerArray;
+    store->z  = base + realsPerArray * 2;
+    store->vx = base + realsPerArray * 3;
+    store->vy = base + realsPerArray * 4;
+    store->vz = base + realsPerArray * 5;
+    store->capacity = paddedCapacity(capacity);
+    store->block = NULL;
+}
+
+int particleStoreInit(ParticleStore* store, int capacity) {
+    size_t bytes = particleStoreBytes(capacity);
+    void* block = alignedAlloc(LANE_ALIGNMENT, bytes);
+    if (!block) {
+        return 0;
+    }
+    memset(block, 0, bytes);
+
+    particleStoreView(store, block, capacity);
+    store->block = block;
+    return 1;
+}
+
+void particleStoreDestroy(ParticleStore* store) {
+    alignedFree(store->block);
+    memset(store, 0, sizeof(*store));
+}
+
+void particleStoreSet(ParticleStore* store, int i, const Vec3 point) {
+    store->x[i] = point.x;
+    store->y[i] = point.y;
+    store->z[i] = point.z;
+    store->vx[i] = 0;
+    store->vy[i] = 0;
+    store->vz[i] = 0;
+}
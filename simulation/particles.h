@@ -0,0 +1,47 @@
+#ifndef LORENZ_PARTICLES_H
+#define LORENZ_PARTICLES_H
+
+#include <stddef.h>
+
+#include "../engine3d/engine3d.h"
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+// Structure-of-arrays particle storage. Every array is LANE_ALIGNMENT aligned and
+// padded to a multiple of LANE_WIDTH so the batched kernels can use full vectors.
+typedef struct ParticleStore {
+    real* x;
+    real* y;
+    real* z;
+    real* vx; // Displacement over the last integration call, used for velocity rendering
+    real* vy;
+    real* vz;
+    int capacity;
+    void* block; // Single allocation backing every array above, NULL for views
+} ParticleStore;
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+// Returns 1 on success, 0 if the allocation failed
+int particleStoreInit(ParticleStore* store, int capacity);
+void particleStoreDestroy(ParticleStore* store);
+
+// Size of the single block backing a store of this capacity, arrays included
+size_t particleStoreBytes(int capacity);
+// Lays a store out over memory it doesn't own (a mapped checkpoint, say). The memory must be
+// LANE_ALIGNMENT aligned and particleStoreBytes(capacity) long. Views are never destroyed.
+void particleStoreView(ParticleStore* store, void* memory, int capacity);
+
+static inline Vec3 particleStoreGet(const ParticleStore* store, int i) {
+    return (Vec3){store->x[i], store->y[i], store->z[i]};
+}
+static inline Vec3 particleStoreGetVelocity(const ParticleStore* store, int i) {
+    return (Vec3){store->vx[i], store->vy[i], store->vz[i]};
+}
+void particleStoreSet(ParticleStore* store, int i, const Vec3 point);
+
+#endif
@@ -0,0 +1,208 @@
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <stdio.h>
+#else
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "platform.h"
+
+void* alignedAlloc(size_t alignment, size_t size) {
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, alignment, size)) {
+        return NULL;
+    }
+    return ptr;
+#endif
+}
+
+void alignedFree(void* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+void* platformAllocLarge(size_t size, int hugePages) {
+#ifdef _WIN32
+    if (hugePages) {
+        // Needs SeLockMemoryPrivilege, which most accounts don't have
+        SIZE_T large = GetLargePageMinimum();
+        if (large) {
+            SIZE_T rounded = (size + large - 1) / large * large;
+            void* ptr = VirtualAlloc(NULL, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (ptr) {
+                return ptr;
+            }
+        }
+    }
+    return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    void* ptr;
+#ifdef MAP_HUGETLB
+    // Explicit huge pages only exist if the administrator reserved some
+    if (hugePages) {
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            return ptr;
+        }
+    }
+#endif
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    // Otherwise transparent huge pages, if the kernel has them enabled
+    if (hugePages) {
+        madvise(ptr, size, MADV_HUGEPAGE);
+    }
+#endif
+    return ptr;
+#endif
+}
+
+void platformFreeLarge(void* ptr, size_t size) {
+    if (!ptr) {
+        return;
+    }
+#ifdef _WIN32
+    (void) size;
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+    munmap(ptr, size);
+#endif
+}
+
+int platformCpuCount() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int count = (int) info.dwNumberOfProcessors;
+#else
+    int count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return count > 0 ? count : 1;
+}
+
+void* platformMapFile(const char* path, size_t* size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+    LARGE_INTEGER length;
+    if (!GetFileSizeEx(file, &length) || length.QuadPart == 0) {
+        CloseHandle(file);
+        return NULL;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) {
+        return NULL;
+    }
+    // The view keeps the mapping alive after its handle is closed
+    void* data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!data) {
+        return NULL;
+    }
+    *size = (size_t) length.QuadPart;
+    return data;
+#else
+    int file = open(path, O_RDONLY);
+    if (file < 0) {
+        return NULL;
+    }
+    struct stat info;
+    if (fstat(file, &info) || info.st_size == 0) {
+        close(file);
+        return NULL;
+    }
+    void* data = mmap(NULL, (size_t) info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    *size = (size_t) info.st_size;
+    return data;
+#endif
+}
+
+void platformUnmapFile(void* data, size_t size) {
+#ifdef _WIN32
+    (void) size;
+    UnmapViewOfFile(data);
+#else
+    munmap(data, size);
+#endif
+}
+
+int platformReplaceFile(const char* from, const char* to) {
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+FILE* platformTakeStdout() {
+    fflush(stdout);
+#ifdef _WIN32
+    int output = _dup(_fileno(stdout));
+    if (output < 0) {
+        return NULL;
+    }
+    _setmode(output, _O_BINARY);
+    _dup2(_fileno(stderr), _fileno(stdout));
+    return _fdopen(output, "wb");
+#else
+    int output = dup(STDOUT_FILENO);
+    if (output < 0) {
+        return NULL;
+    }
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    return fdopen(output, "wb");
+#endif
+}
+
+double platformTime() {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double) counter.QuadPart / (double) frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+#endif
+}
+
+void platformSleep(double seconds) {
+    if (seconds <= 0) {
+        return;
+    }
+#ifdef _WIN32
+    Sleep((DWORD) (seconds * 1000.0));
+#else
+    struct timespec duration;
+    duration.tv_sec = (time_t) seconds;
+    duration.tv_nsec = (long) ((seconds - (double) duration.tv_sec) * 1e9);
+    nanosleep(&duration, NULL);
+#endif
+}
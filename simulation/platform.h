@@ -0,0 +1,38 @@
+#ifndef LORENZ_PLATFORM_H
+#define LORENZ_PLATFORM_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+// -- Memory --
+// Alignment must be a power of two. Memory from alignedAlloc must be freed with alignedFree
+void* alignedAlloc(size_t alignment, size_t size);
+void alignedFree(void* ptr);
+// Page aligned, zeroed memory straight from the OS, for big long lived arenas. With hugePages it
+// asks for large pages and quietly falls back to normal ones. Free with platformFreeLarge.
+void* platformAllocLarge(size_t size, int hugePages);
+void platformFreeLarge(void* ptr, size_t size);
+
+// -- System --
+int platformCpuCount(); // Logical processors available to the process, at least 1
+
+// -- Files --
+// Maps a whole file copy-on-write: the pages load lazily and writes stay private to the process.
+// Returns NULL on failure, otherwise size receives the file length.
+void* platformMapFile(const char* path, size_t* size);
+void platformUnmapFile(void* data, size_t size);
+// Renames from over to, replacing to if it exists. Returns 1 on success.
+int platformReplaceFile(const char* from, const char* to);
+// A binary stream on the process's original stdout, which is then pointed at stderr so anything
+// printed afterwards stays out of piped output. Returns NULL on failure.
+FILE* platformTakeStdout();
+
+// -- Time --
+double platformTime(); // Monotonic seconds from an arbitrary origin
+void platformSleep(double seconds);
+
+#endif
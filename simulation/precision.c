@@ -0,0 +1,54 @@
+#include <math.h>
+
+#include "precision.h"
+
+void precisionProbeSync(PrecisionProbe* probe, const ParticleStore* store, int pointCount) {
+    int count = pointCount < PRECISION_SAMPLES ? pointCount : PRECISION_SAMPLES;
+    int i;
+    for (i = 0; i < count; i++) {
+        int index = (int) ((long long) i * pointCount / count);
+        probe->index[i] = index;
+        probe->x[i] = store->x[index];
+        probe->y[i] = store->y[index];
+        probe->z[i] = store->z[index];
+    }
+    probe->count = count;
+    probe->age = 0;
+}
+
+int precisionProbeTick(PrecisionProbe* probe, const Attractor* attractor, const ParticleStore* store, int pointCount,
+    const AttractorParams* params, double delta, int steps) {
+    if (probe->count == 0) {
+        precisionProbeSync(probe, store, pointCount);
+        return 0;
+    }
+
+    attractor->rk4Reference(probe->x, probe->y, probe->z, probe->count, params, delta, steps);
+    probe->age++;
+
+    double largest = 0, sum = 0;
+    int i;
+    for (i = 0; i < probe->count; i++) {
+        int index = probe->index[i];
+        double dx = store->x[index] - probe->x[i];
+        double dy = store->y[index] - probe->y[i];
+        double dz = store->z[index] - probe->z[i];
+        double distance = sqrt(dx * dx + dy * dy + dz * dz);
+        largest = fmax(largest, distance);
+        sum += distance;
+    }
+
+    if (probe->age == 1) {
+        probe->report.tickError = largest;
+    }
+    if (probe->age < PRECISION_WINDOW) {
+        return 0;
+    }
+
+    probe->report.windowError = largest;
+    probe->report.windowMean = sum / probe->count;
+    probe->report.viewError = largest * attractor->scale;
+    probe->report.samples = probe->count;
+    precisionProbeSync(probe, store, pointCount);
+    return 1;
+}
@@ -0,0 +1,46 @@
+#ifndef LORENZ_PRECISION_H
+#define LORENZ_PRECISION_H
+
+#include "particles.h"
+#include "attractors.h"
+
+#define PRECISION_SAMPLES 256 // Particles shadowed in double precision
+#define PRECISION_WINDOW 60   // Ticks between resynchronizing the shadow copies
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+// Distances between the stored (possibly float) particles and double precision shadows that
+// started from the same state. Chaos amplifies any difference, so the window error says how
+// long float output stays trustworthy rather than how wrong a single step is.
+typedef struct PrecisionReport {
+    double tickError;   // Largest error after one tick
+    double windowError; // Largest error after PRECISION_WINDOW ticks
+    double windowMean;  // Mean error after PRECISION_WINDOW ticks
+    double viewError;   // windowError times the attractor's view scale
+    int samples;
+} PrecisionReport;
+
+typedef struct PrecisionProbe {
+    double x[PRECISION_SAMPLES];
+    double y[PRECISION_SAMPLES];
+    double z[PRECISION_SAMPLES];
+    int index[PRECISION_SAMPLES];
+    int count; // 0 until synced
+    int age;   // Ticks since the last sync
+    PrecisionReport report;
+} PrecisionProbe;
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+// Copies evenly spaced particles out of the store as the new double precision baseline
+void precisionProbeSync(PrecisionProbe* probe, const ParticleStore* store, int pointCount);
+// Advances the shadows with the same RK4 step the store just took and compares. Returns 1 when
+// a window finished and probe->report was updated (the probe resyncs itself afterwards).
+int precisionProbeTick(PrecisionProbe* probe, const Attractor* attractor, const ParticleStore* store, int pointCount,
+    const AttractorParams* params, double delta, int steps);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef LORENZ_RANDOM_H
+#define LORENZ_RANDOM_H
+
+#include <stdint.h>
+
+/*
+Philox4x32-10 counter-based generator (Salmon et al., "Parallel random numbers: as easy as
+1, 2, 3"). There is no state to carry around: the same key and counter always give the same
+four words, so any thread can produce the numbers for any particle index directly and the
+result doesn't depend on how the work was split or on the platform's rand().
+*/
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+typedef struct PhiloxCounter {
+    uint32_t v[4];
+} PhiloxCounter;
+
+typedef struct PhiloxKey {
+    uint32_t v[2];
+} PhiloxKey;
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+static inline PhiloxCounter philox4x32(PhiloxCounter counter, PhiloxKey key) {
+    int round;
+    for (round = 0; round < 10; round++) {
+        uint64_t product0 = (uint64_t) 0xD2511F53u * counter.v[0];
+        uint64_t product1 = (uint64_t) 0xCD9E8D57u * counter.v[2];
+        PhiloxCounter next = {{
+            (uint32_t) (product1 >> 32) ^ counter.v[1] ^ key.v[0],
+            (uint32_t) product1,
+            (uint32_t) (product0 >> 32) ^ counter.v[3] ^ key.v[1],
+            (uint32_t) product0,
+        }};
+        counter = next;
+        key.v[0] += 0x9E3779B9u;
+        key.v[1] += 0xBB67AE85u;
+    }
+    return counter;
+}
+
+// Uniform double in [0, 1) from two words, using all 53 bits of the mantissa
+static inline double philoxUniform(uint32_t high, uint32_t low) {
+    return ((uint64_t) (high >> 5) * 67108864 + (low >> 6)) * (1.0 / 9007199254740992.0);
+}
+
+#endif
@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "recorder.h"
+#include "platform.h"
+
+#define RECORDER_POLL 0.001 // Seconds the writer sleeps when the queue is empty
+#define RECORDER_MAX_FRAMES 4096
+
+typedef struct RecorderSlot {
+    Vec3* frames;
+    unsigned long long firstTick;
+    int frameCount;
+    int particleCount;
+    int system;
+} RecorderSlot;
+
+struct Recorder {
+    RecorderSettings settings;
+    int framesPerChunk;
+
+    // Single producer single consumer ring. The producer fills slots[tail] in place and
+    // publishes it by advancing tail, the writer hands it back by advancing head.
+    RecorderSlot slots[RECORDER_QUEUE_CHUNKS];
+    _Atomic unsigned int head;
+    _Atomic unsigned int tail;
+    _Atomic int running;
+    _Atomic int failed;
+    pthread_t thread;
+
+    // Producer owned
+    int filling; // slots[tail] holds frames that aren't published yet
+    unsigned long long appended;
+    unsigned long long dropped;
+
+    // Writer owned
+    FILE* file;
+    uint64_t position;
+    unsigned char* encoded;
+    unsigned char* scratch;
+    TrajectoryIndexEntry* index;
+    size_t indexCount;
+    size_t indexCapacity;
+};
+
+// ------------------------------------------------------
+// Writer
+// ------------------------------------------------------
+
+static int writeBytes(Recorder* recorder, const void* data, size_t size) {
+    if (size && fwrite(data, 1, size, recorder->file) != size) {
+        return 0;
+    }
+    recorder->position += size;
+    return 1;
+}
+
+static int padFile(Recorder* recorder) {
+    static const char zeros[TRAJECTORY_ALIGNMENT];
+    size_t extra = (size_t) (recorder->position % TRAJECTORY_ALIGNMENT);
+    return !extra || writeBytes(recorder, zeros, TRAJECTORY_ALIGNMENT - extra);
+}
+
+static int writeChunk(Recorder* recorder, const RecorderSlot* slot) {
+    size_t raw = trajectoryRawBytes(slot->frameCount, slot->particleCount);
+    const void* payload = slot->frames;
+    TrajectoryChunk chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    memcpy(chunk.magic, trajectoryChunkMagic, sizeof(chunk.magic));
+    chunk.codec = TRAJECTORY_RAW;
+    chunk.firstTick = slot->firstTick;
+    chunk.frameCount = slot->frameCount;
+    chunk.particleCount = slot->particleCount;
+    chunk.system = slot->system;
+    chunk.storedBytes = raw;
+
+    if (recorder->settings.codec == TRAJECTORY_XOR_RLE) {
+        size_t size = trajectoryEncode(slot->frames, slot->frameCount, slot->particleCount, recorder->encoded, recorder->scratch);
+        // Incompressible chunks stay raw so replay can use them in place
+        if (size < raw) {
+            chunk.codec = TRAJECTORY_XOR_RLE;
+            chunk.storedBytes = size;
+            payload = recorder->encoded;
+        }
+    }
+
+    if (recorder->indexCount == recorder->indexCapacity) {
+        size_t capacity = recorder->indexCapacity ? recorder->indexCapacity * 2 : 256;
+        TrajectoryIndexEntry* grown = realloc(recorder->index, capacity * sizeof(TrajectoryIndexEntry));
+        if (!grown) {
+            return 0;
+        }
+        recorder->index = grown;
+        recorder->indexCapacity = capacity;
+    }
+    recorder->index[recorder->indexCount++] = (TrajectoryIndexEntry){
+        recorder->position, chunk.firstTick, chunk.frameCount, chunk.particleCount,
+    };
+
+    return writeBytes(recorder, &chunk, sizeof(chunk)) &&
+        writeBytes(recorder, payload, (size_t) chunk.storedBytes) &&
+        padFile(recorder);
+}
+
+static void* writerMain(void* data) {
+    Recorder* recorder = data;
+    for (;;) {
+        unsigned int head = atomic_load_explicit(&recorder->head, memory_order_relaxed);
+        unsigned int tail = atomic_load_explicit(&recorder->tail, memory_order_acquire);
+        if (head == tail) {
+            // Only stop once everything published before running was cleared has been written
+            if (!atomic_load(&recorder->running) && head == atomic_load(&recorder->tail)) {
+                break;
+            }
+            platformSleep(RECORDER_POLL);
+            continue;
+        }
+        const RecorderSlot* slot = &recorder->slots[head & (RECORDER_QUEUE_CHUNKS - 1)];
+        if (!atomic_load_explicit(&recorder->failed, memory_order_relaxed) && !writeChunk(recorder, slot)) {
+            atomic_store(&recorder->failed, 1);
+        }
+        atomic_store_explicit(&recorder->head, head + 1, memory_order_release);
+    }
+    return NULL;
+}
+
+// ------------------------------------------------------
+// Producer
+// ------------------------------------------------------
+
+static void publishSlot(Recorder* recorder) {
+    unsigned int tail = atomic_load_explicit(&recorder->tail, memory_order_relaxed);
+    atomic_store_explicit(&recorder->tail, tail + 1, memory_order_release);
+    recorder->filling = 0;
+}
+
+// Claims slots[tail] for a new chunk, returns NULL if every slot is waiting for the writer
+static RecorderSlot* claimSlot(Recorder* recorder) {
+    for (;;) {
+        unsigned int tail = atomic_load_explicit(&recorder->tail, memory_order_relaxed);
+        unsigned int head = atomic_load_explicit(&recorder->head, memory_order_acquire);
+        if (tail - head < RECORDER_QUEUE_CHUNKS) {
+            recorder->filling = 1;
+            return &recorder->slots[tail & (RECORDER_QUEUE_CHUNKS - 1)];
+        }
+        if (!recorder->settings.blocking) {
+            return NULL;
+        }
+        platformSleep(RECORDER_POLL);
+    }
+}
+
+int recorderAppend(Recorder* recorder, unsigned long long tick, const ParticleStore* store, int count, int system) {
+    if (count > recorder->settings.capacity) {
+        count = recorder->settings.capacity;
+    }
+    recorder->appended++;
+
+    unsigned int tail = atomic_load_explicit(&recorder->tail, memory_order_relaxed);
+    RecorderSlot* slot = &recorder->slots[tail & (RECORDER_QUEUE_CHUNKS - 1)];
+    if (recorder->filling && (slot->particleCount != count || slot->system != system ||
+        slot->firstTick + slot->frameCount != tick)) {
+        publishSlot(recorder);
+    }
+    if (!recorder->filling) {
+        slot = claimSlot(recorder);
+        if (!slot) {
+            recorder->dropped++;
+            return 0;
+        }
+        slot->firstTick = tick;
+        slot->frameCount = 0;
+        slot->particleCount = count;
+        slot->system = system;
+    }
+
+    Vec3* frame = slot->frames + (size_t) slot->frameCount * count;
+    int i;
+    for (i = 0; i < count; i++) {
+        frame[i] = particleStoreGet(store, i);
+    }
+    if (++slot->frameCount == recorder->framesPerChunk) {
+        publishSlot(recorder);
+    }
+    return 1;
+}
+
+// ------------------------------------------------------
+// Setup
+// ------------------------------------------------------
+
+static void recorderFree(Recorder* recorder) {
+    int i;
+    for (i = 0; i < RECORDER_QUEUE_CHUNKS; i++) {
+        alignedFree(recorder->slots[i].frames);
+    }
+    free(recorder->encoded);
+    free(recorder->scratch);
+    free(recorder->index);
+    free(recorder);
+}
+
+Recorder* recorderCreate(const RecorderSettings* settings) {
+    if (settings->capacity <= 0) {
+        return NULL;
+    }
+    Recorder* recorder = calloc(1, sizeof(Recorder));
+    if (!recorder) {
+        return NULL;
+    }
+    recorder->settings = *settings;
+    recorder->settings.path = NULL; // Not needed after opening, and the caller may free it
+
+    size_t frameBytes = trajectoryRawBytes(1, settings->capacity);
+    recorder->framesPerChunk = RECORDER_CHUNK_BYTES / frameBytes;
+    if (recorder->framesPerChunk < 1) {
+        recorder->framesPerChunk = 1;
+    } else if (recorder->framesPerChunk > RECORDER_MAX_FRAMES) {
+        recorder->framesPerChunk = RECORDER_MAX_FRAMES;
+    }
+    size_t chunkBytes = frameBytes * recorder->framesPerChunk;
+
+    int i, ok = 1;
+    for (i = 0; i < RECORDER_QUEUE_CHUNKS && ok; i++) {
+        ok = (recorder->slots[i].frames = alignedAlloc(TRAJECTORY_ALIGNMENT, chunkBytes)) != NULL;
+    }
+    if (ok && settings->codec == TRAJECTORY_XOR_RLE) {
+        ok = (recorder->encoded = malloc(trajectoryEncodedBound(recorder->framesPerChunk, settings->capacity))) &&
+            (recorder->scratch = malloc(chunkBytes));
+    }
+    if (!ok || !(recorder->file = fopen(settings->path, "wb"))) {
+        recorderFree(recorder);
+        return NULL;
+    }
+
+    TrajectoryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, trajectoryMagic, sizeof(header.magic));
+    header.version = TRAJECTORY_VERSION;
+    header.realSize = sizeof(real);
+    header.system = settings->system;
+    header.capacity = settings->capacity;
+    header.params = settings->params;
+    header.tickPeriod = settings->tickPeriod;
+    header.codec = settings->codec;
+    if (!writeBytes(recorder, &header, sizeof(header)) || !padFile(recorder)) {
+        fclose(recorder->file);
+        recorderFree(recorder);
+        return NULL;
+    }
+
+    atomic_init(&recorder->head, 0);
+    atomic_init(&recorder->tail, 0);
+    atomic_init(&recorder->failed, 0);
+    atomic_init(&recorder->running, 1);
+    if (pthread_create(&recorder->thread, NULL, writerMain, recorder)) {
+        fclose(recorder->file);
+        recorderFree(recorder);
+        return NULL;
+    }
+    return recorder;
+}
+
+int recorderClose(Recorder* recorder) {
+    if (!recorder) {
+        return 1;
+    }
+    if (recorder->filling) {
+        publishSlot(recorder);
+    }
+    atomic_store(&recorder->running, 0);
+    pthread_join(recorder->thread, NULL);
+
+    int ok = !atomic_load(&recorder->failed);
+    uint64_t indexOffset = recorder->position;
+    TrajectoryFooter footer = {indexOffset, recorder->indexCount, {0}};
+    memcpy(footer.magic, trajectoryFooterMagic, sizeof(footer.magic));
+    ok = ok && writeBytes(recorder, recorder->index, recorder->indexCount * sizeof(TrajectoryIndexEntry));
+    ok = ok && writeBytes(recorder, &footer, sizeof(footer));
+    ok = (fclose(recorder->file) == 0) && ok;
+
+    printf("Recorded %llu frames in %zu chunks, %.1f MB", recorder->appended - recorder->dropped,
+        recorder->indexCount, recorder->position / (1024.0 * 1024.0));
+    if (recorder->dropped) {
+        printf(", dropped %llu frames the writer couldn't keep up with", recorder->dropped);
+    }
+    printf(ok ? "\n" : ", the file is incomplete\n");
+
+    recorderFree(recorder);
+    return ok;
+}
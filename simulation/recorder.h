@@ -0,0 +1,45 @@
+#ifndef LORENZ_RECORDER_H
+#define LORENZ_RECORDER_H
+
+#include "trajectory.h"
+#include "particles.h"
+
+#define RECORDER_QUEUE_CHUNKS 4        // Chunks that can wait for the writer, a power of two
+#define RECORDER_CHUNK_BYTES (4 << 20) // Raw size a chunk aims for, at least one frame
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+typedef struct RecorderSettings {
+    const char* path;
+    int capacity;          // Most particles a frame will ever hold
+    int system;
+    AttractorParams params;
+    double tickPeriod;
+    TrajectoryCodec codec;
+    // Wait for the writer instead of dropping frames when the queue is full. Only for callers
+    // that would rather stall than lose data, the live simulation never sets it.
+    int blocking;
+} RecorderSettings;
+
+// Streams frames to a trajectory file (see trajectory.h). One thread appends, a writer thread
+// of its own encodes and writes, and the two only meet in a bounded lock-free chunk queue.
+typedef struct Recorder Recorder;
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+// Creates the file and starts the writer. Returns NULL on failure.
+Recorder* recorderCreate(const RecorderSettings* settings);
+// Flushes the last chunk, writes the index and prints a summary. Returns 1 if every chunk
+// that was queued reached the file.
+int recorderClose(Recorder* recorder);
+
+// Appends the first count particles as the frame for tick. Frames that aren't one tick after
+// the last, or that change the system or count, start a new chunk. Never blocks unless the
+// recorder is blocking, returns 0 if the frame was dropped because the queue was full.
+int recorderAppend(Recorder* recorder, unsigned long long tick, const ParticleStore* store, int count, int system);
+
+#endif
@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+#include "platform.h"
+
+typedef struct ReplayCacheSlot {
+    Vec3* frames;
+    size_t chunk;            // Index of the decoded chunk, chunkCount when empty
+    unsigned long long used; // Replay clock at the last hit, the smallest is evicted
+} ReplayCacheSlot;
+
+struct Replay {
+    char* mapping;
+    size_t size;
+    const TrajectoryHeader* header;
+
+    // Chunk index, straight from the footer or rebuilt into ownedIndex
+    const TrajectoryIndexEntry* index;
+    TrajectoryIndexEntry* ownedIndex;
+    size_t chunkCount;
+    unsigned long long firstTick;
+    unsigned long long lastTick; // Inclusive
+
+    // Time index: buckets[b] is the first chunk that ends after firstTick + b * bucketTicks.
+    // Buckets are as long as the shortest chunk, so at most one chunk ends inside any bucket and
+    // a lookup never walks more than two entries. Only recordings with long gaps get wider buckets.
+    unsigned long long bucketTicks;
+    size_t* buckets;
+    size_t bucketCount;
+
+    // Decoded compressed chunks
+    ReplayCacheSlot* cache;
+    int cacheSlots;
+    unsigned char* scratch;
+    unsigned long long clock;
+};
+
+// ------------------------------------------------------
+// Index
+// ------------------------------------------------------
+
+static uint64_t alignOffset(uint64_t offset) {
+    return (offset + TRAJECTORY_ALIGNMENT - 1) / TRAJECTORY_ALIGNMENT * TRAJECTORY_ALIGNMENT;
+}
+
+// Checks the chunk at offset and returns its header, or NULL if it's damaged or runs past the end
+static const TrajectoryChunk* chunkAt(const Replay* replay, uint64_t offset) {
+    if (offset % TRAJECTORY_ALIGNMENT || offset > replay->size || replay->size - offset < sizeof(TrajectoryChunk)) {
+        return NULL;
+    }
+    const TrajectoryChunk* chunk = (const TrajectoryChunk*) (replay->mapping + offset);
+    uint64_t available = replay->size - offset - sizeof(TrajectoryChunk);
+    if (memcmp(chunk->magic, trajectoryChunkMagic, sizeof(chunk->magic)) || chunk->storedBytes > available ||
+        !chunk->frameCount || !chunk->particleCount || (int) chunk->particleCount > replay->header->capacity ||
+        chunk->system < 0 || chunk->system >= ATTRACTOR_COUNT) {
+        return NULL;
+    }
+    if (chunk->codec == TRAJECTORY_RAW) {
+        return chunk->storedBytes == trajectoryRawBytes(chunk->frameCount, chunk->particleCount) ? chunk : NULL;
+    }
+    return chunk->codec == TRAJECTORY_XOR_RLE ? chunk : NULL;
+}
+
+// Uses the footer's index if it's intact
+static int readIndex(Replay* replay) {
+    if (replay->size < sizeof(TrajectoryHeader) + sizeof(TrajectoryFooter)) {
+        return 0;
+    }
+    const TrajectoryFooter* footer = (const TrajectoryFooter*) (replay->mapping + replay->size - sizeof(TrajectoryFooter));
+    uint64_t indexBytes = footer->chunkCount * sizeof(TrajectoryIndexEntry);
+    if (memcmp(footer->magic, trajectoryFooterMagic, sizeof(footer->magic)) ||
+        footer->chunkCount > replay->size / sizeof(TrajectoryIndexEntry) ||
+        footer->indexOffset + indexBytes + sizeof(TrajectoryFooter) != replay->size) {
+        return 0;
+    }
+    const TrajectoryIndexEntry* index = (const TrajectoryIndexEntry*) (replay->mapping + footer->indexOffset);
+    size_t c;
+    for (c = 0; c < footer->chunkCount; c++) {
+        const TrajectoryChunk* chunk = chunkAt(replay, index[c].offset);
+        if (!chunk || chunk->firstTick != index[c].firstTick || chunk->frameCount != index[c].frameCount ||
+            chunk->particleCount != index[c].particleCount) {
+            return 0;
+        }
+    }
+    replay->index = index;
+    replay->chunkCount = footer->chunkCount;
+    return 1;
+}
+
+// Walks the chunk headers of a recording that was never closed, stopping at the first bad one
+static int rebuildIndex(Replay* replay) {
+    uint64_t offset = alignOffset(sizeof(TrajectoryHeader));
+    size_t capacity = 0;
+    const TrajectoryChunk* chunk;
+    while ((chunk = chunkAt(replay, offset))) {
+        if (replay->chunkCount == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            TrajectoryIndexEntry* grown = realloc(replay->ownedIndex, capacity * sizeof(TrajectoryIndexEntry));
+            if (!grown) {
+                return 0;
+            }
+            replay->ownedIndex = grown;
+        }
+        replay->ownedIndex[replay->chunkCount++] = (TrajectoryIndexEntry){
+            offset, chunk->firstTick, chunk->frameCount, chunk->particleCount,
+        };
+        offset = alignOffset(offset + sizeof(TrajectoryChunk) + chunk->storedBytes);
+    }
+    replay->index = replay->ownedIndex;
+    return 1;
+}
+
+static int buildTimeIndex(Replay* replay) {
+    const TrajectoryIndexEntry* index = replay->index;
+    unsigned long long shortest = index[0].frameCount;
+    size_t c;
+    for (c = 1; c < replay->chunkCount; c++) {
+        if (index[c].firstTick < index[c - 1].firstTick + index[c - 1].frameCount) {
+            return 0; // Ticks must only move forward
+        }
+        if (index[c].frameCount < shortest) {
+            shortest = index[c].frameCount;
+        }
+    }
+    replay->firstTick = index[0].firstTick;
+    replay->lastTick = index[replay->chunkCount - 1].firstTick + index[replay->chunkCount - 1].frameCount - 1;
+
+    // Long gaps between chunks would make the table mostly empty, widen the buckets instead
+    unsigned long long span = replay->lastTick - replay->firstTick + 1;
+    unsigned long long widest = span / (2 * replay->chunkCount) + 1;
+    replay->bucketTicks = shortest > widest ? shortest : widest;
+    replay->bucketCount = (size_t) ((span + replay->bucketTicks - 1) / replay->bucketTicks);
+    replay->buckets = malloc(replay->bucketCount * sizeof(size_t));
+    if (!replay->buckets) {
+        return 0;
+    }
+    size_t b;
+    c = 0;
+    for (b = 0; b < replay->bucketCount; b++) {
+        unsigned long long start = replay->firstTick + b * replay->bucketTicks;
+        while (index[c].firstTick + index[c].frameCount <= start) {
+            c++;
+        }
+        replay->buckets[b] = c;
+    }
+    return 1;
+}
+
+// Enough decoded chunks to hold recentFrames consecutive frames at once
+static int createCache(Replay* replay, int recentFrames) {
+    size_t largest = 0, compressed = 0, c;
+    unsigned long long shortest = ~0ULL;
+    for (c = 0; c < replay->chunkCount; c++) {
+        const TrajectoryChunk* chunk = (const TrajectoryChunk*) (replay->mapping + replay->index[c].offset);
+        size_t raw = trajectoryRawBytes(chunk->frameCount, chunk->particleCount);
+        if (chunk->codec == TRAJECTORY_XOR_RLE) {
+            compressed++;
+            largest = raw > largest ? raw : largest;
+            shortest = chunk->frameCount < shortest ? chunk->frameCount : shortest;
+        }
+    }
+    if (!compressed) {
+        return 1;
+    }
+
+    unsigned long long spanned = recentFrames > 1 ? (recentFrames - 2) / shortest + 2 : 1;
+    replay->cacheSlots = spanned < compressed ? (int) spanned : (int) compressed;
+    replay->cache = calloc(replay->cacheSlots, sizeof(ReplayCacheSlot));
+    replay->scratch = malloc(largest);
+    if (!replay->cache || !replay->scratch) {
+        return 0;
+    }
+    int s;
+    for (s = 0; s < replay->cacheSlots; s++) {
+        replay->cache[s].chunk = replay->chunkCount;
+        if (!(replay->cache[s].frames = alignedAlloc(TRAJECTORY_ALIGNMENT, largest))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+Replay* replayOpen(const char* path, int recentFrames) {
+    Replay* replay = calloc(1, sizeof(Replay));
+    if (!replay) {
+        return NULL;
+    }
+    replay->mapping = platformMapFile(path, &replay->size);
+    if (!replay->mapping) {
+        printf("Can't map recording %s\n", path);
+        free(replay);
+        return NULL;
+    }
+
+    replay->header = (const TrajectoryHeader*) replay->mapping;
+    const char* problem = NULL;
+    if (replay->size < sizeof(TrajectoryHeader) || memcmp(replay->header->magic, trajectoryMagic, sizeof(trajectoryMagic))) {
+        problem = "not a recording";
+    } else if (replay->header->version != TRAJECTORY_VERSION) {
+        problem = "written by a different version";
+    } else if (replay->header->realSize != sizeof(real)) {
+        problem = "precision doesn't match this build (LORENZ_SINGLE_PRECISION)";
+    } else if (replay->header->capacity <= 0) {
+        problem = "header is damaged";
+    } else if (!readIndex(replay)) {
+        if (!rebuildIndex(replay)) {
+            problem = "out of memory rebuilding the index";
+        } else if (replay->chunkCount) {
+            printf("%s has no index, it was probably cut short. Recovered %zu chunks\n", path, replay->chunkCount);
+        }
+    }
+    if (!problem && !replay->chunkCount) {
+        problem = "no frames";
+    }
+    if (!problem && !buildTimeIndex(replay)) {
+        problem = "chunks are out of order";
+    }
+    if (!problem && !createCache(replay, recentFrames)) {
+        problem = "out of memory for the chunk cache";
+    }
+    if (problem) {
+        printf("Can't replay %s: %s\n", path, problem);
+        replayClose(replay);
+        return NULL;
+    }
+    return replay;
+}
+
+void replayClose(Replay* replay) {
+    if (!replay) {
+        return;
+    }
+    int s;
+    for (s = 0; s < replay->cacheSlots && replay->cache; s++) {
+        alignedFree(replay->cache[s].frames);
+    }
+    free(replay->cache);
+    free(replay->scratch);
+    free(replay->buckets);
+    free(replay->ownedIndex);
+    platformUnmapFile(replay->mapping, replay->size);
+    free(replay);
+}
+
+const TrajectoryHeader* replayHeader(const Replay* replay) {
+    return replay->header;
+}
+
+unsigned long long replayFirstTick(const Replay* replay) {
+    return replay->firstTick;
+}
+
+unsigned long long replayLastTick(const Replay* replay) {
+    return replay->lastTick;
+}
+
+// Returns the decoded frames of chunk c, decoding over the least recently used slot on a miss
+static const Vec3* decodedChunk(Replay* replay, size_t c, const TrajectoryChunk* chunk) {
+    ReplayCacheSlot* victim = &replay->cache[0];
+    int s;
+    replay->clock++;
+    for (s = 0; s < replay->cacheSlots; s++) {
+        ReplayCacheSlot* slot = &replay->cache[s];
+        if (slot->chunk == c) {
+            slot->used = replay->clock;
+            return slot->frames;
+        }
+        if (slot->used < victim->used) {
+            victim = slot;
+        }
+    }
+    victim->chunk = replay->chunkCount;
+    if (!trajectoryDecode((const unsigned char*) (chunk + 1), (size_t) chunk->storedBytes, chunk->frameCount,
+        chunk->particleCount, victim->frames, replay->scratch)) {
+        return NULL;
+    }
+    victim->chunk = c;
+    victim->used = replay->clock;
+    return victim->frames;
+}
+
+int replayFrame(Replay* replay, unsigned long long tick, ReplayFrame* frame) {
+    if (tick < replay->firstTick || tick > replay->lastTick) {
+        return 0;
+    }
+    const TrajectoryIndexEntry* index = replay->index;
+    size_t c = replay->buckets[(tick - replay->firstTick) / replay->bucketTicks];
+    while (index[c].firstTick + index[c].frameCount <= tick) {
+        c++;
+    }
+    if (index[c].firstTick > tick) {
+        return 0; // Dropped
+    }
+
+    const TrajectoryChunk* chunk = (const TrajectoryChunk*) (replay->mapping + index[c].offset);
+    const Vec3* frames = chunk->codec == TRAJECTORY_RAW ? (const Vec3*) (chunk + 1) : decodedChunk(replay, c, chunk);
+    if (!frames) {
+        return 0;
+    }
+    frame->positions = frames + (size_t) (tick - index[c].firstTick) * chunk->particleCount;
+    frame->tick = tick;
+    frame->particleCount = chunk->particleCount;
+    frame->system = chunk->system;
+    return 1;
+}
@@ -0,0 +1,40 @@
+#ifndef LORENZ_REPLAY_H
+#define LORENZ_REPLAY_H
+
+#include "trajectory.h"
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+typedef struct ReplayFrame {
+    const Vec3* positions; // particleCount positions, valid until the next replayFrame call evicts its chunk
+    unsigned long long tick;
+    int particleCount;
+    int system;
+} ReplayFrame;
+
+// A memory mapped trajectory file. Raw chunks are read in place, compressed ones are decoded
+// into a small cache, so memory follows the frames being looked at rather than the file size.
+typedef struct Replay Replay;
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+// Maps and validates path, reading the index from the footer or rebuilding it from the chunk
+// headers if the recording was cut short. Returns NULL and prints why on failure.
+// Any span of recentFrames consecutive frames stays cached at once, so that many frame pointers
+// can be held together (a trail's worth, say).
+Replay* replayOpen(const char* path, int recentFrames);
+void replayClose(Replay* replay);
+
+const TrajectoryHeader* replayHeader(const Replay* replay);
+unsigned long long replayFirstTick(const Replay* replay);
+unsigned long long replayLastTick(const Replay* replay);
+
+// Finds the frame for tick in constant time. Returns 0 if tick wasn't recorded (outside the
+// recording, dropped, or a damaged chunk).
+int replayFrame(Replay* replay, unsigned long long tick, ReplayFrame* frame);
+
+#endif
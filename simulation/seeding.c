@@ -0,0 +1,108 @@
+#include <math.h>
+#include <ctype.h>
+
+#include "seeding.h"
+#include "random.h"
+
+#define SEEDING_GRAIN 4096
+
+const char* seedShapeNames[SEED_SHAPE_COUNT] = {
+    [SEED_CUBE] = "cube",
+    [SEED_SPHERE] = "sphere",
+    [SEED_GAUSSIAN] = "gaussian",
+};
+
+int seedShapeFromName(const char* name) {
+    int i;
+    for (i = 0; i < SEED_SHAPE_COUNT; i++) {
+        const char* a = seedShapeNames[i];
+        const char* b = name;
+        while (*a && *b && tolower((unsigned char) *a) == tolower((unsigned char) *b)) {
+            a++;
+            b++;
+        }
+        if (!*a && !*b) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// ------------------------------------------------------
+// Seeding
+// ------------------------------------------------------
+
+void seedParticleRange(ParticleStore* store, int start, int end, const Attractor* attractor, const SeedSettings* settings) {
+    const double pi = 3.14159265358979323846;
+    const double size = attractor->seedSize;
+    const Vec3 center = {
+        attractor->seedOrigin.x + size / 2,
+        attractor->seedOrigin.y + size / 2,
+        attractor->seedOrigin.z + size / 2,
+    };
+    PhiloxKey key = {{settings->seed, settings->stream}};
+    int i;
+
+    for (i = start; i < end; i++) {
+        // Two blocks give four 53-bit uniforms, enough for every shape without rejection
+        PhiloxCounter first = philox4x32((PhiloxCounter){{(uint32_t) i, 0, 0, 0}}, key);
+        PhiloxCounter second = philox4x32((PhiloxCounter){{(uint32_t) i, 1, 0, 0}}, key);
+        double u0 = philoxUniform(first.v[0], first.v[1]);
+        double u1 = philoxUniform(first.v[2], first.v[3]);
+        double u2 = philoxUniform(second.v[0], second.v[1]);
+        double u3 = philoxUniform(second.v[2], second.v[3]);
+        Vec3 point;
+
+        switch (settings->shape) {
+            case SEED_SPHERE: {
+                double radius = size / 2 * cbrt(u0);
+                double cosTheta = 2 * u1 - 1;
+                double sinTheta = sqrt(1 - cosTheta * cosTheta);
+                double phi = 2 * pi * u2;
+                point = (Vec3){
+                    center.x + radius * sinTheta * cos(phi),
+                    center.y + radius * sinTheta * sin(phi),
+                    center.z + radius * cosTheta,
+                };
+                break;
+            }
+            case SEED_GAUSSIAN: {
+                // Box-Muller, 1 - u keeps the logarithm away from zero
+                double sigma = size / 4;
+                double r0 = sqrt(-2 * log(1 - u0));
+                double r1 = sqrt(-2 * log(1 - u2));
+                point = (Vec3){
+                    center.x + sigma * r0 * cos(2 * pi * u1),
+                    center.y + sigma * r0 * sin(2 * pi * u1),
+                    center.z + sigma * r1 * cos(2 * pi * u3),
+                };
+                break;
+            }
+            default:
+                point = (Vec3){
+                    attractor->seedOrigin.x + u0 * size,
+                    attractor->seedOrigin.y + u1 * size,
+                    attractor->seedOrigin.z + u2 * size,
+                };
+                break;
+        }
+        particleStoreSet(store, i, point);
+    }
+}
+
+typedef struct SeedJob {
+    ParticleStore* store;
+    const Attractor* attractor;
+    const SeedSettings* settings;
+} SeedJob;
+
+static void seedTask(void* context, int start, int end, int worker) {
+    SeedJob* job = context;
+    (void) worker;
+    seedParticleRange(job->store, start, end, job->attractor, job->settings);
+}
+
+void seedParticlesParallel(ThreadPool* pool, ParticleStore* store, int start, int end, const Attractor* attractor, const SeedSettings* settings) {
+    SeedJob job = {store, attractor, settings};
+    threadPoolParallelFor(pool, start, end, SEEDING_GRAIN, seedTask, &job);
+}
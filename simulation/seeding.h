@@ -0,0 +1,40 @@
+#ifndef LORENZ_SEEDING_H
+#define LORENZ_SEEDING_H
+
+#include <stdint.h>
+
+#include "particles.h"
+#include "attractors.h"
+#include "threadpool.h"
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+// All shapes are placed with the attractor's seedOrigin and seedSize
+typedef enum SeedShape {
+    SEED_CUBE,     // Uniform in [seedOrigin, seedOrigin + seedSize)
+    SEED_SPHERE,   // Uniform in the ball inscribed in that cube
+    SEED_GAUSSIAN, // Normal around the cube's center, standard deviation seedSize / 4
+    SEED_SHAPE_COUNT
+} SeedShape;
+
+typedef struct SeedSettings {
+    SeedShape shape;
+    uint32_t seed;
+    uint32_t stream; // Bumped for every reseed so a reset gives new points, still reproducibly
+} SeedSettings;
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+extern const char* seedShapeNames[SEED_SHAPE_COUNT];
+// Case-insensitive lookup, returns -1 if there's no shape by that name
+int seedShapeFromName(const char* name);
+
+// Particle i only depends on (seed, stream, i), so any range can be seeded on its own
+void seedParticleRange(ParticleStore* store, int start, int end, const Attractor* attractor, const SeedSettings* settings);
+void seedParticlesParallel(ThreadPool* pool, ParticleStore* store, int start, int end, const Attractor* attractor, const SeedSettings* settings);
+
+#endif
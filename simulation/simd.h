@@ -0,0 +1,128 @@
+#ifndef LORENZ_SIMD_H
+#define LORENZ_SIMD_H
+
+#include <math.h>
+
+#include "../constants.h"
+
+/*
+Thin lane abstraction over the widest vector unit the compiler is allowed to target, for
+the storage type `real`. Kernels are written once against Lane and the lane* functions and
+get AVX (4 doubles / 8 floats), SSE2 (2 doubles / 4 floats) or plain scalars (1 lane)
+depending on the -m flags in the Makefile and LORENZ_SINGLE_PRECISION.
+*/
+
+#if defined(LORENZ_SINGLE_PRECISION) && defined(__AVX__)
+
+#include <immintrin.h>
+#define LANE_WIDTH 8
+typedef __m256 Lane;
+
+static inline Lane laneLoad(const real* p) { return _mm256_loadu_ps(p); }
+static inline void laneStore(real* p, Lane v) { _mm256_storeu_ps(p, v); }
+static inline Lane laneSet(real v) { return _mm256_set1_ps(v); }
+static inline Lane laneAdd(Lane a, Lane b) { return _mm256_add_ps(a, b); }
+static inline Lane laneSub(Lane a, Lane b) { return _mm256_sub_ps(a, b); }
+static inline Lane laneMul(Lane a, Lane b) { return _mm256_mul_ps(a, b); }
+#if defined(__FMA__)
+static inline Lane laneMulAdd(Lane a, Lane b, Lane c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+static inline Lane laneMulAdd(Lane a, Lane b, Lane c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+
+#elif defined(LORENZ_SINGLE_PRECISION) && defined(__SSE2__)
+
+#include <emmintrin.h>
+#define LANE_WIDTH 4
+typedef __m128 Lane;
+
+static inline Lane laneLoad(const real* p) { return _mm_loadu_ps(p); }
+static inline void laneStore(real* p, Lane v) { _mm_storeu_ps(p, v); }
+static inline Lane laneSet(real v) { return _mm_set1_ps(v); }
+static inline Lane laneAdd(Lane a, Lane b) { return _mm_add_ps(a, b); }
+static inline Lane laneSub(Lane a, Lane b) { return _mm_sub_ps(a, b); }
+static inline Lane laneMul(Lane a, Lane b) { return _mm_mul_ps(a, b); }
+static inline Lane laneMulAdd(Lane a, Lane b, Lane c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+
+#elif defined(__AVX__)
+
+#include <immintrin.h>
+#define LANE_WIDTH 4
+typedef __m256d Lane;
+
+static inline Lane laneLoad(const double* p) { return _mm256_loadu_pd(p); }
+static inline void laneStore(double* p, Lane v) { _mm256_storeu_pd(p, v); }
+static inline Lane laneSet(double v) { return _mm256_set1_pd(v); }
+static inline Lane laneAdd(Lane a, Lane b) { return _mm256_add_pd(a, b); }
+static inline Lane laneSub(Lane a, Lane b) { return _mm256_sub_pd(a, b); }
+static inline Lane laneMul(Lane a, Lane b) { return _mm256_mul_pd(a, b); }
+#if defined(__FMA__)
+static inline Lane laneMulAdd(Lane a, Lane b, Lane c) { return _mm256_fmadd_pd(a, b, c); }
+#else
+static inline Lane laneMulAdd(Lane a, Lane b, Lane c) { return _mm256_add_pd(_mm256_mul_pd(a, b), c); }
+#endif
+
+#elif defined(__SSE2__)
+
+#include <emmintrin.h>
+#define LANE_WIDTH 2
+typedef __m128d Lane;
+
+static inline Lane laneLoad(const double* p) { return _mm_loadu_pd(p); }
+static inline void laneStore(double* p, Lane v) { _mm_storeu_pd(p, v); }
+static inline Lane laneSet(double v) { return _mm_set1_pd(v); }
+static inline Lane laneAdd(Lane a, Lane b) { return _mm_add_pd(a, b); }
+static inline Lane laneSub(Lane a, Lane b) { return _mm_sub_pd(a, b); }
+static inline Lane laneMul(Lane a, Lane b) { return _mm_mul_pd(a, b); }
+static inline Lane laneMulAdd(Lane a, Lane b, Lane c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+
+#else
+
+#define LANE_WIDTH 1
+typedef real Lane;
+
+static inline Lane laneLoad(const real* p) { return *p; }
+static inline void laneStore(real* p, Lane v) { *p = v; }
+static inline Lane laneSet(real v) { return v; }
+static inline Lane laneAdd(Lane a, Lane b) { return a + b; }
+static inline Lane laneSub(Lane a, Lane b) { return a - b; }
+static inline Lane laneMul(Lane a, Lane b) { return a * b; }
+static inline Lane laneMulAdd(Lane a, Lane b, Lane c) { return a * b + c; }
+
+#endif
+
+// laneMulAdd(a, b, c) is a * b + c, fused when the target has FMA
+#define LANE_ALIGNMENT 64 // Cache line, also satisfies every vector width above
+
+// There's no vector sine in the intrinsics, so it goes through memory one lane at a time
+static inline Lane laneSin(Lane v) {
+    real values[LANE_WIDTH];
+    int i;
+    laneStore(values, v);
+    for (i = 0; i < LANE_WIDTH; i++) {
+        values[i] = sin(values[i]);
+    }
+    return laneLoad(values);
+}
+
+static inline Lane laneCos(Lane v) {
+    real values[LANE_WIDTH];
+    int i;
+    laneStore(values, v);
+    for (i = 0; i < LANE_WIDTH; i++) {
+        values[i] = cos(values[i]);
+    }
+    return laneLoad(values);
+}
+
+// Double precision scalar twins of the lane functions, so the same expression can be expanded
+// for either. Scalar code always works in double, whatever the storage type is
+static inline double scalarSet(double v) { return v; }
+static inline double scalarAdd(double a, double b) { return a + b; }
+static inline double scalarSub(double a, double b) { return a - b; }
+static inline double scalarMul(double a, double b) { return a * b; }
+static inline double scalarMulAdd(double a, double b, double c) { return a * b + c; }
+static inline double scalarSin(double v) { return sin(v); }
+static inline double scalarCos(double v) { return cos(v); }
+
+#endif
@@ -0,0 +1,567 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "simulation.h"
+#include "platform.h"
+#include "threadpool.h"
+#include "integrators.h"
+#include "precision.h"
+#include "checkpoint.h"
+
+#define SNAPSHOT_FRESH 4 // Set on the shared triple buffer index when it hasn't been read yet
+#define MAX_TICK_LAG 4   // Ticks the thread may fall behind before it stops catching up
+#define LYAPUNOV_REPORT_TICKS 120 // Ticks between printed Lyapunov summaries
+
+struct Simulation {
+    SimulationSettings settings;
+    ThreadPool* pool;
+
+    // Simulation owned state
+    ParticleStore particles;
+    RK45Integrator adaptive;
+    TrailStore trails;
+    unsigned int trailEpoch; // Bumped whenever trails restart or the point count changes, snapshots then copy them whole
+    AttractorParams params;
+    unsigned long long tick;
+    unsigned int seedStream; // Next SeedSettings.stream
+    PrecisionProbe* probe; // Only allocated with settings.precisionReport
+    TangentStore tangent;  // Only allocated with settings.lyapunovReport
+    CheckpointWriter* writer; // Created by the first SIM_SAVE_CHECKPOINT
+    Recorder* recorder;       // Created by the first tick when settings.recordPath is set
+    LyapunovStats lyapunov;
+    OccupancyGrid occupancy;       // Only allocated with settings.occupancySize
+    unsigned long long occupancyFrom; // First tick counted into it, after the warmup
+
+    // Triple buffer, the writer owns back, the reader owns front and the third one is shared
+    SimSnapshot snapshots[3];
+    int back;
+    int front;
+    _Atomic int middle;
+
+    // Single producer single consumer command ring
+    SimCommand commands[SIM_COMMAND_QUEUE_SIZE];
+    _Atomic unsigned int commandHead; // Next slot to read
+    _Atomic unsigned int commandTail; // Next slot to write
+
+    pthread_t thread;
+    _Atomic int running;
+    int started;
+};
+
+// ------------------------------------------------------
+// Setup
+// ------------------------------------------------------
+
+// Fits the trail quantization box and decimation tolerance to the current system
+static void frameTrails(Simulation* sim) {
+    const Attractor* attractor = &attractors[sim->settings.system];
+    trailStoreSetFrame(&sim->trails, attractor->center, TRAILEXTENT / attractor->scale);
+    sim->trails.tolerance = sim->settings.trailTolerance / attractor->scale; // Set in screen units
+}
+
+// Empties the occupancy grid, fits it to the current system and restarts the warmup
+static void resetOccupancy(Simulation* sim) {
+    if (!sim->occupancy.shards) {
+        return;
+    }
+    const Attractor* attractor = &attractors[sim->settings.system];
+    occupancyReset(&sim->occupancy, attractor->center, TRAILEXTENT / attractor->scale);
+    sim->occupancyFrom = sim->tick + sim->settings.occupancyWarmup;
+}
+
+static void seedParticles(Simulation* sim) {
+    const Attractor* attractor = &attractors[sim->settings.system];
+    SeedSettings seeding = {sim->settings.seedShape, sim->settings.seed, sim->seedStream++};
+    seedParticlesParallel(sim->pool, &sim->particles, 0, sim->settings.maxPoints, attractor, &seeding);
+
+    trailStoreClear(&sim->trails, 0, sim->settings.maxPoints);
+    frameTrails(sim);
+    resetOccupancy(sim);
+    sim->trailEpoch++;
+    rk45Reset(&sim->adaptive, &sim->particles, 0, sim->settings.maxPoints);
+    if (sim->probe) {
+        sim->probe->count = 0;
+    }
+    if (sim->tangent.block) {
+        sim->tangent.time = 0;
+        tangentStoreReset(&sim->tangent, 0, sim->settings.maxPoints);
+    }
+}
+
+static int snapshotInit(SimSnapshot* snapshot, const SimulationSettings* settings) {
+    int maxPoints = settings->maxPoints;
+    if (!trailStoreInit(&snapshot->trails, maxPoints, settings->trailLength, settings->trailTolerance > 0, settings->hugePages)) {
+        return 0;
+    }
+    if (!particleStoreInit(&snapshot->current, maxPoints)) {
+        return 0;
+    }
+    if (!particleStoreInit(&snapshot->previous, maxPoints)) {
+        return 0;
+    }
+    return 1;
+}
+
+static void snapshotDestroy(SimSnapshot* snapshot) {
+    if (snapshot->trails.block) {
+        trailStoreDestroy(&snapshot->trails);
+    }
+    if (snapshot->current.block) {
+        particleStoreDestroy(&snapshot->current);
+    }
+    if (snapshot->previous.block) {
+        particleStoreDestroy(&snapshot->previous);
+    }
+}
+
+// Fills every snapshot with the current state so the renderer has something before the first tick
+static void publishInitialState(Simulation* sim) {
+    int i;
+    for (i = 0; i < 3; i++) {
+        SimSnapshot* snapshot = &sim->snapshots[i];
+        int p;
+        for (p = 0; p < sim->settings.maxPoints; p++) {
+            Vec3 point = particleStoreGet(&sim->particles, p);
+            particleStoreSet(&snapshot->current, p, point);
+            particleStoreSet(&snapshot->previous, p, point);
+        }
+        trailStoreCopy(&snapshot->trails, &sim->trails, 0, sim->settings.maxPoints);
+        snapshot->trailEpoch = sim->trailEpoch;
+        snapshot->pointCount = sim->settings.pointCount;
+        snapshot->system = sim->settings.system;
+        snapshot->tick = sim->tick;
+        snapshot->tickPeriod = 1.0 / sim->settings.tickRate;
+        snapshot->publishTime = platformTime();
+    }
+}
+
+Simulation* simulationCreate(const SimulationSettings* settings) {
+    Simulation* sim = calloc(1, sizeof(Simulation));
+    if (!sim) {
+        return NULL;
+    }
+    sim->settings = *settings;
+    if (sim->settings.pointCount > sim->settings.maxPoints) {
+        sim->settings.pointCount = sim->settings.maxPoints;
+    }
+    if (sim->settings.trailLength < 1) {
+        sim->settings.trailLength = 1;
+    }
+    sim->params = attractors[settings->system].defaults;
+
+    int i, ok = 1;
+    sim->pool = threadPoolCreate(settings->threads);
+    ok = ok && sim->pool;
+    ok = ok && particleStoreInit(&sim->particles, settings->maxPoints);
+    ok = ok && rk45Init(&sim->adaptive, settings->maxPoints, settings->tolerance);
+    ok = ok && trailStoreInit(&sim->trails, settings->maxPoints, sim->settings.trailLength,
+        settings->trailTolerance > 0, settings->hugePages);
+    if (settings->precisionReport) {
+        ok = ok && (sim->probe = calloc(1, sizeof(PrecisionProbe)));
+    }
+    if (settings->lyapunovReport) {
+        ok = ok && tangentStoreInit(&sim->tangent, settings->maxPoints);
+        ok = ok && lyapunovStatsInit(&sim->lyapunov, threadPoolThreadCount(sim->pool));
+    }
+    if (settings->occupancySize > 0) {
+        ok = ok && occupancyInit(&sim->occupancy, threadPoolThreadCount(sim->pool), settings->occupancySize);
+    }
+    for (i = 0; i < 3 && ok; i++) {
+        ok = snapshotInit(&sim->snapshots[i], &sim->settings);
+    }
+    if (!ok) {
+        simulationDestroy(sim);
+        return NULL;
+    }
+
+    seedParticles(sim);
+
+    sim->back = 0;
+    sim->front = 1;
+    atomic_init(&sim->middle, 2);
+    atomic_init(&sim->commandHead, 0);
+    atomic_init(&sim->commandTail, 0);
+    atomic_init(&sim->running, 0);
+
+    publishInitialState(sim);
+
+    return sim;
+}
+
+void simulationDestroy(Simulation* sim) {
+    if (!sim) {
+        return;
+    }
+    simulationStop(sim);
+
+    int i;
+    for (i = 0; i < 3; i++) {
+        snapshotDestroy(&sim->snapshots[i]);
+    }
+    if (sim->trails.block) {
+        trailStoreDestroy(&sim->trails);
+    }
+    checkpointWriterDestroy(sim->writer);
+    if (sim->recorder && !recorderClose(sim->recorder)) {
+        printf("Failed to write the recording %s\n", sim->settings.recordPath);
+    }
+    free(sim->probe);
+    if (sim->tangent.block) {
+        tangentStoreDestroy(&sim->tangent);
+    }
+    if (sim->lyapunov.shards) {
+        lyapunovStatsDestroy(&sim->lyapunov);
+    }
+    if (sim->occupancy.shards) {
+        if (sim->settings.occupancyPath) {
+            occupancyMerge(&sim->occupancy, sim->pool);
+            occupancyPrintReport(&sim->occupancy, attractors[sim->settings.system].name);
+            if (!occupancyExportRaw(&sim->occupancy, sim->settings.occupancyPath)) {
+                printf("Failed to write the occupancy grid %s\n", sim->settings.occupancyPath);
+            }
+        }
+        occupancyDestroy(&sim->occupancy);
+    }
+    if (sim->adaptive.particles) {
+        rk45Destroy(&sim->adaptive);
+    }
+    if (sim->particles.block) {
+        particleStoreDestroy(&sim->particles);
+    }
+    threadPoolDestroy(sim->pool);
+    free(sim);
+}
+
+static void fillCheckpointState(const Simulation* sim, CheckpointState* state) {
+    memset(state, 0, sizeof(*state));
+    state->system = sim->settings.system;
+    state->integrator = sim->settings.integrator;
+    state->capacity = sim->settings.maxPoints;
+    state->pointCount = sim->settings.pointCount;
+    state->params = sim->params;
+    state->delta = sim->settings.delta;
+    state->steps = sim->settings.steps;
+    state->tolerance = sim->settings.tolerance;
+    state->rk45Time = sim->adaptive.time;
+    state->tick = sim->tick;
+    state->seed = sim->settings.seed;
+    state->seedStream = sim->seedStream;
+    state->seedShape = sim->settings.seedShape;
+}
+
+int simulationRestore(Simulation* sim, const Checkpoint* checkpoint) {
+    const CheckpointState* state = &checkpoint->state;
+    if (sim->started) {
+        return 0;
+    }
+    int count = state->capacity < sim->settings.maxPoints ? state->capacity : sim->settings.maxPoints;
+    size_t bytes = count * sizeof(real);
+
+    seedParticles(sim); // Anything past the checkpoint's capacity still gets sensible points
+    memcpy(sim->particles.x, checkpoint->particles.x, bytes);
+    memcpy(sim->particles.y, checkpoint->particles.y, bytes);
+    memcpy(sim->particles.z, checkpoint->particles.z, bytes);
+    memcpy(sim->particles.vx, checkpoint->particles.vx, bytes);
+    memcpy(sim->particles.vy, checkpoint->particles.vy, bytes);
+    memcpy(sim->particles.vz, checkpoint->particles.vz, bytes);
+
+    sim->settings.system = state->system;
+    frameTrails(sim);
+    resetOccupancy(sim);
+    // Timed and untimed trails don't convert, a run switching between them starts its trails afresh
+    if (checkpoint->trails.samples && !checkpoint->trails.ticks == !sim->trails.ticks) {
+        trailStoreCopy(&sim->trails, &checkpoint->trails, 0, count);
+    }
+    sim->settings.integrator = state->integrator == INTEGRATOR_RK45 ? INTEGRATOR_RK45 : INTEGRATOR_RK4;
+    sim->settings.pointCount = state->pointCount < count ? state->pointCount : count;
+    sim->settings.delta = state->delta;
+    sim->settings.steps = state->steps;
+    sim->settings.tolerance = state->tolerance;
+    sim->settings.seed = state->seed;
+    sim->settings.seedShape = state->seedShape;
+    sim->params = state->params;
+    sim->tick = state->tick;
+    sim->seedStream = state->seedStream;
+    sim->occupancyFrom = sim->tick + sim->settings.occupancyWarmup;
+
+    sim->adaptive.tolerance = state->tolerance;
+    sim->adaptive.time = state->rk45Time;
+    rk45Reset(&sim->adaptive, &sim->particles, 0, sim->settings.maxPoints);
+    if (checkpoint->rk45) {
+        memcpy(sim->adaptive.particles, checkpoint->rk45, count * sizeof(RK45Particle));
+    }
+
+    publishInitialState(sim);
+    return 1;
+}
+
+int simulationSaveCheckpoint(Simulation* sim, const char* path, const CheckpointCamera* camera) {
+    if (sim->started) {
+        return 0;
+    }
+    if (sim->writer) {
+        checkpointWriterWait(sim->writer); // An older background write must not land on top of this one
+    }
+    CheckpointState state;
+    fillCheckpointState(sim, &state);
+    if (camera) {
+        state.hasCamera = 1;
+        state.camera = *camera;
+    }
+    const RK45Particle* rk45 = sim->settings.integrator == INTEGRATOR_RK45 ? sim->adaptive.particles : NULL;
+    return checkpointWrite(path, &state, &sim->particles, &sim->trails, rk45);
+}
+
+// ------------------------------------------------------
+// Commands
+// ------------------------------------------------------
+
+int simulationSend(Simulation* sim, const SimCommand* command) {
+    unsigned int tail = atomic_load_explicit(&sim->commandTail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&sim->commandHead, memory_order_acquire);
+    if (tail - head >= SIM_COMMAND_QUEUE_SIZE) {
+        return 0;
+    }
+    sim->commands[tail & (SIM_COMMAND_QUEUE_SIZE - 1)] = *command;
+    atomic_store_explicit(&sim->commandTail, tail + 1, memory_order_release);
+    return 1;
+}
+
+static void saveCheckpoint(Simulation* sim, const char* path, const CheckpointCamera* camera) {
+    if (!sim->writer && !(sim->writer = checkpointWriterCreate())) {
+        printf("Checkpoint writer creation failed\n");
+        return;
+    }
+    CheckpointState state;
+    fillCheckpointState(sim, &state);
+    if (camera) {
+        state.hasCamera = 1;
+        state.camera = *camera;
+    }
+    // Only the copy happens on this thread, the file is written in the background
+    const RK45Particle* rk45 = sim->settings.integrator == INTEGRATOR_RK45 ? sim->adaptive.particles : NULL;
+    if (!checkpointWriterSubmit(sim->writer, path, &state, &sim->particles, &sim->trails, rk45)) {
+        printf("Checkpoint skipped, the previous one is still being written\n");
+    }
+}
+
+static void applyCommand(Simulation* sim, const SimCommand* command) {
+    switch (command->type) {
+        case SIM_SET_DELTA:
+            sim->settings.delta = command->delta;
+            break;
+        case SIM_SET_POINT_COUNT: {
+            int previous = sim->settings.pointCount;
+            sim->settings.pointCount = command->pointCount < 0 ? 0 :
+                command->pointCount > sim->settings.maxPoints ? sim->settings.maxPoints : command->pointCount;
+            if (sim->probe) {
+                sim->probe->count = 0;
+            }
+            if (sim->settings.pointCount != previous) {
+                sim->trailEpoch++;
+            }
+            // Particles that sat out some ticks would otherwise average their growth over time they weren't integrated
+            if (sim->tangent.block && sim->settings.pointCount > previous) {
+                tangentStoreReset(&sim->tangent, previous, sim->settings.pointCount);
+            }
+            break;
+        }
+        case SIM_SET_PARAMS:
+            sim->params = command->params;
+            resetOccupancy(sim);
+            // Each particle's last derivative and the step it took past the shown time came from the old parameters
+            rk45Reset(&sim->adaptive, &sim->particles, 0, sim->settings.maxPoints);
+            break;
+        case SIM_SET_SYSTEM:
+            if (command->system >= 0 && command->system < ATTRACTOR_COUNT) {
+                sim->settings.system = command->system;
+                sim->params = attractors[command->system].defaults;
+                seedParticles(sim);
+            }
+            break;
+        case SIM_RESET_PARTICLES:
+            seedParticles(sim);
+            break;
+        case SIM_SAVE_CHECKPOINT:
+            saveCheckpoint(sim, command->checkpoint.path, &command->checkpoint.camera);
+            break;
+    }
+}
+
+static void drainCommands(Simulation* sim) {
+    unsigned int head = atomic_load_explicit(&sim->commandHead, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&sim->commandTail, memory_order_acquire);
+    while (head != tail) {
+        applyCommand(sim, &sim->commands[head & (SIM_COMMAND_QUEUE_SIZE - 1)]);
+        head++;
+    }
+    atomic_store_explicit(&sim->commandHead, head, memory_order_release);
+}
+
+// ------------------------------------------------------
+// Ticking
+// ------------------------------------------------------
+
+static void publishSnapshot(Simulation* sim) {
+    SimSnapshot* snapshot = &sim->snapshots[sim->back];
+    int count = sim->settings.pointCount;
+    size_t bytes = count * sizeof(real);
+
+    // previous was filled in before this tick's integration
+    memcpy(snapshot->current.x, sim->particles.x, bytes);
+    memcpy(snapshot->current.y, sim->particles.y, bytes);
+    memcpy(snapshot->current.z, sim->particles.z, bytes);
+    memcpy(snapshot->current.vx, sim->particles.vx, bytes);
+    memcpy(snapshot->current.vy, sim->particles.vy, bytes);
+    memcpy(snapshot->current.vz, sim->particles.vz, bytes);
+    // This buffer last saw the trails a few ticks ago, so usually only those samples need copying
+    unsigned long long behind = sim->tick - snapshot->tick;
+    if (snapshot->trailEpoch == sim->trailEpoch && behind < (unsigned long long) sim->trails.length) {
+        trailStoreCatchUp(&snapshot->trails, &sim->trails, 0, count, (int) behind);
+    } else {
+        trailStoreCopy(&snapshot->trails, &sim->trails, 0, count);
+    }
+    snapshot->trailEpoch = sim->trailEpoch;
+
+    snapshot->pointCount = count;
+    snapshot->system = sim->settings.system;
+    snapshot->tick = sim->tick;
+    snapshot->tickPeriod = 1.0 / sim->settings.tickRate;
+    snapshot->publishTime = platformTime();
+
+    // Hand the finished buffer over and take back whichever one the reader isn't using
+    sim->back = atomic_exchange(&sim->middle, sim->back | SNAPSHOT_FRESH) & 3;
+}
+
+// Opened on the first tick rather than at creation so the header sees a restored checkpoint's system and parameters
+static void startRecording(Simulation* sim) {
+    RecorderSettings recording = {
+        sim->settings.recordPath,
+        sim->settings.maxPoints,
+        sim->settings.system,
+        sim->params,
+        1.0 / sim->settings.tickRate,
+        sim->settings.recordCompression ? TRAJECTORY_XOR_RLE : TRAJECTORY_RAW,
+        0,
+    };
+    sim->recorder = recorderCreate(&recording);
+    if (!sim->recorder) {
+        printf("Can't record to %s\n", sim->settings.recordPath);
+        sim->settings.recordPath = NULL;
+    }
+}
+
+void simulationTick(Simulation* sim) {
+    drainCommands(sim);
+    if (sim->settings.recordPath && !sim->recorder) {
+        startRecording(sim);
+    }
+
+    const Attractor* attractor = &attractors[sim->settings.system];
+    int count = sim->settings.pointCount;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        trailStorePush(&sim->trails, i, particleStoreGet(&sim->particles, i), (uint32_t) sim->tick);
+    }
+    // Exact positions to interpolate from, the trails only keep quantized ones
+    SimSnapshot* back = &sim->snapshots[sim->back];
+    size_t bytes = count * sizeof(real);
+    memcpy(back->previous.x, sim->particles.x, bytes);
+    memcpy(back->previous.y, sim->particles.y, bytes);
+    memcpy(back->previous.z, sim->particles.z, bytes);
+
+    double tickDelta = sim->settings.delta * attractor->timeScale;
+    OccupancyGrid* occupancy = sim->occupancy.shards && sim->tick >= sim->occupancyFrom ? &sim->occupancy : NULL;
+    if (sim->settings.integrator == INTEGRATOR_RK45) {
+        integrateRK45Parallel(sim->pool, attractor, &sim->adaptive, &sim->particles, 0, count, &sim->params, tickDelta, occupancy);
+    } else if (sim->tangent.block) {
+        int report = (sim->tick + 1) % LYAPUNOV_REPORT_TICKS == 0;
+        if (report) {
+            lyapunovStatsClear(&sim->lyapunov);
+        }
+        integrateRK4TangentParallel(sim->pool, attractor, &sim->particles, &sim->tangent, 0, count, &sim->params,
+            tickDelta / sim->settings.steps, sim->settings.steps, report ? &sim->lyapunov : NULL, occupancy);
+        if (report) {
+            LyapunovReport summary;
+            lyapunovMerge(&sim->lyapunov, sim->tangent.time, &summary);
+            // The viewer seeds independent particles, so the pair statistics would compare unrelated ones
+            lyapunovPrintReport(&summary, attractor->name, 0);
+            fflush(stdout);
+        }
+    } else {
+        integrateRK4Parallel(sim->pool, attractor, &sim->particles, 0, count, &sim->params, tickDelta / sim->settings.steps, sim->settings.steps, occupancy);
+        if (sim->probe && precisionProbeTick(sim->probe, attractor, &sim->particles, count, &sim->params, tickDelta / sim->settings.steps, sim->settings.steps)) {
+            const PrecisionReport* report = &sim->probe->report;
+            printf("precision (%s, %d samples): 1 tick %.3g, %d ticks max %.3g mean %.3g, view units %.3g\n",
+                sizeof(real) == sizeof(float) ? "float" : "double", report->samples, report->tickError,
+                PRECISION_WINDOW, report->windowError, report->windowMean, report->viewError);
+            fflush(stdout);
+        }
+    }
+
+    if (occupancy) {
+        occupancyTick(occupancy, sim->pool);
+    }
+
+    sim->tick++;
+    if (sim->recorder) {
+        recorderAppend(sim->recorder, sim->tick, &sim->particles, count, sim->settings.system);
+    }
+    publishSnapshot(sim);
+}
+
+const SimSnapshot* simulationAcquireSnapshot(Simulation* sim) {
+    if (atomic_load(&sim->middle) & SNAPSHOT_FRESH) {
+        sim->front = atomic_exchange(&sim->middle, sim->front) & 3;
+    }
+    return &sim->snapshots[sim->front];
+}
+
+// ------------------------------------------------------
+// Thread
+// ------------------------------------------------------
+
+static void* simulationMain(void* data) {
+    Simulation* sim = data;
+    double period = 1.0 / sim->settings.tickRate;
+    double next = platformTime();
+
+    while (atomic_load(&sim->running)) {
+        simulationTick(sim);
+
+        next += period;
+        double now = platformTime();
+        if (now - next > period * MAX_TICK_LAG) {
+            // Hopelessly behind (suspended, debugger, overloaded), drop the backlog
+            next = now;
+        }
+        platformSleep(next - now);
+    }
+    return NULL;
+}
+
+int simulationStart(Simulation* sim) {
+    if (sim->started) {
+        return 1;
+    }
+    atomic_store(&sim->running, 1);
+    if (pthread_create(&sim->thread, NULL, simulationMain, sim)) {
+        atomic_store(&sim->running, 0);
+        return 0;
+    }
+    sim->started = 1;
+    return 1;
+}
+
+void simulationStop(Simulation* sim) {
+    if (!sim->started) {
+        return;
+    }
+    atomic_store(&sim->running, 0);
+    pthread_join(sim->thread, NULL);
+    sim->started = 0;
+}
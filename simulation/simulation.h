@@ -0,0 +1,115 @@
+#ifndef LORENZ_SIMULATION_H
+#define LORENZ_SIMULATION_H
+
+#include "particles.h"
+#include "attractors.h"
+#include "trails.h"
+#include "seeding.h"
+#include "checkpoint.h"
+#include "recorder.h"
+#include "occupancy.h"
+
+#define SIM_COMMAND_QUEUE_SIZE 256 // Must be a power of two
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+typedef enum IntegratorKind { INTEGRATOR_RK4, INTEGRATOR_RK45 } IntegratorKind;
+
+typedef struct SimulationSettings {
+    int maxPoints;
+    int trailLength;     // Samples kept per particle trail
+    double trailTolerance; // Decimate trails to this many screen units of deviation, 0 keeps a sample every tick
+    int pointCount;
+    int threads;         // 0 uses every core
+    IntegratorKind integrator;
+    double tolerance;    // RK45 only
+    int system;          // AttractorSystem
+    double delta;        // Simulated time per tick, before the system's timeScale
+    int steps;           // RK4 substeps per tick
+    double tickRate;     // Ticks per second when running on its own thread
+    int precisionReport; // Print float vs double divergence every PRECISION_WINDOW ticks (RK4 only)
+    int lyapunovReport;  // Evolve tangent vectors and print exponent statistics now and then (RK4 only)
+    SeedShape seedShape;
+    unsigned int seed;   // Same seed, same particles on every platform and thread count
+    const char* recordPath; // Stream every tick's positions to this trajectory file, NULL to not record
+    int recordCompression;  // Encode the recorded chunks with TRAJECTORY_XOR_RLE
+    int hugePages;          // Put the trail arenas on large pages when the OS allows it
+    int occupancySize;      // Voxels along each side of the occupancy grid, 0 doesn't keep one
+    int occupancyWarmup;    // Ticks after every reseed or parameter change before positions are counted
+    const char* occupancyPath; // Raw volume written by simulationDestroy, NULL to not export
+} SimulationSettings;
+
+typedef enum SimCommandType {
+    SIM_SET_DELTA,
+    SIM_SET_POINT_COUNT,
+    SIM_SET_PARAMS,     // Also empties the occupancy grid, it measured a different attractor
+    SIM_SET_SYSTEM,     // Also restores the system's default parameters and reseeds
+    SIM_RESET_PARTICLES, // Reseeds with the next stream of the same seed
+    SIM_SAVE_CHECKPOINT, // Copies the state at the next tick boundary and writes it in the background
+} SimCommandType;
+
+typedef struct SimCommand {
+    SimCommandType type;
+    union {
+        double delta;
+        int pointCount;
+        int system;
+        AttractorParams params;
+        struct {
+            const char* path; // Must stay valid until the command has been processed
+            CheckpointCamera camera;
+        } checkpoint;
+    };
+} SimCommand;
+
+// Everything the renderer needs from one tick. Previous holds the positions one tick earlier
+// so the renderer can interpolate between the two.
+typedef struct SimSnapshot {
+    ParticleStore current;
+    ParticleStore previous;
+    TrailStore trails;
+    unsigned int trailEpoch; // Simulation bookkeeping for catching the trails up
+    int pointCount;
+    int system;
+    unsigned long long tick;
+    double tickPeriod;  // Wall clock seconds between ticks
+    double publishTime; // platformTime() when this snapshot was published
+} SimSnapshot;
+
+typedef struct Simulation Simulation;
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+// Returns NULL on failure
+Simulation* simulationCreate(const SimulationSettings* settings);
+void simulationDestroy(Simulation* sim); // Stops the thread first if it's running
+
+// Replaces the state with a checkpoint's: particles, trails, parameters, counters and RK45 state.
+// Only before simulationStart. Returns 0 if the thread is already running.
+int simulationRestore(Simulation* sim, const Checkpoint* checkpoint);
+
+// Writes a checkpoint on the calling thread, after any background save finishes. Only while
+// the thread isn't running. Returns 1 on success.
+int simulationSaveCheckpoint(Simulation* sim, const char* path, const CheckpointCamera* camera);
+
+// Runs one tick on the calling thread: drains commands, integrates, updates trails and
+// publishes a snapshot. Only use this when the simulation thread isn't running.
+void simulationTick(Simulation* sim);
+
+// Runs simulationTick at settings.tickRate on a dedicated thread. If the thread falls more
+// than a few ticks behind it drops them instead of trying to catch up. Returns 1 on success.
+int simulationStart(Simulation* sim);
+void simulationStop(Simulation* sim);
+
+// Single producer: only one thread may send. Returns 0 if the queue is full.
+int simulationSend(Simulation* sim, const SimCommand* command);
+
+// Single consumer: returns the newest published snapshot, which stays valid and unchanged
+// until the next call. Never blocks.
+const SimSnapshot* simulationAcquireSnapshot(Simulation* sim);
+
+#endif
@@ -0,0 +1,252 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "threadpool.h"
+#include "platform.h"
+
+// Each worker owns a range of chunk indices packed as (tail << 32 | head). The owner pops
+// from the head, thieves take from the tail, and both sides go through one CAS so a chunk
+// can only ever be claimed once.
+typedef struct WorkerQueue {
+    _Alignas(64) _Atomic uint64_t range;
+} WorkerQueue;
+
+typedef struct WorkerArgs {
+    ThreadPool* pool;
+    int index;
+} WorkerArgs;
+
+struct ThreadPool {
+    int threadCount;
+    pthread_t* threads;
+    WorkerArgs* args;
+    WorkerQueue* queues;
+
+    // Current job
+    ThreadPoolTask task;
+    void* context;
+    int start;
+    int end;
+    int grain;
+    _Atomic int pending; // Chunks not yet finished
+
+    // Wake up / shut down
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+    unsigned int generation;
+    int activeWorkers;
+    int quit;
+};
+
+static inline uint64_t packRange(uint32_t head, uint32_t tail) {
+    return ((uint64_t) tail << 32) | head;
+}
+
+// Takes one chunk from the front of the worker's own queue
+static int popChunk(WorkerQueue* queue, uint32_t* chunk) {
+    uint64_t range = atomic_load(&queue->range);
+    for (;;) {
+        uint32_t head = (uint32_t) range;
+        uint32_t tail = (uint32_t) (range >> 32);
+        if (head >= tail) {
+            return 0;
+        }
+        if (atomic_compare_exchange_weak(&queue->range, &range, packRange(head + 1, tail))) {
+            *chunk = head;
+            return 1;
+        }
+    }
+}
+
+// Moves the back half of some other worker's queue into the thief's (empty) queue
+static int stealChunks(ThreadPool* pool, int thief) {
+    int i;
+    for (i = 1; i < pool->threadCount; i++) {
+        WorkerQueue* victim = &pool->queues[(thief + i) % pool->threadCount];
+        uint64_t range = atomic_load(&victim->range);
+        for (;;) {
+            uint32_t head = (uint32_t) range;
+            uint32_t tail = (uint32_t) (range >> 32);
+            if (head >= tail) {
+                break;
+            }
+            uint32_t take = (tail - head + 1) / 2;
+            if (atomic_compare_exchange_weak(&victim->range, &range, packRange(head, tail - take))) {
+                atomic_store(&pool->queues[thief].range, packRange(tail - take, tail));
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void runChunks(ThreadPool* pool, int worker) {
+    uint32_t chunk;
+    for (;;) {
+        while (popChunk(&pool->queues[worker], &chunk)) {
+            int chunkStart = pool->start + (int) chunk * pool->grain;
+            int chunkEnd = chunkStart + pool->grain;
+            if (chunkEnd > pool->end) {
+                chunkEnd = pool->end;
+            }
+            pool->task(pool->context, chunkStart, chunkEnd, worker);
+            atomic_fetch_sub(&pool->pending, 1);
+        }
+        if (!stealChunks(pool, worker)) {
+            return;
+        }
+    }
+}
+
+static void* workerMain(void* data) {
+    WorkerArgs* args = data;
+    ThreadPool* pool = args->pool;
+    unsigned int seen = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->generation == seen && !pool->quit) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->quit) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        seen = pool->generation;
+        pool->activeWorkers++;
+        pthread_mutex_unlock(&pool->lock);
+
+        runChunks(pool, args->index);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->activeWorkers--;
+        if (pool->activeWorkers == 0) {
+            pthread_cond_signal(&pool->idle);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+ThreadPool* threadPoolCreate(int threadCount) {
+    if (threadCount <= 0) {
+        threadCount = platformCpuCount();
+    }
+
+    ThreadPool* pool = calloc(1, sizeof(ThreadPool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->threadCount = threadCount;
+    pool->threads = calloc(threadCount, sizeof(pthread_t));
+    pool->args = calloc(threadCount, sizeof(WorkerArgs));
+    pool->queues = alignedAlloc(64, threadCount * sizeof(WorkerQueue));
+    if (!pool->threads || !pool->args || !pool->queues) {
+        free(pool->threads);
+        free(pool->args);
+        alignedFree(pool->queues);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    int i;
+    for (i = 0; i < threadCount; i++) {
+        atomic_init(&pool->queues[i].range, 0);
+        pool->args[i].pool = pool;
+        pool->args[i].index = i;
+    }
+    // Worker 0 is whoever calls threadPoolParallelFor
+    for (i = 1; i < threadCount; i++) {
+        if (pthread_create(&pool->threads[i], NULL, workerMain, &pool->args[i])) {
+            pool->threadCount = i;
+            break;
+        }
+    }
+
+    return pool;
+}
+
+void threadPoolDestroy(ThreadPool* pool) {
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    int i;
+    for (i = 1; i < pool->threadCount; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->idle);
+    free(pool->threads);
+    free(pool->args);
+    alignedFree(pool->queues);
+    free(pool);
+}
+
+int threadPoolThreadCount(const ThreadPool* pool) {
+    return pool->threadCount;
+}
+
+void threadPoolParallelFor(ThreadPool* pool, int start, int end, int grain, ThreadPoolTask task, void* context) {
+    if (end <= start) {
+        return;
+    }
+    if (grain < 1) {
+        grain = 1;
+    }
+    int chunkCount = (end - start + grain - 1) / grain;
+
+    // Nothing to share, skip the wake up entirely
+    if (pool->threadCount == 1 || chunkCount == 1) {
+        int chunkStart;
+        for (chunkStart = start; chunkStart < end; chunkStart += grain) {
+            task(context, chunkStart, chunkStart + grain < end ? chunkStart + grain : end, 0);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    // Stragglers from the previous job may still be looking for work to steal
+    while (pool->activeWorkers > 0) {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+
+    pool->task = task;
+    pool->context = context;
+    pool->start = start;
+    pool->end = end;
+    pool->grain = grain;
+    atomic_store(&pool->pending, chunkCount);
+
+    int i;
+    for (i = 0; i < pool->threadCount; i++) {
+        uint32_t head = (uint32_t) ((long long) chunkCount * i / pool->threadCount);
+        uint32_t tail = (uint32_t) ((long long) chunkCount * (i + 1) / pool->threadCount);
+        atomic_store(&pool->queues[i].range, packRange(head, tail));
+    }
+
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    runChunks(pool, 0);
+
+    // Everything is claimed, wait for the last chunks still in flight on other workers
+    while (atomic_load(&pool->pending) > 0) {
+        sched_yield();
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef LORENZ_THREAD_POOL_H
+#define LORENZ_THREAD_POOL_H
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+// Called once per chunk with the half-open range [start, end). Worker is in [0, threadCount)
+// and is stable for the duration of the call, so it can index per-thread scratch data.
+typedef void (*ThreadPoolTask)(void* context, int start, int end, int worker);
+
+typedef struct ThreadPool ThreadPool;
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+// threadCount <= 0 uses one thread per logical processor. The calling thread counts as
+// worker 0, so a pool of 1 runs everything inline. Returns NULL on failure.
+ThreadPool* threadPoolCreate(int threadCount);
+void threadPoolDestroy(ThreadPool* pool);
+int threadPoolThreadCount(const ThreadPool* pool);
+
+// Splits [start, end) into chunks of `grain` items, hands every worker an equal share and
+// lets idle workers steal half of a busy worker's remaining chunks. Blocks until all chunks
+// are done. Not reentrant: tasks must not call back into the same pool.
+void threadPoolParallelFor(ThreadPool* pool, int start, int end, int grain, ThreadPoolTask task, void* context);
+
+#endif
@@ -0,0 +1,214 @@
+#include <math.h>
+#include <string.h>
+
+#include "trails.h"
+#include "platform.h"
+
+#define TRAIL_ALIGNMENT 64
+
+static size_t alignTrail(size_t bytes) {
+    return (bytes + TRAIL_ALIGNMENT - 1) / TRAIL_ALIGNMENT * TRAIL_ALIGNMENT;
+}
+
+// Arena layout: samples, then for timed stores ticks and directions, then the frame and rings, each 64 aligned
+size_t trailStoreBytes(int capacity, int length, int timed) {
+    size_t bytes = alignTrail((size_t) capacity * length * sizeof(TrailSample));
+    if (timed) {
+        bytes += alignTrail((size_t) capacity * length * sizeof(uint32_t));
+        bytes += alignTrail((size_t) capacity * sizeof(Vec3));
+    }
+    bytes += alignTrail(sizeof(TrailFrame));
+    return bytes + (size_t) capacity * sizeof(TrailRing);
+}
+
+void trailStoreView(TrailStore* store, void* memory, int capacity, int length, int timed) {
+    char* at = memory;
+    store->samples = (TrailSample*) at;
+    at += alignTrail((size_t) capacity * length * sizeof(TrailSample));
+    store->ticks = NULL;
+    store->directions = NULL;
+    if (timed) {
+        store->ticks = (uint32_t*) at;
+        at += alignTrail((size_t) capacity * length * sizeof(uint32_t));
+        store->directions = (Vec3*) at;
+        at += alignTrail((size_t) capacity * sizeof(Vec3));
+    }
+    store->frame = (TrailFrame*) at;
+    at += alignTrail(sizeof(TrailFrame));
+    store->rings = (TrailRing*) at;
+    store->capacity = capacity;
+    store->length = length;
+    store->tolerance = 0;
+    store->block = NULL;
+    store->blockSize = trailStoreBytes(capacity, length, timed);
+}
+
+int trailStoreInit(TrailStore* store, int capacity, int length, int timed, int hugePages) {
+    size_t bytes = trailStoreBytes(capacity, length, timed);
+    void* block = platformAllocLarge(bytes, hugePages); // Zeroed, so every ring starts empty
+    if (!block) {
+        return 0;
+    }
+    trailStoreView(store, block, capacity, length, timed);
+    store->block = block;
+    trailStoreSetFrame(store, (Vec3){0, 0, 0}, 1);
+    return 1;
+}
+
+void trailStoreDestroy(TrailStore* store) {
+    platformFreeLarge(store->block, store->blockSize);
+    store->block = NULL;
+}
+
+void trailStoreSetFrame(TrailStore* store, const Vec3 center, double extent) {
+    store->frame->origin = (Vec3){center.x - extent, center.y - extent, center.z - extent};
+    store->frame->step = 2 * extent / UINT16_MAX;
+}
+
+void trailStoreClear(TrailStore* store, int start, int end) {
+    int i;
+    for (i = start; i < end; i++) {
+        store->rings[i] = (TrailRing){.writes = store->rings[i].writes};
+    }
+}
+
+// Replaces ring i wholesale. Its write count goes on past every slot, so a reader of dst that
+// had caught up sees the whole ring as rewritten.
+static void replaceRing(TrailStore* dst, int i, const TrailRing ring) {
+    uint32_t writes = dst->rings[i].writes + dst->length;
+    dst->rings[i] = ring;
+    dst->rings[i].writes = writes;
+}
+
+void trailStoreCopy(TrailStore* dst, const TrailStore* src, int start, int end) {
+    if (end <= start) {
+        return;
+    }
+    *dst->frame = *src->frame;
+    if (dst->length == src->length) {
+        size_t from = (size_t) start * src->length;
+        size_t count = (size_t) (end - start) * src->length;
+        memcpy(dst->samples + from, src->samples + from, count * sizeof(TrailSample));
+        if (src->ticks) {
+            memcpy(dst->ticks + from, src->ticks + from, count * sizeof(uint32_t));
+            memcpy(dst->directions + start, src->directions + start, (end - start) * sizeof(Vec3));
+        }
+        int i;
+        for (i = start; i < end; i++) {
+            replaceRing(dst, i, src->rings[i]);
+        }
+        return;
+    }
+    int i, k;
+    for (i = start; i < end; i++) {
+        int count = trailStoreCount(src, i);
+        int skip = count > dst->length ? count - dst->length : 0;
+        replaceRing(dst, i, (TrailRing){0});
+        for (k = skip; k < count; k++) {
+            trailStoreAppendSample(dst, i, src->samples[trailStoreSlot(src, i, k)], src->ticks ? trailStoreTick(src, i, k) : 0);
+        }
+        if (src->ticks) {
+            dst->directions[i] = src->directions[i];
+        }
+    }
+}
+
+// A decimating store rewrites its newest sample until it is kept, so dst's newest may be stale.
+// Every sample from the one after dst's last kept sample on is taken again from src. Directions
+// aren't carried over, only the store being pushed to needs them.
+static void catchUpDecimated(TrailStore* dst, const TrailStore* src, int i) {
+    int have = trailStoreCount(dst, i);
+    int count = trailStoreCount(src, i);
+    if (have < 2) {
+        trailStoreCopy(dst, src, i, i + 1);
+        return;
+    }
+    uint32_t kept = trailStoreTick(dst, i, have - 2);
+    int k = count;
+    while (k > 0 && (int32_t) (trailStoreTick(src, i, k - 1) - kept) > 0) {
+        k--;
+    }
+    if (k == 0 || trailStoreTick(src, i, k - 1) != kept) {
+        trailStoreCopy(dst, src, i, i + 1); // dst's last kept sample has left src's ring
+        return;
+    }
+    trailStoreDropNewest(dst, i);
+    for (; k < count; k++) {
+        trailStoreAppendSample(dst, i, src->samples[trailStoreSlot(src, i, k)], trailStoreTick(src, i, k));
+    }
+}
+
+void trailStoreCatchUp(TrailStore* dst, const TrailStore* src, int start, int end, int pushes) {
+    if (pushes >= src->length || dst->length != src->length) {
+        trailStoreCopy(dst, src, start, end);
+        return;
+    }
+    int i, k;
+    if (src->ticks && src->tolerance > 0) {
+        for (i = start; i < end; i++) {
+            catchUpDecimated(dst, src, i);
+        }
+        return;
+    }
+    for (i = start; i < end; i++) {
+        int count = trailStoreCount(src, i);
+        int fresh = pushes < count ? pushes : count;
+        for (k = count - fresh; k < count; k++) {
+            trailStoreAppendSample(dst, i, src->samples[trailStoreSlot(src, i, k)], src->ticks ? trailStoreTick(src, i, k) : 0);
+        }
+    }
+}
+
+// ------------------------------------------------------
+// Decimation
+// ------------------------------------------------------
+
+/*
+The newest sample is provisional: it follows the particle while the path stays inside a strip
+tolerance wide around the line through the last kept sample, along the direction the path
+first took from it. Once a point falls outside the strip (or heads backwards) the provisional
+sample is kept and the point becomes the new provisional one. Every dropped position lay within
+tolerance of that line, so within twice the tolerance of the segment drawn in its place.
+*/
+
+static Vec3 unitDirection(const Vec3 from, const Vec3 to) {
+    Vec3 d = {to.x - from.x, to.y - from.y, to.z - from.z};
+    real length = (real) sqrt(d.x * d.x + d.y * d.y + d.z * d.z);
+    if (length > 0) {
+        d.x /= length;
+        d.y /= length;
+        d.z /= length;
+    }
+    return d;
+}
+
+void trailStorePushDecimated(TrailStore* store, int i, const Vec3 point, uint32_t tick) {
+    int count = trailStoreCount(store, i);
+    if (count < 2) {
+        trailStoreAppend(store, i, point, tick);
+        if (count == 1) {
+            store->directions[i] = unitDirection(trailStoreGet(store, i, 0), point);
+        }
+        return;
+    }
+
+    const Vec3 anchor = trailStoreGet(store, i, count - 2);
+    Vec3* direction = &store->directions[i];
+    const Vec3 v = {point.x - anchor.x, point.y - anchor.y, point.z - anchor.z};
+    if (direction->x == 0 && direction->y == 0 && direction->z == 0) {
+        *direction = unitDirection(anchor, point); // The particle hadn't moved yet
+    }
+    double along = v.x * direction->x + v.y * direction->y + v.z * direction->z;
+    double offset = v.x * v.x + v.y * v.y + v.z * v.z - along * along;
+    if (along >= 0 && offset <= store->tolerance * store->tolerance) {
+        size_t at = trailStoreSlot(store, i, count - 1);
+        store->samples[at] = trailEncode(store->frame, point);
+        store->ticks[at] = tick;
+        store->rings[i].writes++;
+        trailBoxExpand(&store->rings[i].current, store->samples[at]); // The newest sample is always in current
+        return;
+    }
+    const Vec3 kept = trailStoreNewest(store, i);
+    trailStoreAppend(store, i, point, tick);
+    *direction = unitDirection(kept, point);
+}
@@ -0,0 +1,208 @@
+#ifndef LORENZ_TRAILS_H
+#define LORENZ_TRAILS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../constants.h"
+#include "../engine3d/engine3d.h"
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+// A position as 16 bit fixed point inside the store's TrailFrame, a quarter of a double Vec3
+typedef struct TrailSample {
+    uint16_t x;
+    uint16_t y;
+    uint16_t z;
+} TrailSample;
+
+// The box samples are quantized to: world = origin + sample * step. Positions outside it are clamped.
+typedef struct TrailFrame {
+    Vec3 origin;
+    double step;
+} TrailFrame;
+
+typedef struct TrailBox {
+    TrailSample min;
+    TrailSample max;
+} TrailBox;
+
+// A ring only ever holds the newest length samples, which all fall in the last two runs of length
+// appends. Bounding each run separately keeps the union of the two boxes around the trail
+// without rescanning it when the oldest sample drops off.
+typedef struct TrailRing {
+    int start; // Slot of the oldest sample
+    int count;
+    int appended;      // Samples appended since current was started, at most length
+    TrailBox current;  // Bounds of those samples
+    TrailBox previous; // Bounds of the length samples appended before them
+    uint32_t writes;   // Appends, rewrites and drops so far, never reset, so a reader can tell what changed
+} TrailRing;
+
+// Every particle's trail in one arena: a fixed ring of length samples per particle, then the
+// frame and the ring bookkeeping. Pushing overwrites the oldest sample, so it costs the same at
+// any length. Trails are only drawn, so samples are quantized to the frame, which is far finer
+// than a pixel at any sensible zoom.
+//
+// A timed store also records the tick of every sample and can decimate: with a tolerance set,
+// the newest sample follows the particle until the path leaves a strip tolerance wide around
+// the line it started along, and only then is it kept. Straight stretches collapse into a
+// single segment, so the same samples cover a much longer stretch of time.
+typedef struct TrailStore {
+    TrailSample* samples; // Particle i's ring is samples[i * length] to samples[(i + 1) * length - 1]
+    uint32_t* ticks;    // Same layout as samples, NULL unless timed
+    Vec3* directions;   // Per particle unit direction of the segment being extended, NULL unless timed
+    TrailFrame* frame;
+    TrailRing* rings;
+    int capacity;
+    int length;
+    double tolerance;   // Decimation tolerance, 0 keeps every push. Only used by timed stores.
+    void* block;        // NULL for views
+    size_t blockSize;
+} TrailStore;
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+// Returns 1 on success, 0 if the allocation failed. hugePages asks for large pages, see platformAllocLarge.
+int trailStoreInit(TrailStore* store, int capacity, int length, int timed, int hugePages);
+void trailStoreDestroy(TrailStore* store);
+
+// Size of the arena for this capacity, length and timing
+size_t trailStoreBytes(int capacity, int length, int timed);
+// Lays a store out over trailStoreBytes of memory it doesn't own (a mapped checkpoint, say)
+void trailStoreView(TrailStore* store, void* memory, int capacity, int length, int timed);
+
+// Quantizes to the box center +- extent from now on. Samples already stored move with it, so
+// clear the trails too.
+void trailStoreSetFrame(TrailStore* store, const Vec3 center, double extent);
+void trailStoreClear(TrailStore* store, int start, int end);
+// Copies the trails of particles [start, end) and the frame. Stores of different lengths keep the
+// newest samples that fit. Both stores must be timed or both untimed.
+void trailStoreCopy(TrailStore* dst, const TrailStore* src, int start, int end);
+// Brings dst up to date with src when every trail in src has taken pushes pushes since the two
+// matched. Costs pushes samples per particle instead of a whole trail.
+void trailStoreCatchUp(TrailStore* dst, const TrailStore* src, int start, int end, int pushes);
+
+// Decimating push for timed stores, see TrailStore
+void trailStorePushDecimated(TrailStore* store, int i, const Vec3 point, uint32_t tick);
+
+static inline int trailStoreCount(const TrailStore* store, int i) {
+    return store->rings[i].count;
+}
+static inline void trailBoxExpand(TrailBox* box, const TrailSample sample) {
+    box->min.x = sample.x < box->min.x ? sample.x : box->min.x;
+    box->min.y = sample.y < box->min.y ? sample.y : box->min.y;
+    box->min.z = sample.z < box->min.z ? sample.z : box->min.z;
+    box->max.x = sample.x > box->max.x ? sample.x : box->max.x;
+    box->max.y = sample.y > box->max.y ? sample.y : box->max.y;
+    box->max.z = sample.z > box->max.z ? sample.z : box->max.z;
+}
+// Fixed point box around every sample of particle i, possibly a little larger than the tightest
+// one. Returns 0 if the trail is empty.
+static inline int trailStoreBounds(const TrailStore* store, int i, TrailBox* box) {
+    const TrailRing* ring = &store->rings[i];
+    if (ring->count == 0) {
+        return 0;
+    }
+    *box = ring->appended ? ring->current : ring->previous;
+    if (ring->appended && ring->count > ring->appended) {
+        trailBoxExpand(box, ring->previous.min);
+        trailBoxExpand(box, ring->previous.max);
+    }
+    return 1;
+}
+static inline uint16_t trailQuantize(double value, double origin, double step) {
+    double q = (value - origin) / step + 0.5;
+    return q <= 0 ? 0 : q >= UINT16_MAX ? UINT16_MAX : (uint16_t) q;
+}
+static inline TrailSample trailEncode(const TrailFrame* frame, const Vec3 point) {
+    return (TrailSample){
+        trailQuantize(point.x, frame->origin.x, frame->step),
+        trailQuantize(point.y, frame->origin.y, frame->step),
+        trailQuantize(point.z, frame->origin.z, frame->step),
+    };
+}
+
+// Arena index of sample k of particle i, oldest first
+static inline size_t trailStoreSlot(const TrailStore* store, int i, int k) {
+    int slot = store->rings[i].start + k;
+    if (slot >= store->length) {
+        slot -= store->length;
+    }
+    return (size_t) i * store->length + slot;
+}
+// Sample k still in fixed point, for renderers that fold the frame into their transform
+static inline Vec3 trailStoreGetFixed(const TrailStore* store, int i, int k) {
+    TrailSample sample = store->samples[trailStoreSlot(store, i, k)];
+    return (Vec3){sample.x, sample.y, sample.z};
+}
+static inline Vec3 trailStoreGet(const TrailStore* store, int i, int k) {
+    TrailSample sample = store->samples[trailStoreSlot(store, i, k)];
+    const TrailFrame* frame = store->frame;
+    return (Vec3){
+        frame->origin.x + sample.x * frame->step,
+        frame->origin.y + sample.y * frame->step,
+        frame->origin.z + sample.z * frame->step,
+    };
+}
+// Tick of sample k, timed stores only
+static inline uint32_t trailStoreTick(const TrailStore* store, int i, int k) {
+    return store->ticks[trailStoreSlot(store, i, k)];
+}
+static inline Vec3 trailStoreNewest(const TrailStore* store, int i) {
+    return trailStoreGet(store, i, store->rings[i].count - 1);
+}
+// Always keeps sample as a new sample, dropping the oldest when the ring is full
+static inline void trailStoreAppendSample(TrailStore* store, int i, const TrailSample sample, uint32_t tick) {
+    TrailRing* ring = &store->rings[i];
+    int slot = ring->start + ring->count;
+    if (ring->count < store->length) {
+        ring->count++;
+    } else if (++ring->start == store->length) {
+        ring->start = 0;
+    }
+    if (slot >= store->length) {
+        slot -= store->length;
+    }
+    size_t at = (size_t) i * store->length + slot;
+    ring->writes++;
+    store->samples[at] = sample;
+    if (store->ticks) {
+        store->ticks[at] = tick;
+    }
+    if (ring->appended == store->length) {
+        ring->previous = ring->current;
+        ring->appended = 0;
+    }
+    if (ring->appended++) {
+        trailBoxExpand(&ring->current, sample);
+    } else {
+        ring->current = (TrailBox){sample, sample};
+    }
+}
+// Drops the newest sample, to be appended again
+static inline void trailStoreDropNewest(TrailStore* store, int i) {
+    TrailRing* ring = &store->rings[i];
+    ring->count--;
+    ring->writes++;
+    if (ring->appended) {
+        ring->appended--; // current may still cover the dropped sample, which only loosens it
+    }
+}
+static inline void trailStoreAppend(TrailStore* store, int i, const Vec3 point, uint32_t tick) {
+    trailStoreAppendSample(store, i, trailEncode(store->frame, point), tick);
+}
+// tick is only recorded by timed stores
+static inline void trailStorePush(TrailStore* store, int i, const Vec3 point, uint32_t tick) {
+    if (store->ticks && store->tolerance > 0) {
+        trailStorePushDecimated(store, i, point, tick);
+    } else {
+        trailStoreAppend(store, i, point, tick);
+    }
+}
+
+#endif
@@ -0,0 +1,111 @@
+#include <string.h>
+
+#include "trajectory.h"
+
+#define RLE_RUN 128 // Longest literal or zero run one token describes
+
+const char trajectoryMagic[8] = {'L', 'O', 'R', 'E', 'N', 'Z', 'T', 'R'};
+const char trajectoryChunkMagic[4] = {'C', 'H', 'N', 'K'};
+const char trajectoryFooterMagic[8] = {'L', 'O', 'R', 'E', 'N', 'Z', 'I', 'X'};
+
+// ------------------------------------------------------
+// Codec
+// ------------------------------------------------------
+
+/*
+Consecutive positions of a particle share their sign, exponent and leading mantissa bits, so
+XORing every word with the word one frame earlier leaves mostly zero high bytes. Grouping byte
+b of every word together turns those into long zero runs, which the token stream collapses:
+
+    0x00-0x7F   literal, the next token + 1 bytes are copied
+    0x80-0xFF   token - 0x7F zero bytes
+*/
+
+size_t trajectoryEncodedBound(int frameCount, int particleCount) {
+    size_t raw = trajectoryRawBytes(frameCount, particleCount);
+    return raw + raw / RLE_RUN + 1;
+}
+
+size_t trajectoryEncode(const Vec3* frames, int frameCount, int particleCount, unsigned char* out, unsigned char* scratch) {
+    const size_t wordSize = sizeof(real);
+    const size_t words = (size_t) frameCount * particleCount * 3;
+    const size_t frameBytes = (size_t) particleCount * sizeof(Vec3);
+    const unsigned char* raw = (const unsigned char*) frames;
+    size_t k, b;
+
+    // XOR against the previous frame and group the bytes by significance. Walking the words in
+    // order keeps the reads sequential and spreads the writes over just wordSize streams.
+    for (k = 0; k < words; k++) {
+        size_t at = k * wordSize;
+        for (b = 0; b < wordSize; b++) {
+            scratch[b * words + k] = at + b >= frameBytes ? raw[at + b] ^ raw[at + b - frameBytes] : raw[at + b];
+        }
+    }
+
+    const size_t total = words * wordSize;
+    size_t i = 0, size = 0;
+    while (i < total) {
+        size_t run = 0;
+        if (!scratch[i]) {
+            while (i + run < total && run < RLE_RUN && !scratch[i + run]) {
+                run++;
+            }
+            out[size++] = (unsigned char) (0x7F + run);
+        } else {
+            // A lone zero costs less inside a literal than as its own token
+            while (i + run < total && run < RLE_RUN &&
+                (scratch[i + run] || (i + run + 1 < total && scratch[i + run + 1]))) {
+                run++;
+            }
+            out[size++] = (unsigned char) (run - 1);
+            memcpy(out + size, scratch + i, run);
+            size += run;
+        }
+        i += run;
+    }
+    return size;
+}
+
+int trajectoryDecode(const unsigned char* data, size_t size, int frameCount, int particleCount, Vec3* frames, unsigned char* scratch) {
+    const size_t wordSize = sizeof(real);
+    const size_t words = (size_t) frameCount * particleCount * 3;
+    const size_t frameBytes = (size_t) particleCount * sizeof(Vec3);
+    const size_t total = words * wordSize;
+    size_t i = 0, filled = 0;
+
+    while (i < size) {
+        unsigned char token = data[i++];
+        if (token >= 0x80) {
+            size_t run = token - 0x7F;
+            if (filled + run > total) {
+                return 0;
+            }
+            memset(scratch + filled, 0, run);
+            filled += run;
+        } else {
+            size_t run = token + 1;
+            if (filled + run > total || i + run > size) {
+                return 0;
+            }
+            memcpy(scratch + filled, data + i, run);
+            filled += run;
+            i += run;
+        }
+    }
+    if (filled != total) {
+        return 0;
+    }
+
+    unsigned char* raw = (unsigned char*) frames;
+    size_t k, b;
+    for (k = 0; k < words; k++) {
+        for (b = 0; b < wordSize; b++) {
+            raw[k * wordSize + b] = scratch[b * words + k];
+        }
+    }
+    // Undo the XOR front to back, each frame needs the one before it restored
+    for (k = frameBytes; k < total; k++) {
+        raw[k] ^= raw[k - frameBytes];
+    }
+    return 1;
+}
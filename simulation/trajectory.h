@@ -0,0 +1,97 @@
+#ifndef LORENZ_TRAJECTORY_H
+#define LORENZ_TRAJECTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../engine3d/engine3d.h"
+#include "attractors.h"
+
+#define TRAJECTORY_VERSION 1
+#define TRAJECTORY_ALIGNMENT 64 // Chunk headers and payloads start on cache line boundaries
+
+/*
+File layout, all native endian:
+
+    TrajectoryHeader       magic, version, sizeof(real), recording settings
+    chunks                 TrajectoryChunk followed by its payload, each TRAJECTORY_ALIGNMENT aligned
+    TrajectoryIndexEntry   one per chunk, written when the recording is closed
+    TrajectoryFooter       last bytes of the file, locates the index
+
+A raw payload is frameCount frames of particleCount Vec3 positions, frame after frame, so
+particle i of frame f is payload[f * particleCount + i]. Every frame in a chunk is one tick
+after the previous one, and a chunk never mixes systems or particle counts.
+
+A file without a footer was cut short; its chunks can still be found by walking the headers.
+Any change to these structs or to the layout bumps TRAJECTORY_VERSION.
+*/
+
+// ------------------------------------------------------
+// Structs
+// ------------------------------------------------------
+
+typedef enum TrajectoryCodec {
+    TRAJECTORY_RAW,
+    // Each word XORed with the same word one frame earlier, the bytes grouped by significance
+    // across the chunk, then zero runs collapsed. Lossless, and every chunk decodes on its own.
+    TRAJECTORY_XOR_RLE,
+} TrajectoryCodec;
+
+typedef struct TrajectoryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t realSize;    // sizeof(real) of the build that wrote it
+    int32_t system;       // System at the start, chunks carry their own
+    int32_t capacity;     // Largest particle count any chunk can hold
+    AttractorParams params;
+    double tickPeriod;    // Wall clock seconds between ticks when recorded live
+    uint32_t codec;       // TrajectoryCodec
+    uint32_t reserved[3];
+} TrajectoryHeader;
+
+typedef struct TrajectoryChunk {
+    char magic[4];
+    uint32_t codec;
+    uint64_t firstTick;
+    uint32_t frameCount;
+    uint32_t particleCount;
+    int32_t system;
+    uint32_t reserved;
+    uint64_t storedBytes; // Payload size in the file
+    uint64_t padding[3];  // Keeps the payload aligned
+} TrajectoryChunk;
+
+typedef struct TrajectoryIndexEntry {
+    uint64_t offset;      // Of the TrajectoryChunk
+    uint64_t firstTick;
+    uint32_t frameCount;
+    uint32_t particleCount;
+} TrajectoryIndexEntry;
+
+typedef struct TrajectoryFooter {
+    uint64_t indexOffset;
+    uint64_t chunkCount;
+    char magic[8];
+} TrajectoryFooter;
+
+extern const char trajectoryMagic[8];
+extern const char trajectoryChunkMagic[4];
+extern const char trajectoryFooterMagic[8];
+
+// ------------------------------------------------------
+// Functions
+// ------------------------------------------------------
+
+static inline size_t trajectoryRawBytes(int frameCount, int particleCount) {
+    return (size_t) frameCount * particleCount * sizeof(Vec3);
+}
+// Worst case size of an encoded chunk
+size_t trajectoryEncodedBound(int frameCount, int particleCount);
+
+// Encodes frames (a raw payload) into out using scratch, which must hold trajectoryRawBytes.
+// Returns the encoded size.
+size_t trajectoryEncode(const Vec3* frames, int frameCount, int particleCount, unsigned char* out, unsigned char* scratch);
+// Inverse of trajectoryEncode. scratch must hold trajectoryRawBytes. Returns 0 if the data is malformed.
+int trajectoryDecode(const unsigned char* data, size_t size, int frameCount, int particleCount, Vec3* frames, unsigned char* scratch);
+
+#endif
@@ -0,0 +1,937 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../constants.h"
+#include "../engine3d/engine3d.h"
+#include "../engine3d/mat4f.h"
+#include "../engine3d/raster.h"
+#include "../engine3d/trailview.h"
+#include "../engine3d/vertexcache.h"
+#include "../engine3d/density.h"
+#include "../simulation/attractors.h"
+#include "../simulation/integrators.h"
+#include "../simulation/occupancy.h"
+#include "../simulation/particles.h"
+#include "../simulation/random.h"
+#include "../simulation/seeding.h"
+#include "../simulation/simulation.h"
+#include "../simulation/threadpool.h"
+#include "../simulation/trails.h"
+#include "../simulation/platform.h"
+
+// Benchmark suite. Times the hot kernels on their own and whole frames of fixed seed scenes
+// without SDL, and writes the results as JSON so a later run can be compared against them.
+
+#define BENCH_WIDTH 1280
+#define BENCH_HEIGHT 720
+#define BENCH_GUARD_BAND 4.0 // Same as the viewer's CLIP_GUARD_BAND
+#define BENCH_POINTS 65536   // Particles in the fixture ensemble
+#define BENCH_BLOCK 4096     // Particles per kernel call, about what one worker gets handed
+#define BENCH_SEGMENTS 1024  // Random lines and points cycled through by the single item benchmarks
+#define BENCH_TRAILS 16384   // Particles with trails in the trail benchmarks
+#define BENCH_TRAIL 32       // Trail length, and frames of precomputed path to push from
+#define BENCH_SETTLE 200     // Ticks the fixture ensemble runs to land on the attractor
+#define BENCH_MAX_REPEATS 100
+#define BENCH_MAX_RESULTS 128
+#define BENCH_NAME 64
+
+typedef void (*BenchFunction)(void* context, long long iterations);
+
+typedef struct BenchSettings {
+    int repeats;          // Timed samples per benchmark
+    double sampleTime;    // Seconds each sample runs for
+    int threads;
+    const char* filter;   // Only run benchmarks whose name contains this
+    const char* json;     // "-" for stdout
+    const char* baseline; // Earlier JSON output to compare against
+    double threshold;     // Percent slower than the baseline that counts as a regression
+    int list;
+} BenchSettings;
+
+typedef struct BenchResult {
+    char name[BENCH_NAME];
+    long long iterations; // Ops per sample
+    double itemsPerOp;
+    double median;        // ns/op
+    double mean;
+    double min;
+    double variance;      // Of ns/op across the samples
+} BenchResult;
+
+typedef struct BaselineEntry {
+    char name[BENCH_NAME];
+    double nsPerOp;
+} BaselineEntry;
+
+// Everything the micro benchmarks run on, built once from a fixed seed
+typedef struct Fixture {
+    const Attractor* attractor;
+    AttractorParams params;
+    double delta;         // One viewer tick, before the system's timeScale
+    ThreadPool* pool;
+    ParticleStore points; // BENCH_POINTS particles on the attractor
+    ParticleStore block;  // BENCH_BLOCK particles for the kernels to step
+    Vec3* path;           // BENCH_TRAIL frames of BENCH_TRAILS positions, frame after frame
+    long long pathFrame;
+
+    Mat4 objectToClip;
+    Mat4f objectToClipMatrix;
+    Mat4f trailToClipMatrix[2]; // The second one is turned slightly, to invalidate the vertex cache
+    long long view;
+
+    Vec3 lorenzPoint;
+    Vec3 lorenzParams;
+    Mat4 rotation;
+    Mat4 matrix;
+    Mat4f rotationf;
+    Mat4f matrixf;
+    Vec3 vectors[BENCH_SEGMENTS];
+    Vec3 lines[BENCH_SEGMENTS][2];
+    Vec4 clipLines[BENCH_SEGMENTS][2]; // Random clip space lines, some behind the camera
+    float blockX[BENCH_SEGMENTS], blockY[BENCH_SEGMENTS], blockZ[BENCH_SEGMENTS];
+    float screenX[BENCH_SEGMENTS], screenY[BENCH_SEGMENTS];
+    unsigned char outcodes[BENCH_SEGMENTS];
+
+    TrailStore trails;    // Full trails of BENCH_TRAILS particles
+    TrailStore copy;
+    TrailStore pushed;
+    TrailStore decimated;
+    VertexCache cache;
+    Rasterizer* raster;
+    DensityMap* density;
+    OccupancyGrid occupancy;
+} Fixture;
+
+typedef struct SceneSpec {
+    int count;
+    int trailLength;
+    int density; // Splat into a density map instead of drawing lines
+} SceneSpec;
+
+typedef struct Scene {
+    Simulation* sim;
+    const Attractor* attractor;
+    int count;
+    int trailLength;
+    Rasterizer* raster;
+    DensityMap* density;
+    VertexCache cache;
+    unsigned char trailFade[TRAIL_FADE_STEPS + 1];
+} Scene;
+
+static const SceneSpec scenes[] = {
+    {MAXPOINTS, MAXTRAIL, 0}, // The viewer's defaults
+    {20000, 50, 0},
+    {100000, 16, 0},
+    {1000000, 8, 1},
+};
+
+static volatile double benchSink; // Results are added here so no benchmark loop can be optimized out
+
+// ------------------------------------------------------
+// Helper functions
+// ------------------------------------------------------
+
+static void printUsage(const char* program) {
+    printf("Usage: %s [options]\n", program);
+    printf("  --repeats N          timed samples per benchmark (default 7)\n");
+    printf("  --sample-time S      seconds per sample (default 0.1)\n");
+    printf("  --threads N          threads for the pools, 0 uses every core\n");
+    printf("  --filter text        only run benchmarks whose name contains text\n");
+    printf("  --list               print the benchmark names and exit\n");
+    printf("  --json path          write the results as JSON, - for stdout\n");
+    printf("  --baseline path      compare against the JSON of an earlier run, exits with 1 on a regression\n");
+    printf("  --threshold P        percent slower than the baseline that counts as a regression (default 10)\n");
+}
+
+// The viewer's starting camera: orbiting 35 units out, looking at the centered and scaled attractor
+static void makeObjectToClip(Mat4* out, const Attractor* attractor, int width, int height) {
+    Mat4 projectionMatrix = makeProjectionMatrix(90.0, 0.1, 100, (double) height / width);
+    Mat4 viewMatrix = quickMatrixInverse(makePointAtMatrix((Vec3){0, 0, -35}, (Vec3){0, 0, 0}, (Vec3){0, 1, 0}));
+    Mat4 transformationMatrix;
+    Mat4 translationMatrix = makeTranslationMatrix((Vec3){-attractor->center.x, -attractor->center.y, -attractor->center.z});
+    Mat4 scalingMatrix = makeScalingMatrix((Vec3){attractor->scale, attractor->scale, attractor->scale});
+    Mat4MultiplyMat4(&transformationMatrix, scalingMatrix, translationMatrix);
+    Mat4MultiplyMat4(out, viewMatrix, transformationMatrix);
+    Mat4MultiplyMat4(out, projectionMatrix, *out);
+}
+
+// Trail samples are fixed point, so their frame is folded into the transform like the viewer does
+static void makeTrailToClip(Mat4f* out, const Mat4* objectToClip, const TrailFrame* frame) {
+    Mat4 trailFrameMatrix = makeScalingMatrix((Vec3){frame->step, frame->step, frame->step});
+    Mat4MultiplyMat4(&trailFrameMatrix, makeTranslationMatrix(frame->origin), trailFrameMatrix);
+    Mat4 trailToClip;
+    Mat4MultiplyMat4(&trailToClip, *objectToClip, trailFrameMatrix);
+    Mat4fFromMat4(out, &trailToClip);
+}
+
+// Uniform in [low, high), the same for every run
+static double fixedUniform(uint32_t index, uint32_t lane, double low, double high) {
+    PhiloxCounter counter = philox4x32((PhiloxCounter){{index, lane, 0, 0}}, (PhiloxKey){{0x6C6F7265u, 0x6E7A0001u}});
+    return low + (high - low) * philoxUniform(counter.v[0], counter.v[1]);
+}
+
+// ------------------------------------------------------
+// Measuring
+// ------------------------------------------------------
+
+static int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*) a, y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+// Grows the op count until one call takes sampleTime, which also warms the caches and the pool
+static long long calibrate(BenchFunction run, void* context, double sampleTime) {
+    long long iterations = 1;
+    for (;;) {
+        double start = platformTime();
+        run(context, iterations);
+        double elapsed = platformTime() - start;
+        if (elapsed >= sampleTime) {
+            return iterations;
+        }
+        // At most 10x a round, so a fast first call can't make the next one run for ages
+        double scale = elapsed > 0 ? sampleTime / elapsed * 1.1 : 10;
+        long long next = (long long) (iterations * (scale < 10 ? scale : 10));
+        iterations = next > iterations ? next : iterations + 1;
+    }
+}
+
+static void measure(const BenchSettings* settings, const char* name, double itemsPerOp, BenchFunction run, void* context, BenchResult* result) {
+    double samples[BENCH_MAX_REPEATS];
+    int s;
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->itemsPerOp = itemsPerOp;
+    result->iterations = calibrate(run, context, settings->sampleTime);
+    result->mean = 0;
+    for (s = 0; s < settings->repeats; s++) {
+        double start = platformTime();
+        run(context, result->iterations);
+        samples[s] = (platformTime() - start) * 1e9 / result->iterations;
+        result->mean += samples[s];
+    }
+    result->mean /= settings->repeats;
+    result->variance = 0;
+    for (s = 0; s < settings->repeats; s++) {
+        result->variance += (samples[s] - result->mean) * (samples[s] - result->mean);
+    }
+    result->variance = settings->repeats > 1 ? result->variance / (settings->repeats - 1) : 0;
+    qsort(samples, settings->repeats, sizeof(double), compareDoubles);
+    result->min = samples[0];
+    result->median = settings->repeats % 2 ? samples[settings->repeats / 2] :
+        (samples[settings->repeats / 2 - 1] + samples[settings->repeats / 2]) / 2;
+}
+
+static double itemsPerSecond(const BenchResult* result) {
+    return result->median > 0 ? result->itemsPerOp * 1e9 / result->median : 0;
+}
+
+// ------------------------------------------------------
+// Micro benchmarks
+// ------------------------------------------------------
+
+static void benchRK4Lorenz(void* context, long long iterations) {
+    Fixture* f = context;
+    Vec3 velocity;
+    long long n;
+    for (n = 0; n < iterations; n++) {
+        rk4LorenzAttractor(&f->lorenzPoint, &velocity, f->lorenzParams, DELTA / STEPS);
+    }
+    benchSink += f->lorenzPoint.x;
+}
+
+// The system is picked by the name the benchmark was registered under, see runMicro
+static const Attractor* batchAttractor;
+
+static void benchRK4Batch(void* context, long long iterations) {
+    Fixture* f = context;
+    long long n;
+    for (n = 0; n < iterations; n++) {
+        batchAttractor->rk4Batch(&f->block, 0, BENCH_BLOCK, &batchAttractor->defaults, f->delta * batchAttractor->timeScale / STEPS, 1);
+    }
+    benchSink += f->block.x[0];
+}
+
+static void benchIntegrateParallel(void* context, long long iterations) {
+    Fixture* f = context;
+    long long n;
+    for (n = 0; n < iterations; n++) {
+        integrateRK4Parallel(f->pool, f->attractor, &f->points, 0, BENCH_POINTS, &f->params, f->delta * f->attractor->timeScale / STEPS, 1, NULL);
+    }
+    benchSink += f->points.x[0];
+}
+
+static void benchMat4MultiplyMat4(void* context, long long iterations) {
+    Fixture* f = context;
+    long long n;
+    // Chained through a rotation so every product depends on the last and nothing grows
+    for (n = 0; n < iterations; n++) {
+        Mat4MultiplyMat4(&f->matrix, f->rotation, f->matrix);
+    }
+    benchSink += f->matrix.mat[0][0];
+}
+
+static void benchMat4fMultiplyMat4f(void* context, long long iterations) {
+    Fixture* f = context;
+    long long n;
+    for (n = 0; n < iterations; n++) {
+        Mat4fMultiplyMat4f(&f->matrixf, &f->rotationf, &f->matrixf);
+    }
+    benchSink += f->matrixf.mat[0][0];
+}
+
+static void benchMat4MultiplyVec3(void* context, long long iterations) {
+    Fixture* f = context;
+    Vec3 out;
+    double sum = 0;
+    long long n;
+    for (n = 0; n < iterations; n++) {
+        Mat4MultiplyVec3(&out, f->objectToClip, f->vectors[n % BENCH_SEGMENTS]);
+        sum += out.x;
+    }
+    benchSink += sum;
+}
+
+static void benchProjectVec3(void* context, long long iterations) {
+    Fixture* f = context;
+    Vec3 out;
+    double sum = 0;
+    long long n;
+    for (n = 0; n < iterations; n++) {
+        projectVec3ToScreen(&out, f->objectToClip, f->vectors[n % BENCH_SEGMENTS], BENCH_WIDTH, BENCH_HEIGHT);
+        sum += out.x;
+    }
+    benchSink += sum;
+}
+
+static void benchProjectPoints(void* context, long long iterations) {
+    Fixture* f = context;
+    long long n;
+    for (n = 0; n < iterations; n++) {
+        projectPointsToScreen(f->screenX, f->screenY, f->outcodes, f->blockX, f->blockY, f->blockZ, BENCH_SEGMENTS,
+            &f->objectToClipMatrix, BENCH_WIDTH, BENCH_HEIGHT, BENCH_GUARD_BAND);
+    }
+    benchSink += f->screenX[0];
+}
+
+static void benchClipWithinPlane(void* context, long long iterations) {
+    Fixture* f = context;
+    const Plane near = {{0, 0, 0.1}, {0, 0, 1}};
+    long long n, kept = 0;
+    for (n = 0; n < iterations; n++) {
+        Vec3 a = f->lines[n % BENCH_SEGMENTS][0], b = f->lines[n % BENCH_SEGMENTS][1];
+        kept += clipWithinPlane(near, &a, &b);
+    }
+    benchSink += kept;
+}
+
+static void benchClipLineHomogeneous(void* context, long long iterations) {
+    Fixture* f = context;
+    long long n, kept = 0;
+    for (n = 0; n < iterations; n++) {
+        Vec4 a = f->clipLines[n % BENCH_SEGMENTS][0], b = f->clipLines[n % BENCH_SEGMENTS][1];
+        kept += clipLineHomogeneous(&a, &b, BENCH_GUARD_BAND);
+    }
+    benchSink += kept;
+}
+
+// The viewer's drawLine3D without SDL: every segment of one path frame is projected, clipped and
+// rasterized, then the frame is finished
+static void benchRasterizeLines(void* context, long long iterations) {
+    Fixture* f = context;
+    long long n;
+    int i;
+    for (n = 0; n < iterations; n++) {
+        const Vec3* from = f->path + (size_t) (n % (BENCH_TRAIL - 1)) * BENCH_TRAILS;
+        const Vec3* to = from + BENCH_TRAILS;
+        rasterizerBegin(f->raster);
+        for (i = 0; i < BENCH_BLOCK; i++) {
+            Vec3 a, b;
+            if (projectLine3D(BENCH_WIDTH, BENCH_HEIGHT, from[i], to[i], &f->objectToClipMatrix, BENCH_GUARD_BAND, &a, &b)) {
+                rasterizerLine(f->raster, a.x, a.y, b.x, b.y, 255, 255, 255, 128);
+            }
+        }
+        rasterizerFinish(f->raster);
+    }
+    benchSink += f->raster->pixels[0];
+}
+
+static void pushPath(Fixture* f, TrailStore* store, long long iterations) {
+    long long n;
+    int i;
+    for (n = 0; n < iterations; n++, f->pathFrame++) {
+        const Vec3* frame = f->path + (size_t) (f->pathFrame % BENCH_TRAIL) * BENCH_TRAILS;
+        for (i = 0; i < BENCH_TRAILS; i++) {
+            trailStorePush(store, i, frame[i], (uint32_t) f->pathFrame);
+        }
+    }
+}
+
+static void benchTrailPush(void* context, long long iterations) {
+    Fixture* f = context;
+    pushPath(f, &f->pushed, iterations);
+    benchSink += f->pushed.rings[0].start;
+}
+
+static void benchTrailPushDecimated(void* context, long long iterations) {
+    Fixture* f = context;
+    pushPath(f, &f->decimated, iterations);
+    benchSink += f->decimated.rings[0].count;
+}
+
+static void benchTrailCopy(void* context, long long iterations) {
+    Fixture* f = context;
+    long long n;
+    for (n = 0; n < iterations; n++) {
+        trailStoreCopy(&f->copy, &f->trails, 0, BENCH_TRAILS);
+    }
+    benchSink += f->copy.rings[0].start;
+}
+
+static void benchTrailCatchUp(void* context, long long iterations) {
+    Fixture* f = context;
+    long long n;
+    for (n = 0; n < iterations; n++) {
+        trailStoreCatchUp(&f->copy, &f->trails, 0, BENCH_TRAILS, 1);
+    }
+    benchSink += f->copy.rings[0].start;
+}
+
+static void runVertexCache(Fixture* f, long long iterations, int moving) {
+    long long n;
+    int i;
+    for (n = 0; n < iterations; n++) {
+        const Mat4f* clipMatrix = &f->trailToClipMatrix[moving ? ++f->view & 1 : 0];
+        vertexCacheBegin(&f->cache, &f->trails, clipMatrix, BENCH_WIDTH, BENCH_HEIGHT, BENCH_GUARD_BAND);
+        for (i = 0; i < BENCH_TRAILS; i++) {
+            vertexCacheRequest(&f->cache, &f->trails, i, 0);
+        }
+        vertexCacheProject(&f->cache, &f->trails);
+    }
+    benchSink += f->cache.vertices[0].x;
+}
+
+// A still camera, so only the first frame projects anything
+static void benchVertexCacheStill(void* context, long long iterations) {
+    runVertexCache(context, iterations, 0);
+}
+
+// The view changes every frame, so every sample is projected again
+static void benchVertexCacheMoving(void* context, long long iterations) {
+    runVertexCache(context, iterations, 1);
+}
+
+static void benchDensity(void* context, long long iterations) {
+    Fixture* f = context;
+    long long n;
+    for (n = 0; n < iterations; n++) {
+        densityMapSplatParticles(f->density, &f->objectToClipMatrix, &f->points, &f->points, 0.5f, BENCH_POINTS);
+        densityMapResolve(f->density);
+    }
+    benchSink += f->density->pixels[0];
+}
+
+static void benchOccupancy(void* context, long long iterations) {
+    Fixture* f = context;
+    long long n;
+    for (n = 0; n < iterations; n++) {
+        occupancyAccumulate(&f->occupancy, 0, &f->points, 0, BENCH_POINTS);
+        occupancyTick(&f->occupancy, f->pool);
+    }
+    benchSink += f->occupancy.samples;
+}
+
+// ------------------------------------------------------
+// Fixture
+// ------------------------------------------------------
+
+static void fixtureDestroy(Fixture* f) {
+    occupancyDestroy(&f->occupancy);
+    densityMapDestroy(f->density);
+    if (f->raster) {
+        rasterizerDestroy(f->raster);
+    }
+    vertexCacheDestroy(&f->cache);
+    TrailStore* stores[] = {&f->trails, &f->copy, &f->pushed, &f->decimated};
+    int s;
+    for (s = 0; s < 4; s++) {
+        if (stores[s]->block) {
+            trailStoreDestroy(stores[s]);
+        }
+    }
+    free(f->path);
+    if (f->block.block) {
+        particleStoreDestroy(&f->block);
+    }
+    if (f->points.block) {
+        particleStoreDestroy(&f->points);
+    }
+    if (f->pool) {
+        threadPoolDestroy(f->pool);
+    }
+}
+
+static int fixtureInit(Fixture* f, int threads) {
+    memset(f, 0, sizeof(*f));
+    f->attractor = &attractors[ATTRACTOR_LORENZ];
+    f->params = f->attractor->defaults;
+    f->delta = DELTA * 10.0 / TICKRATE;
+    const double step = f->delta * f->attractor->timeScale / STEPS;
+    f->pool = threadPoolCreate(threads);
+    if (!f->pool || !particleStoreInit(&f->points, BENCH_POINTS) || !particleStoreInit(&f->block, BENCH_BLOCK)) {
+        fixtureDestroy(f);
+        return 0;
+    }
+    SeedSettings seeding = {SEED_CUBE, 1, 0};
+    seedParticlesParallel(f->pool, &f->points, 0, BENCH_POINTS, f->attractor, &seeding);
+    int i, k;
+    for (i = 0; i < BENCH_SETTLE; i++) {
+        integrateRK4Parallel(f->pool, f->attractor, &f->points, 0, BENCH_POINTS, &f->params, step, STEPS, NULL);
+    }
+    for (i = 0; i < BENCH_BLOCK; i++) {
+        particleStoreSet(&f->block, i, particleStoreGet(&f->points, i));
+    }
+
+    // -- Matrices and single items --
+    makeObjectToClip(&f->objectToClip, f->attractor, BENCH_WIDTH, BENCH_HEIGHT);
+    Mat4fFromMat4(&f->objectToClipMatrix, &f->objectToClip);
+    f->rotation = makeYRotationMatrix(0.01);
+    f->matrix = f->objectToClip;
+    Mat4fFromMat4(&f->rotationf, &f->rotation);
+    Mat4fFromMat4(&f->matrixf, &f->matrix);
+    f->lorenzPoint = particleStoreGet(&f->points, 0);
+    f->lorenzParams = (Vec3){f->params.values[0], f->params.values[1], f->params.values[2]};
+    for (i = 0; i < BENCH_SEGMENTS; i++) {
+        f->vectors[i] = particleStoreGet(&f->points, i);
+        f->blockX[i] = f->points.x[i];
+        f->blockY[i] = f->points.y[i];
+        f->blockZ[i] = f->points.z[i];
+        for (k = 0; k < 2; k++) {
+            f->lines[i][k] = (Vec3){
+                fixedUniform(i, 8 * k, -1, 1), fixedUniform(i, 8 * k + 1, -1, 1), fixedUniform(i, 8 * k + 2, -0.5, 1),
+            };
+            double w = fixedUniform(i, 8 * k + 3, -0.25, 2);
+            f->clipLines[i][k] = (Vec4){
+                fixedUniform(i, 8 * k + 4, -6, 6) * w, fixedUniform(i, 8 * k + 5, -6, 6) * w, fixedUniform(i, 8 * k + 6, -0.5, 1.5) * w, w,
+            };
+        }
+    }
+
+    // -- Trails --
+    // A path of BENCH_TRAIL ticks to fill the trails from and keep pushing
+    f->path = malloc((size_t) BENCH_TRAIL * BENCH_TRAILS * sizeof(Vec3));
+    ParticleStore walker = {0};
+    if (!f->path || !particleStoreInit(&walker, BENCH_TRAILS)) {
+        fixtureDestroy(f);
+        return 0;
+    }
+    for (i = 0; i < BENCH_TRAILS; i++) {
+        particleStoreSet(&walker, i, particleStoreGet(&f->points, i));
+    }
+    for (k = 0; k < BENCH_TRAIL; k++) {
+        for (i = 0; i < BENCH_TRAILS; i++) {
+            f->path[(size_t) k * BENCH_TRAILS + i] = particleStoreGet(&walker, i);
+        }
+        integrateRK4Parallel(f->pool, f->attractor, &walker, 0, BENCH_TRAILS, &f->params, step, STEPS, NULL);
+    }
+    particleStoreDestroy(&walker);
+    if (!trailStoreInit(&f->trails, BENCH_TRAILS, BENCH_TRAIL, 0, 0) || !trailStoreInit(&f->copy, BENCH_TRAILS, BENCH_TRAIL, 0, 0) ||
+        !trailStoreInit(&f->pushed, BENCH_TRAILS, BENCH_TRAIL, 0, 0) || !trailStoreInit(&f->decimated, BENCH_TRAILS, BENCH_TRAIL, 1, 0)) {
+        fixtureDestroy(f);
+        return 0;
+    }
+    const double extent = TRAILEXTENT / f->attractor->scale;
+    trailStoreSetFrame(&f->trails, f->attractor->center, extent);
+    trailStoreSetFrame(&f->copy, f->attractor->center, extent);
+    trailStoreSetFrame(&f->pushed, f->attractor->center, extent);
+    trailStoreSetFrame(&f->decimated, f->attractor->center, extent);
+    f->decimated.tolerance = 0.05 / f->attractor->scale;
+    pushPath(f, &f->trails, BENCH_TRAIL);
+    trailStoreCopy(&f->copy, &f->trails, 0, BENCH_TRAILS);
+    makeTrailToClip(&f->trailToClipMatrix[0], &f->objectToClip, f->trails.frame);
+    Mat4 turned;
+    Mat4MultiplyMat4(&turned, f->objectToClip, makeYRotationMatrix(0.001));
+    makeTrailToClip(&f->trailToClipMatrix[1], &turned, f->trails.frame);
+
+    // -- Renderers --
+    f->raster = rasterizerCreate(BENCH_WIDTH, BENCH_HEIGHT, threads);
+    f->density = densityMapCreate(BENCH_WIDTH, BENCH_HEIGHT, threads, 2.2f);
+    if (!f->raster || !f->density || !occupancyInit(&f->occupancy, threadPoolThreadCount(f->pool), OCCUPANCYSIZE)) {
+        fixtureDestroy(f);
+        return 0;
+    }
+    occupancyReset(&f->occupancy, f->attractor->center, extent);
+    return 1;
+}
+
+// ------------------------------------------------------
+// Scenes
+// ------------------------------------------------------
+
+// TrailSink callbacks, target is the Rasterizer
+static void rasterTrailLine(void* target, const Vec3 a, const Vec3 b, TrailColor color) {
+    rasterizerLine(target, a.x, a.y, b.x, b.y, color.r, color.g, color.b, color.a);
+}
+
+static void rasterTrailRect(void* target, float x, float y, float w, float h, TrailColor color) {
+    rasterizerRect(target, x, y, w, h, color.r, color.g, color.b, color.a);
+}
+
+// One frame the way the viewer draws it with --raster, through the same TrailView: trails
+// through the vertex cache, culled by their bounds, and a tip on every particle
+static void drawSceneLines(Scene* scene, const SimSnapshot* snapshot, const Mat4* objectToClip) {
+    const TrailStore* trails = &snapshot->trails;
+    Mat4f objectToClipMatrix, trailToClipMatrix;
+    Mat4fFromMat4(&objectToClipMatrix, objectToClip);
+    makeTrailToClip(&trailToClipMatrix, objectToClip, trails->frame);
+    rasterizerBegin(scene->raster);
+    TrailView view = {
+        trails,
+        NULL,
+        0,
+        &scene->cache,
+        0,
+        &objectToClipMatrix,
+        &trailToClipMatrix,
+        BENCH_WIDTH,
+        BENCH_HEIGHT,
+        BENCH_GUARD_BAND,
+        scene->trailFade,
+        scene->trailLength,
+        trails->ticks != 0,
+        (uint32_t) snapshot->tick,
+        (uint32_t) scene->trailLength * TRAILREACH,
+        {rasterTrailLine, rasterTrailRect, scene->raster},
+    };
+    trailViewProject(&view, snapshot->pointCount);
+    const TrailColor white = {255, 255, 255, 255};
+    int i;
+    for (i = 0; i < snapshot->pointCount; i++) {
+        Vec3 previous = particleStoreGet(&snapshot->previous, i), current = particleStoreGet(&snapshot->current, i);
+        Vec3 point = {(previous.x + current.x) / 2, (previous.y + current.y) / 2, (previous.z + current.z) / 2};
+        trailViewDrawTrail(&view, i, point, white);
+        trailViewDrawTip(&view, point, white);
+    }
+    rasterizerFinish(scene->raster);
+    benchSink += scene->raster->pixels[0];
+}
+
+// A tick of the simulation and a frame drawn from its snapshot
+static void benchScene(void* context, long long iterations) {
+    Scene* scene = context;
+    Mat4 objectToClip;
+    long long n;
+    for (n = 0; n < iterations; n++) {
+        simulationTick(scene->sim);
+        const SimSnapshot* snapshot = simulationAcquireSnapshot(scene->sim);
+        // The camera is rebuilt every frame, as the viewer does
+        makeObjectToClip(&objectToClip, scene->attractor, BENCH_WIDTH, BENCH_HEIGHT);
+        if (scene->density) {
+            Mat4f objectToClipMatrix, trailToClipMatrix;
+            Mat4fFromMat4(&objectToClipMatrix, &objectToClip);
+            makeTrailToClip(&trailToClipMatrix, &objectToClip, snapshot->trails.frame);
+            densityMapSplatParticles(scene->density, &objectToClipMatrix, &snapshot->previous, &snapshot->current, 0.5f, snapshot->pointCount);
+            densityMapSplatTrails(scene->density, &trailToClipMatrix, &snapshot->trails, snapshot->pointCount);
+            densityMapResolve(scene->density);
+            benchSink += scene->density->pixels[0];
+        } else {
+            drawSceneLines(scene, snapshot, &objectToClip);
+        }
+    }
+}
+
+static void sceneDestroy(Scene* scene) {
+    if (scene->sim) {
+        simulationDestroy(scene->sim);
+    }
+    if (scene->raster) {
+        rasterizerDestroy(scene->raster);
+    }
+    densityMapDestroy(scene->density);
+    vertexCacheDestroy(&scene->cache);
+}
+
+// The viewer's default settings at another size, seeded the same every run, and ticked until
+// the trails are full
+static int sceneInit(Scene* scene, const SceneSpec* spec, int threads) {
+    memset(scene, 0, sizeof(*scene));
+    SimulationSettings settings = {
+        spec->count,
+        spec->trailLength,
+        0,
+        spec->count,
+        threads,
+        INTEGRATOR_RK4,
+        TOLERANCE,
+        ATTRACTOR_LORENZ,
+        DELTA * 10.0 / TICKRATE,
+        STEPS,
+        TICKRATE,
+        0,
+        0,
+        SEED_CUBE,
+        1,
+        NULL,
+        0,
+        0,
+        0,
+        0,
+        NULL,
+    };
+    scene->attractor = &attractors[settings.system];
+    scene->count = spec->count;
+    scene->trailLength = spec->trailLength;
+    trailFadeInit(scene->trailFade);
+    scene->sim = simulationCreate(&settings);
+    if (spec->density) {
+        scene->density = densityMapCreate(BENCH_WIDTH, BENCH_HEIGHT, threads, 2.2f);
+    } else {
+        scene->raster = rasterizerCreate(BENCH_WIDTH, BENCH_HEIGHT, threads);
+    }
+    if (!scene->sim || (!scene->density && !scene->raster)) {
+        sceneDestroy(scene);
+        return 0;
+    }
+    int t;
+    for (t = 0; t < spec->trailLength; t++) {
+        simulationTick(scene->sim);
+    }
+    return 1;
+}
+
+// ------------------------------------------------------
+// Reporting
+// ------------------------------------------------------
+
+static int writeJson(const char* path, const BenchSettings* settings, int threads, const BenchResult* results, int count) {
+    FILE* file = strcmp(path, "-") ? fopen(path, "w") : stdout;
+    if (!file) {
+        return 0;
+    }
+#if defined(__AVX2__)
+    const char* simd = "avx2";
+#elif defined(__SSE2__)
+    const char* simd = "sse2";
+#else
+    const char* simd = "scalar";
+#endif
+    fprintf(file, "{\n");
+    fprintf(file, "  \"precision\": \"%s\",\n", sizeof(real) == sizeof(float) ? "single" : "double");
+    fprintf(file, "  \"simd\": \"%s\",\n", simd);
+    fprintf(file, "  \"threads\": %d,\n", threads);
+    fprintf(file, "  \"repeats\": %d,\n", settings->repeats);
+    fprintf(file, "  \"sample_time\": %g,\n", settings->sampleTime);
+    fprintf(file, "  \"results\": [\n");
+    int r;
+    // One result per line, which is all readBaseline relies on
+    for (r = 0; r < count; r++) {
+        const BenchResult* result = &results[r];
+        fprintf(file, "    {\"name\": \"%s\", \"iterations\": %lld, \"items_per_op\": %g, \"ns_per_op\": %.6g, \"ns_per_op_mean\": %.6g, "
+            "\"ns_per_op_min\": %.6g, \"variance\": %.6g, \"items_per_second\": %.6g}%s\n",
+            result->name, result->iterations, result->itemsPerOp, result->median, result->mean, result->min, result->variance,
+            itemsPerSecond(result), r + 1 < count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    if (file == stdout) {
+        return fflush(file) == 0;
+    }
+    return fclose(file) == 0;
+}
+
+// Reads the name and ns_per_op of every result line written by writeJson. Returns the number of
+// entries, or -1 if the file can't be opened.
+static int readBaseline(const char* path, BaselineEntry* entries, int capacity) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    char line[1024];
+    int count = 0;
+    while (count < capacity && fgets(line, sizeof(line), file)) {
+        const char* name = strstr(line, "\"name\": \"");
+        const char* time = strstr(line, "\"ns_per_op\": ");
+        if (!name || !time || sscanf(name + 9, "%63[^\"]", entries[count].name) != 1) {
+            continue;
+        }
+        entries[count].nsPerOp = strtod(time + 13, NULL);
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+// Prints every benchmark against its baseline and returns the number of regressions. A result
+// only regresses when its median is threshold slower and even its fastest sample is slower than
+// the baseline, so one noisy sample can't fail a run.
+static int compareBaseline(FILE* log, const BenchResult* results, int count, const BaselineEntry* baseline, int baselineCount, double threshold) {
+    int r, b, regressions = 0;
+    fprintf(log, "\ncompared with the baseline (median ns/op, %g%% threshold):\n", threshold);
+    for (r = 0; r < count; r++) {
+        const BenchResult* result = &results[r];
+        for (b = 0; b < baselineCount && strcmp(baseline[b].name, result->name); b++);
+        if (b == baselineCount || baseline[b].nsPerOp <= 0) {
+            fprintf(log, "  %-36s %12.4g  (not in the baseline)\n", result->name, result->median);
+            continue;
+        }
+        double change = 100 * (result->median / baseline[b].nsPerOp - 1);
+        int regressed = change > threshold && result->min > baseline[b].nsPerOp;
+        regressions += regressed;
+        fprintf(log, "  %-36s %12.4g  was %12.4g  %+7.1f%%%s\n", result->name, result->median, baseline[b].nsPerOp, change,
+            regressed ? "  REGRESSION" : change < -threshold ? "  faster" : "");
+    }
+    return regressions;
+}
+
+// Runs one benchmark unless the filter skips it, and prints its line as soon as it's done
+static void run(const BenchSettings* settings, FILE* log, const char* name, double itemsPerOp, BenchFunction function, void* context, BenchResult* results, int* count) {
+    if (settings->filter && !strstr(name, settings->filter)) {
+        return;
+    }
+    if (settings->list) {
+        fprintf(log, "%s\n", name);
+        return;
+    }
+    if (*count == BENCH_MAX_RESULTS) {
+        return;
+    }
+    BenchResult* result = &results[*count];
+    measure(settings, name, itemsPerOp, function, context, result);
+    fprintf(log, "  %-36s %12.4g ns/op  +-%5.1f%%  %12.4g items/s\n", result->name, result->median,
+        result->mean > 0 ? 100 * sqrt(result->variance) / result->mean : 0.0, itemsPerSecond(result));
+    fflush(log);
+    (*count)++;
+}
+
+// Main
+int main( int argc, char* argv[] ) {
+    // -- Command line --
+    BenchSettings settings = {
+        7,
+        0.1,
+        THREADS,
+        NULL,
+        NULL,
+        NULL,
+        10.0,
+        0,
+    };
+    int arg;
+    for (arg = 1; arg < argc; arg++) {
+        if (!strcmp(argv[arg], "--repeats") && arg + 1 < argc) {
+            settings.repeats = atoi(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--sample-time") && arg + 1 < argc) {
+            settings.sampleTime = atof(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--threads") && arg + 1 < argc) {
+            settings.threads = atoi(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--filter") && arg + 1 < argc) {
+            settings.filter = argv[++arg];
+        } else if (!strcmp(argv[arg], "--list")) {
+            settings.list = 1;
+        } else if (!strcmp(argv[arg], "--json") && arg + 1 < argc) {
+            settings.json = argv[++arg];
+        } else if (!strcmp(argv[arg], "--baseline") && arg + 1 < argc) {
+            settings.baseline = argv[++arg];
+        } else if (!strcmp(argv[arg], "--threshold") && arg + 1 < argc) {
+            settings.threshold = atof(argv[++arg]);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (settings.repeats < 1 || settings.repeats > BENCH_MAX_REPEATS || settings.sampleTime <= 0) {
+        printf("--repeats must be between 1 and %d and --sample-time positive\n", BENCH_MAX_REPEATS);
+        return 1;
+    }
+    // With the JSON on stdout the progress goes to stderr
+    FILE* log = settings.json && !strcmp(settings.json, "-") ? stderr : stdout;
+
+    static BaselineEntry baseline[BENCH_MAX_RESULTS];
+    int baselineCount = 0;
+    if (settings.baseline && (baselineCount = readBaseline(settings.baseline, baseline, BENCH_MAX_RESULTS)) < 0) {
+        printf("Can't read the baseline %s\n", settings.baseline);
+        return 1;
+    }
+
+    // -- Setup --
+    // Listing only needs the names, the benchmarks never touch the fixture
+    static Fixture fixture;
+    if (!settings.list && !fixtureInit(&fixture, settings.threads)) {
+        printf("Failed to set up the benchmarks\n");
+        return 1;
+    }
+    const int threads = fixture.pool ? threadPoolThreadCount(fixture.pool) : 0;
+    if (!settings.list) {
+        fprintf(log, "%d threads, %d samples of %g s, %s precision\n", threads, settings.repeats, settings.sampleTime,
+            sizeof(real) == sizeof(float) ? "single" : "double");
+    }
+
+    // -- Micro benchmarks --
+    static BenchResult results[BENCH_MAX_RESULTS];
+    int count = 0, s;
+    char name[BENCH_NAME];
+    Fixture* f = &fixture;
+    run(&settings, log, "micro/rk4LorenzAttractor", 1, benchRK4Lorenz, f, results, &count);
+    for (s = 0; s < ATTRACTOR_COUNT; s++) {
+        batchAttractor = &attractors[s];
+        snprintf(name, sizeof(name), "micro/rk4Batch/%s", attractors[s].name);
+        run(&settings, log, name, BENCH_BLOCK, benchRK4Batch, f, results, &count);
+    }
+    run(&settings, log, "micro/integrateRK4Parallel", BENCH_POINTS, benchIntegrateParallel, f, results, &count);
+    run(&settings, log, "micro/Mat4MultiplyMat4", 1, benchMat4MultiplyMat4, f, results, &count);
+    run(&settings, log, "micro/Mat4fMultiplyMat4f", 1, benchMat4fMultiplyMat4f, f, results, &count);
+    run(&settings, log, "micro/Mat4MultiplyVec3", 1, benchMat4MultiplyVec3, f, results, &count);
+    run(&settings, log, "micro/projectVec3ToScreen", 1, benchProjectVec3, f, results, &count);
+    run(&settings, log, "micro/projectPointsToScreen", BENCH_SEGMENTS, benchProjectPoints, f, results, &count);
+    run(&settings, log, "micro/clipWithinPlane", 1, benchClipWithinPlane, f, results, &count);
+    run(&settings, log, "micro/clipLineHomogeneous", 1, benchClipLineHomogeneous, f, results, &count);
+    run(&settings, log, "micro/rasterizeLines", BENCH_BLOCK, benchRasterizeLines, f, results, &count);
+    run(&settings, log, "micro/trailStorePush", BENCH_TRAILS, benchTrailPush, f, results, &count);
+    run(&settings, log, "micro/trailStorePushDecimated", BENCH_TRAILS, benchTrailPushDecimated, f, results, &count);
+    run(&settings, log, "micro/trailStoreCopy", BENCH_TRAILS, benchTrailCopy, f, results, &count);
+    run(&settings, log, "micro/trailStoreCatchUp", BENCH_TRAILS, benchTrailCatchUp, f, results, &count);
+    run(&settings, log, "micro/vertexCache/still", BENCH_TRAILS, benchVertexCacheStill, f, results, &count);
+    run(&settings, log, "micro/vertexCache/moving", BENCH_TRAILS, benchVertexCacheMoving, f, results, &count);
+    run(&settings, log, "micro/densitySplat", BENCH_POINTS, benchDensity, f, results, &count);
+    run(&settings, log, "micro/occupancyAccumulate", BENCH_POINTS, benchOccupancy, f, results, &count);
+    if (!settings.list) {
+        fixtureDestroy(f);
+    }
+
+    // -- Scenes --
+    int status = 0;
+    for (s = 0; s < (int) (sizeof(scenes) / sizeof(scenes[0])); s++) {
+        const SceneSpec* spec = &scenes[s];
+        snprintf(name, sizeof(name), "scene/%s/%dx%d", spec->density ? "density" : "lines", spec->count, spec->trailLength);
+        if ((settings.filter && !strstr(name, settings.filter)) || settings.list) {
+            run(&settings, log, name, spec->count, benchScene, NULL, results, &count); // Only lists it
+            continue;
+        }
+        Scene scene;
+        if (!sceneInit(&scene, spec, settings.threads)) {
+            printf("Failed to set up %s\n", name);
+            status = 1;
+            continue;
+        }
+        run(&settings, log, name, spec->count, benchScene, &scene, results, &count);
+        sceneDestroy(&scene);
+    }
+    if (settings.list) {
+        return 0;
+    }
+
+    // -- Report --
+    if (settings.json && !writeJson(settings.json, &settings, threads, results, count)) {
+        printf("Failed to write %s\n", settings.json);
+        status = 1;
+    }
+    if (settings.baseline) {
+        int regressions = compareBaseline(log, results, count, baseline, baselineCount, settings.threshold);
+        fprintf(log, "%d regression%s\n", regressions, regressions == 1 ? "" : "s");
+        if (regressions) {
+            status = 1;
+        }
+    }
+    return status;
+}
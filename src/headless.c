@@ -0,0 +1,507 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../constants.h"
+#include "../simulation/attractors.h"
+#include "../simulation/checkpoint.h"
+#include "../simulation/integrators.h"
+#include "../simulation/lyapunov.h"
+#include "../simulation/occupancy.h"
+#include "../simulation/particles.h"
+#include "../simulation/recorder.h"
+#include "../simulation/simulation.h"
+#include "../simulation/seeding.h"
+#include "../simulation/threadpool.h"
+#include "../simulation/platform.h"
+
+// Headless batch runner. Integrates an ensemble without opening a window and reports throughput,
+// so it builds and runs on machines without SDL.
+
+#define HEADLESS_BATCH_STEPS 1000 // RK4 steps handed to the pool per parallel pass
+
+typedef struct HeadlessSettings {
+    int count;
+    long long steps;     // RK4 steps, or RK45 output intervals
+    double duration;     // Simulated time, before the system's timeScale is applied
+    int threads;
+    IntegratorKind integrator;
+    double tolerance;
+    int system;
+    AttractorParams params;
+    int paramCount;      // Parameters given on the command line, the rest keep their defaults
+    SeedShape seedShape;
+    unsigned int seed;
+    const char* output;  // Final positions, one "x y z" line per particle
+    int lyapunov;        // Evolve tangent vectors and print exponent and divergence statistics
+    double pairOffset;   // Initial distance between the particles of each pair with lyapunov
+    const char* resume;     // Checkpoint to continue from instead of seeding
+    const char* checkpoint; // Checkpoint written at the end
+    const char* record;     // Trajectory file, one frame every recordEvery steps
+    long long recordEvery;
+    int recordCompression;
+    const char* occupancy;  // Raw volume of every position visited after the warmup
+    const char* marginals;  // Prefix for the occupancy grid's projections along each axis as images
+    int occupancySize;
+    long long occupancyWarmup; // Steps (RK45 output intervals) before positions are counted
+} HeadlessSettings;
+
+// ------------------------------------------------------
+// Helper functions
+// ------------------------------------------------------
+
+static void printUsage(const char* program) {
+    printf("Usage: %s [options]\n", program);
+    printf("  --count N            particles in the ensemble (default 100000)\n");
+    printf("  --steps N            RK4 steps, or RK45 output intervals (default 10000)\n");
+    printf("  --duration T         simulated time before the system's time scale (default 10)\n");
+    printf("  --system name        lorenz, rossler, chen, thomas, aizawa or halvorsen\n");
+    printf("  --params a,b,...     system parameters, unlisted ones keep their defaults\n");
+    printf("  --integrator rk4|rk45\n");
+    printf("  --tolerance T        RK45 error tolerance\n");
+    printf("  --threads N          0 uses every core\n");
+    printf("  --seed N             random seed for the starting positions\n");
+    printf("  --seed-shape shape   cube, sphere or gaussian around the system's seed point\n");
+    printf("  --output path        write the final positions as text\n");
+    printf("  --lyapunov           track Lyapunov exponents and pair divergence (rk4 only)\n");
+    printf("  --pair-offset D      initial pair separation with --lyapunov (default 1e-6)\n");
+    printf("  --resume path        continue from a checkpoint, its system, parameters and count win\n");
+    printf("  --checkpoint path    write a checkpoint at the end\n");
+    printf("  --record path        write a trajectory file with the starting frame and one every --record-every steps\n");
+    printf("  --record-every N     steps (RK45 output intervals) between recorded frames (default 1)\n");
+    printf("  --record-compress    compress the recorded chunks\n");
+    printf("  --occupancy path     count every step into a voxel grid and write it as raw float32 probabilities\n");
+    printf("  --occupancy-size N   voxels along each side of the grid (default %d)\n", OCCUPANCYSIZE);
+    printf("  --occupancy-warmup N steps before positions are counted (default %d)\n", OCCUPANCYWARMUP);
+    printf("  --occupancy-marginals prefix  also write the grid summed along x, y and z as prefix-yz.pgm, -xz and -xy\n");
+}
+
+// Parses a comma separated list, returns the number of values or -1 on malformed input
+static int parseParams(const char* text, AttractorParams* params) {
+    int count = 0;
+    while (*text) {
+        char* end;
+        double value = strtod(text, &end);
+        if (end == text || count == ATTRACTOR_MAX_PARAMS) {
+            return -1;
+        }
+        params->values[count++] = value;
+        text = end;
+        if (*text == ',') {
+            text++;
+        } else if (*text) {
+            return -1;
+        }
+    }
+    return count;
+}
+
+static int writePositions(const char* path, const ParticleStore* store, int count) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        return 0;
+    }
+    int i;
+    for (i = 0; i < count; i++) {
+        Vec3 point = particleStoreGet(store, i);
+        fprintf(file, "%.17g %.17g %.17g\n", (double)point.x, (double)point.y, (double)point.z);
+    }
+    return fclose(file) == 0;
+}
+
+// Log scaled 8 bit grayscale, so the thin outer sheets of the attractor still show
+static int writeMarginal(const char* prefix, const char* suffix, const OccupancyGrid* grid, int axis, uint64_t* counts) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s-%s.pgm", prefix, suffix);
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return 0;
+    }
+    const size_t pixels = (size_t) grid->size * grid->size;
+    occupancyMarginal(grid, axis, counts);
+    uint64_t largest = 0;
+    size_t p;
+    for (p = 0; p < pixels; p++) {
+        largest = counts[p] > largest ? counts[p] : largest;
+    }
+    fprintf(file, "P5\n%d %d\n255\n", grid->size, grid->size);
+    int ok = 1;
+    for (p = 0; p < pixels && ok; p++) {
+        // Rows go top to bottom in the image, so the second axis points up
+        size_t at = (grid->size - 1 - p / grid->size) * grid->size + p % grid->size;
+        int level = largest ? (int) (255 * log1p((double) counts[at]) / log1p((double) largest) + 0.5) : 0;
+        ok = fputc(level, file) != EOF;
+    }
+    return fclose(file) == 0 && ok;
+}
+
+static int writeMarginals(const char* prefix, const OccupancyGrid* grid) {
+    uint64_t* counts = malloc((size_t) grid->size * grid->size * sizeof(uint64_t));
+    int ok = counts && writeMarginal(prefix, "yz", grid, 0, counts) && writeMarginal(prefix, "xz", grid, 1, counts) &&
+        writeMarginal(prefix, "xy", grid, 2, counts);
+    free(counts);
+    return ok;
+}
+
+// Main
+int main( int argc, char* argv[] ) {
+    // -- Command line --
+    HeadlessSettings settings = {
+        100000,
+        10000,
+        10.0,
+        THREADS,
+        INTEGRATOR_RK4,
+        TOLERANCE,
+        ATTRACTOR_LORENZ,
+        {{0}},
+        0,
+        SEED_CUBE,
+        1,
+        NULL,
+        0,
+        1e-6,
+        NULL,
+        NULL,
+        NULL,
+        1,
+        0,
+        NULL,
+        NULL,
+        OCCUPANCYSIZE,
+        OCCUPANCYWARMUP,
+    };
+    int arg;
+    for (arg = 1; arg < argc; arg++) {
+        if (!strcmp(argv[arg], "--count") && arg + 1 < argc) {
+            settings.count = atoi(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--steps") && arg + 1 < argc) {
+            settings.steps = atoll(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--duration") && arg + 1 < argc) {
+            settings.duration = atof(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--threads") && arg + 1 < argc) {
+            settings.threads = atoi(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--integrator") && arg + 1 < argc) {
+            arg++;
+            if (!strcmp(argv[arg], "rk4")) {
+                settings.integrator = INTEGRATOR_RK4;
+            } else if (!strcmp(argv[arg], "rk45")) {
+                settings.integrator = INTEGRATOR_RK45;
+            } else {
+                printf("Unknown integrator: %s\n", argv[arg]);
+                return 1;
+            }
+        } else if (!strcmp(argv[arg], "--tolerance") && arg + 1 < argc) {
+            settings.tolerance = atof(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--system") && arg + 1 < argc) {
+            settings.system = attractorFromName(argv[++arg]);
+            if (settings.system < 0) {
+                printf("Unknown system: %s\n", argv[arg]);
+                return 1;
+            }
+        } else if (!strcmp(argv[arg], "--params") && arg + 1 < argc) {
+            settings.paramCount = parseParams(argv[++arg], &settings.params);
+            if (settings.paramCount < 0) {
+                printf("Malformed parameter list: %s\n", argv[arg]);
+                return 1;
+            }
+        } else if (!strcmp(argv[arg], "--seed") && arg + 1 < argc) {
+            settings.seed = (unsigned int)strtoul(argv[++arg], NULL, 10);
+        } else if (!strcmp(argv[arg], "--seed-shape") && arg + 1 < argc) {
+            int shape = seedShapeFromName(argv[++arg]);
+            if (shape < 0) {
+                printf("Unknown seed shape: %s\n", argv[arg]);
+                return 1;
+            }
+            settings.seedShape = shape;
+        } else if (!strcmp(argv[arg], "--output") && arg + 1 < argc) {
+            settings.output = argv[++arg];
+        } else if (!strcmp(argv[arg], "--lyapunov")) {
+            settings.lyapunov = 1;
+        } else if (!strcmp(argv[arg], "--pair-offset") && arg + 1 < argc) {
+            settings.pairOffset = atof(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--resume") && arg + 1 < argc) {
+            settings.resume = argv[++arg];
+        } else if (!strcmp(argv[arg], "--checkpoint") && arg + 1 < argc) {
+            settings.checkpoint = argv[++arg];
+        } else if (!strcmp(argv[arg], "--record") && arg + 1 < argc) {
+            settings.record = argv[++arg];
+        } else if (!strcmp(argv[arg], "--record-every") && arg + 1 < argc) {
+            settings.recordEvery = atoll(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--record-compress")) {
+            settings.recordCompression = 1;
+        } else if (!strcmp(argv[arg], "--occupancy") && arg + 1 < argc) {
+            settings.occupancy = argv[++arg];
+        } else if (!strcmp(argv[arg], "--occupancy-size") && arg + 1 < argc) {
+            settings.occupancySize = atoi(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--occupancy-warmup") && arg + 1 < argc) {
+            settings.occupancyWarmup = atoll(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--occupancy-marginals") && arg + 1 < argc) {
+            settings.marginals = argv[++arg];
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    // The particles are used straight from the mapping, so resuming costs no more than a page fault per page touched
+    Checkpoint resume = {0};
+    if (settings.resume) {
+        if (!checkpointOpen(&resume, settings.resume)) {
+            return 1;
+        }
+        settings.count = resume.state.pointCount;
+        settings.system = resume.state.system;
+    }
+    if (settings.count <= 0 || settings.steps <= 0 || settings.duration <= 0 || settings.recordEvery <= 0) {
+        printf("Count, steps, duration and the recording interval must be positive\n");
+        return 1;
+    }
+    if (!(settings.tolerance > 0)) {
+        printf("--tolerance must be positive\n");
+        return 1;
+    }
+    if ((settings.occupancy || settings.marginals) && settings.occupancySize <= 0) {
+        printf("--occupancy-size must be positive\n");
+        return 1;
+    }
+    if (settings.lyapunov && settings.integrator != INTEGRATOR_RK4) {
+        printf("--lyapunov only works with the rk4 integrator\n");
+        return 1;
+    }
+
+    const Attractor* attractor = &attractors[settings.system];
+    if (settings.paramCount > attractor->paramCount) {
+        printf("%s takes %d parameters\n", attractor->name, attractor->paramCount);
+        return 1;
+    }
+    AttractorParams params = settings.resume ? resume.state.params : attractor->defaults;
+    int i;
+    for (i = 0; i < settings.paramCount; i++) {
+        params.values[i] = settings.params.values[i];
+    }
+
+    // -- Setup --
+    ThreadPool* pool = threadPoolCreate(settings.threads);
+    if (!pool) {
+        printf("Failed to create the thread pool\n");
+        return 1;
+    }
+    // Framed like the trails, which fit every system with room to spare
+    OccupancyGrid occupancy = {0};
+    if ((settings.occupancy || settings.marginals) && !occupancyInit(&occupancy, threadPoolThreadCount(pool), settings.occupancySize)) {
+        printf("Failed to allocate the occupancy grid\n");
+        threadPoolDestroy(pool);
+        return 1;
+    }
+    if (occupancy.shards) {
+        occupancyReset(&occupancy, attractor->center, TRAILEXTENT / attractor->scale);
+    }
+    ParticleStore store = {0};
+    if (settings.resume) {
+        store = resume.particles;
+    } else if (!particleStoreInit(&store, settings.count)) {
+        printf("Failed to allocate %d particles\n", settings.count);
+        threadPoolDestroy(pool);
+        return 1;
+    }
+    // A checkpoint saved by the viewer stores more particles than it simulates, and everything
+    // written back out has to keep its layout
+    const int capacity = settings.resume ? resume.state.capacity : settings.count;
+    RK45Integrator adaptive = {0};
+    int resumeRK45 = settings.integrator == INTEGRATOR_RK45 && resume.rk45;
+    if (resumeRK45) {
+        adaptive.particles = resume.rk45;
+        adaptive.capacity = capacity;
+        adaptive.time = resume.state.rk45Time;
+        adaptive.tolerance = settings.tolerance;
+    } else if (settings.integrator == INTEGRATOR_RK45 && !rk45Init(&adaptive, capacity, settings.tolerance)) {
+        printf("Failed to allocate the RK45 integrator\n");
+        if (store.block) {
+            particleStoreDestroy(&store);
+        }
+        checkpointClose(&resume);
+        threadPoolDestroy(pool);
+        return 1;
+    }
+
+    TangentStore tangent = {0};
+    LyapunovStats stats = {0};
+    if (settings.lyapunov && (!tangentStoreInit(&tangent, settings.count) || !lyapunovStatsInit(&stats, threadPoolThreadCount(pool)))) {
+        printf("Failed to allocate the tangent vectors\n");
+        if (tangent.block) {
+            tangentStoreDestroy(&tangent);
+        }
+        if (store.block) {
+            particleStoreDestroy(&store);
+        }
+        checkpointClose(&resume);
+        threadPoolDestroy(pool);
+        return 1;
+    }
+
+    if (!settings.resume) {
+        SeedSettings seeding = {settings.seedShape, settings.seed, 0};
+        seedParticlesParallel(pool, &store, 0, settings.count, attractor, &seeding);
+        // Odd particles shadow their even neighbour so the pairs can be watched separating
+        for (i = 1; settings.lyapunov && i < settings.count; i += 2) {
+            Vec3 point = particleStoreGet(&store, i - 1);
+            point.x += settings.pairOffset;
+            particleStoreSet(&store, i, point);
+        }
+    }
+
+    printf("%s, %d particles, %d threads, %s, duration %g\n", attractor->name, settings.count,
+        threadPoolThreadCount(pool), settings.integrator == INTEGRATOR_RK4 ? "rk4" : "rk45", settings.duration);
+    printf("parameters:");
+    for (i = 0; i < attractor->paramCount; i++) {
+        printf(" %s=%g", attractor->paramNames[i], params.values[i]);
+    }
+    printf("\n");
+
+    // Offline recordings would rather wait for the disk than lose frames
+    Recorder* recorder = NULL;
+    if (settings.record) {
+        RecorderSettings recording = {
+            settings.record, settings.count, settings.system, params, 1.0 / TICKRATE,
+            settings.recordCompression ? TRAJECTORY_XOR_RLE : TRAJECTORY_RAW, 1,
+        };
+        recorder = recorderCreate(&recording);
+        if (!recorder) {
+            printf("Can't record to %s\n", settings.record);
+            return 1;
+        }
+        recorderAppend(recorder, 0, &store, settings.count, settings.system);
+    }
+
+    // -- Integration --
+    double simulated = settings.duration * attractor->timeScale;
+    long long evaluations = 0;
+    long long particleSteps = 0;
+    double start = platformTime();
+    if (settings.integrator == INTEGRATOR_RK4) {
+        double delta = simulated / settings.steps;
+        long long done = 0;
+        while (done < settings.steps) {
+            long long batch = settings.steps - done;
+            if (batch > HEADLESS_BATCH_STEPS) {
+                batch = HEADLESS_BATCH_STEPS;
+            }
+            if (recorder && batch > settings.recordEvery - done % settings.recordEvery) {
+                batch = settings.recordEvery - done % settings.recordEvery;
+            }
+            if (occupancy.shards && done < settings.occupancyWarmup && batch > settings.occupancyWarmup - done) {
+                batch = settings.occupancyWarmup - done;
+            }
+            // A pass may hand a shard at most OCCUPANCY_SHARD_LIMIT samples
+            if (occupancy.shards && batch > OCCUPANCY_SHARD_LIMIT / settings.count) {
+                batch = OCCUPANCY_SHARD_LIMIT / settings.count > 0 ? OCCUPANCY_SHARD_LIMIT / settings.count : 1;
+            }
+            OccupancyGrid* counting = occupancy.shards && done >= settings.occupancyWarmup ? &occupancy : NULL;
+            if (settings.lyapunov) {
+                // Statistics only need to be gathered on the final pass
+                LyapunovStats* gather = done + batch == settings.steps ? &stats : NULL;
+                integrateRK4TangentParallel(pool, attractor, &store, &tangent, 0, settings.count, &params, delta, (int)batch, gather, counting);
+            } else {
+                integrateRK4Parallel(pool, attractor, &store, 0, settings.count, &params, delta, (int)batch, counting);
+            }
+            if (counting) {
+                occupancyTick(counting, pool);
+            }
+            done += batch;
+            if (recorder && done % settings.recordEvery == 0) {
+                recorderAppend(recorder, done / settings.recordEvery, &store, settings.count, settings.system);
+            }
+        }
+        particleSteps = settings.steps * settings.count;
+        evaluations = 4 * particleSteps * (settings.lyapunov ? 2 : 1); // Tangent stages cost about as much again
+    } else {
+        if (!resumeRK45) {
+            rk45Reset(&adaptive, &store, 0, settings.count);
+        }
+        long long interval;
+        for (interval = 0; interval < settings.steps; interval++) {
+            OccupancyGrid* counting = occupancy.shards && interval >= settings.occupancyWarmup ? &occupancy : NULL;
+            evaluations += integrateRK45Parallel(pool, attractor, &adaptive, &store, 0, settings.count, &params, simulated / settings.steps, counting);
+            if (counting) {
+                occupancyTick(counting, pool);
+            }
+            if (recorder && (interval + 1) % settings.recordEvery == 0) {
+                recorderAppend(recorder, (interval + 1) / settings.recordEvery, &store, settings.count, settings.system);
+            }
+        }
+        // Every attempted step costs six evaluations thanks to first-same-as-last
+        particleSteps = evaluations / 6;
+    }
+    int status = 0;
+    if (recorder && !recorderClose(recorder)) {
+        printf("Failed to write %s\n", settings.record);
+        status = 1;
+    }
+    double elapsed = platformTime() - start;
+
+    // -- Report --
+    printf("elapsed %.3f s\n", elapsed);
+    printf("%.4g particle-steps/s%s\n", particleSteps / elapsed, settings.integrator == INTEGRATOR_RK45 ? " (attempted steps)" : "");
+    printf("%.4g derivative evaluations/s\n", evaluations / elapsed);
+    if (settings.lyapunov) {
+        LyapunovReport report;
+        lyapunovMerge(&stats, tangent.time, &report);
+        lyapunovPrintReport(&report, attractor->name, 1);
+    }
+    if (occupancy.shards) {
+        occupancyMerge(&occupancy, pool);
+        occupancyPrintReport(&occupancy, attractor->name);
+        if (settings.occupancy && !occupancyExportRaw(&occupancy, settings.occupancy)) {
+            printf("Failed to write %s\n", settings.occupancy);
+            status = 1;
+        }
+        if (settings.marginals && !writeMarginals(settings.marginals, &occupancy)) {
+            printf("Failed to write the marginals %s-*.pgm\n", settings.marginals);
+            status = 1;
+        }
+    }
+
+    if (settings.output && !writePositions(settings.output, &store, settings.count)) {
+        printf("Failed to write %s\n", settings.output);
+        status = 1;
+    }
+    if (settings.checkpoint) {
+        CheckpointState state = {0};
+        state.system = settings.system;
+        state.integrator = settings.integrator;
+        state.capacity = capacity;
+        state.pointCount = settings.count;
+        state.params = params;
+        state.delta = settings.duration / settings.steps;
+        state.steps = 1;
+        state.tolerance = settings.tolerance;
+        state.rk45Time = adaptive.time;
+        state.tick = (settings.resume ? resume.state.tick : 0) + settings.steps;
+        state.seed = settings.resume ? resume.state.seed : settings.seed;
+        state.seedShape = settings.resume ? resume.state.seedShape : (int)settings.seedShape;
+        state.seedStream = settings.resume ? resume.state.seedStream : 1;
+        const RK45Particle* rk45 = settings.integrator == INTEGRATOR_RK45 ? adaptive.particles : NULL;
+        if (!checkpointWrite(settings.checkpoint, &state, &store, NULL, rk45)) {
+            printf("Failed to write %s\n", settings.checkpoint);
+            status = 1;
+        }
+    }
+
+    if (settings.integrator == INTEGRATOR_RK45 && !resumeRK45) {
+        rk45Destroy(&adaptive);
+    }
+    if (settings.lyapunov) {
+        lyapunovStatsDestroy(&stats);
+        tangentStoreDestroy(&tangent);
+    }
+    if (occupancy.shards) {
+        occupancyDestroy(&occupancy);
+    }
+    if (store.block) {
+        particleStoreDestroy(&store);
+    }
+    checkpointClose(&resume);
+    threadPoolDestroy(pool);
+    return status;
+}
@@ -2,45 +2,28 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "../constants.h"
 #include "../engine3d/engine3d.h"
+#include "../engine3d/density.h"
+#include "../engine3d/framewriter.h"
+#include "../engine3d/mat4f.h"
+#include "../engine3d/raster.h"
+#include "../engine3d/trailview.h"
+#include "../engine3d/vertexcache.h"
 #include "../simplegui/simplegui.h"
+#include "../simulation/attractors.h"
+#include "../simulation/simulation.h"
+#include "../simulation/platform.h"
+#include "../simulation/replay.h"
+
+#define CLIP_GUARD_BAND 4.0 // Lines are clipped to the sides this many half screens from the center, the rasterizer does the rest
 
 // Enums for user control
 enum CAM_MODE { WALK, ORBIT };
 
-// ------------------------------------------------------
-// Structs
-// ------------------------------------------------------
-
-// Queue setup
-typedef struct VectorQueue {
-    Vec3 queue[MAXTRAIL];
-    int count;
-} VecQueue;
-
-void queueRemove(VecQueue* q) {
-    int i;
-    for (i = 0; i < q->count - 1; i++) {
-        q->queue[i] = q->queue[i + 1];
-    }
-    q->count--;
-    return;
-}
-
-void queueAdd(VecQueue* q, const Vec3 element) { //fly
-    if (q->count < MAXTRAIL) {
-        q->queue[q->count] = element;
-    } else {
-        queueRemove(q);
-        q->queue[MAXTRAIL - 1] = element;
-    }
-    q->count++;
-    return;
-}
-
 // ------------------------------------------------------
 // Helper functions
 // ------------------------------------------------------
@@ -61,175 +44,373 @@ double clamp(double x, double a, double b) {
     return min(b, max(a, x));
 }
 
-// Point is used for x, y, and z values
-// Params is used for o, p, and B values
-void eulerLorenzAttractor(Vec3* point, const Vec3 params, double delta) {
-    double dxdt = params.x * (point->y - point->x);
-    dxdt *= delta;
-
-    double dydt = point->x * (params.y - point->z) - point->y;
-    dydt *= delta;
-
-    double dzdt = (point->x * point->y) - (params.z * point->z);
-    dzdt *= delta;
-
-    point->x += dxdt;
-    point->y += dydt;
-    point->z += dzdt;
+void drawLine3D(SDL_Renderer* renderer, int width, int height, const Vec3 p1, const Vec3 p2, const Mat4f* clipMatrix) {
+    Vec3 p1Projected, p2Projected;
+    if (projectLine3D(width, height, p1, p2, clipMatrix, CLIP_GUARD_BAND, &p1Projected, &p2Projected)) {
+        SDL_RenderDrawLine(renderer, p1Projected.x, p1Projected.y, p2Projected.x, p2Projected.y);
+    }
 }
 
-void rk4LorenzAttractor(Vec3* point, Vec3* velocityOut, const Vec3 params, double delta) {
-    // Not the cleanest code, but it works
-    double dxk1 = (params.x * (point->y - point->x));               double x1 = point->x + delta * dxk1 / 2;
-    double dxk2 = (params.x * (point->y - x1));                     double x2 = point->x + delta * dxk2 / 2;
-    double dxk3 = (params.x * (point->y - x2));                     double x3 = point->x + delta * dxk3;
-    double dxk4 = (params.x * (point->y - x3));
-
-    double dxdt = (1.0 / 6.0) * (dxk1 + 2 * dxk2 + 2 * dxk3 + dxk4) * delta;
-
-    double dyk1 = (point->x * (params.y - point->z) - point->y);    double y1 = point->y + delta * dyk1 / 2;
-    double dyk2 = (point->x * (params.y - point->z) - y1);          double y2 = point->y + delta * dyk2 / 2;
-    double dyk3 = (point->x * (params.y - point->z) - y2);          double y3 = point->y + delta * dyk3;
-    double dyk4 = (point->x * (params.y - point->z) - y3);
+void drawPoint3D(SDL_Renderer* renderer, int width, int height, const Vec3 point, const Mat4f* clipMatrix, int radius) {
+    Vec3 pointProjected;
+    if (projectPoint3D(width, height, point, clipMatrix, &pointProjected)) {
+        SDL_RenderFillRect(renderer, 
+        &(SDL_Rect)
+        {
+            pointProjected.x - radius, pointProjected.y - radius,
+            radius * 2, radius * 2
+        });
+    }
+}
 
-    double dydt = (1.0 / 6.0) * (dyk1 + 2 * dyk2 + 2 * dyk3 + dyk4) * delta;
+// ------------------------------------------------------
+// Draw batching
+// ------------------------------------------------------
 
-    double dzk1 = (point->x * point->y) - (params.z * point->z);    double z1 = point->z + delta * dzk1 / 2;
-    double dzk2 = (point->x * point->y) - (params.z * z1);          double z2 = point->z + delta * dzk2 / 2;
-    double dzk3 = (point->x * point->y) - (params.z * z2);          double z3 = point->z + delta * dzk3;
-    double dzk4 = (point->x * point->y) - (params.z * z3);
+// Every trail segment and tip of a frame becomes a colored quad in one vertex buffer, handed to
+// SDL in a single SDL_RenderGeometry call instead of a color and draw call per primitive.
+// With a rasterizer the primitives go to it instead and the finished frame is uploaded once.
+typedef struct DrawBatch {
+    SDL_Vertex* vertices;
+    int* indices;     // Always holds the index pattern for every quad that fits
+    int quadCount;
+    int quadCapacity;
+    Rasterizer* raster;   // NULL draws through SDL
+    SDL_Texture* texture; // Streaming texture the rasterizer's frame is uploaded to
+} DrawBatch;
+
+// Call before queueing a frame's primitives, resizes the rasterizer's frame to the window
+void drawBatchBegin(SDL_Renderer* renderer, DrawBatch* batch, int width, int height) {
+    batch->quadCount = 0;
+    if (!batch->raster) {
+        return;
+    }
+    if (!batch->texture || batch->raster->width != width || batch->raster->height != height) {
+        if (batch->texture) {
+            SDL_DestroyTexture(batch->texture);
+        }
+        batch->texture = NULL;
+        if (rasterizerResize(batch->raster, width, height)) {
+            batch->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+        }
+        if (batch->texture) {
+            SDL_SetTextureBlendMode(batch->texture, SDL_BLENDMODE_NONE); // The frame already has the black background
+        }
+    }
+    rasterizerBegin(batch->raster);
+}
 
-    double dzdt = (1.0 / 6.0) * (dzk1 + 2 * dzk2 + 2 * dzk3 + dzk4) * delta;
+// Returns 0 if the buffers couldn't grow, the primitive is then dropped
+int drawBatchReserve(DrawBatch* batch, int quads) {
+    if (batch->quadCount + quads <= batch->quadCapacity) {
+        return 1;
+    }
+    int capacity = max(1024, max(batch->quadCapacity * 2, batch->quadCount + quads));
+    SDL_Vertex* vertices = realloc(batch->vertices, (size_t) capacity * 4 * sizeof(SDL_Vertex));
+    if (!vertices) {
+        return 0;
+    }
+    batch->vertices = vertices;
+    int* indices = realloc(batch->indices, (size_t) capacity * 6 * sizeof(int));
+    if (!indices) {
+        return 0;
+    }
+    batch->indices = indices;
+    int q;
+    for (q = batch->quadCapacity; q < capacity; q++) {
+        int* quad = indices + q * 6;
+        quad[0] = q * 4; quad[1] = q * 4 + 1; quad[2] = q * 4 + 2;
+        quad[3] = q * 4 + 2; quad[4] = q * 4 + 1; quad[5] = q * 4 + 3;
+    }
+    batch->quadCapacity = capacity;
+    return 1;
+}
 
-    point->x += dxdt;
-    point->y += dydt;
-    point->z += dzdt;
+// Corners in the order a, b, c, d where a-b and c-d are opposite edges
+void drawBatchQuad(DrawBatch* batch, float ax, float ay, float bx, float by, float cx, float cy, float dx, float dy, SDL_Color color) {
+    if (!drawBatchReserve(batch, 1)) {
+        return;
+    }
+    SDL_Vertex* v = batch->vertices + batch->quadCount * 4;
+    v[0] = (SDL_Vertex){{ax, ay}, color, {0, 0}};
+    v[1] = (SDL_Vertex){{bx, by}, color, {0, 0}};
+    v[2] = (SDL_Vertex){{cx, cy}, color, {0, 0}};
+    v[3] = (SDL_Vertex){{dx, dy}, color, {0, 0}};
+    batch->quadCount++;
+}
 
-    // For visualization purposes
-    velocityOut->x += dxdt;
-    velocityOut->y += dydt;
-    velocityOut->z += dzdt;
+void drawBatchRect(DrawBatch* batch, float x, float y, float w, float h, SDL_Color color) {
+    if (batch->raster) {
+        rasterizerRect(batch->raster, x, y, w, h, color.r, color.g, color.b, color.a);
+        return;
+    }
+    drawBatchQuad(batch, x, y, x, y + h, x + w, y, x + w, y + h, color);
 }
 
-void drawLine3D(SDL_Renderer* renderer, int width, int height, const Vec3 p1, const Vec3 p2, const Mat4 transformationMatrix, const Mat4 projectionMatrix, const Plane clippingPlanes[6]) {
-    // Transform to desired space
-    Vec3 p1Transformed, p2Transformed;
-    Mat4MultiplyVec3(&p1Transformed, transformationMatrix, p1);
-    Mat4MultiplyVec3(&p2Transformed, transformationMatrix, p2);
+// A one pixel wide line between two screen points
+void drawBatchLine(DrawBatch* batch, const Vec3 a, const Vec3 b, SDL_Color color) {
+    if (batch->raster) {
+        rasterizerLine(batch->raster, a.x, a.y, b.x, b.y, color.r, color.g, color.b, color.a);
+        return;
+    }
+    float dx = b.x - a.x, dy = b.y - a.y;
+    float length = sqrtf(dx * dx + dy * dy);
+    if (length < 1e-6f) {
+        drawBatchRect(batch, a.x - 0.5f, a.y - 0.5f, 1, 1, color); // A degenerate line still covers its pixel
+        return;
+    }
+    float nx = -dy / length * 0.5f, ny = dx / length * 0.5f;
+    drawBatchQuad(batch, a.x + nx, a.y + ny, a.x - nx, a.y - ny, b.x + nx, b.y + ny, b.x - nx, b.y - ny, color);
+}
 
-    int runningSum = 0; // Adds one for every check to make sure the line shouldnt be culled
+// TrailSink callbacks, target is the DrawBatch
+void drawBatchTrailLine(void* target, const Vec3 a, const Vec3 b, TrailColor color) {
+    drawBatchLine(target, a, b, (SDL_Color){color.r, color.g, color.b, color.a});
+}
 
-    // View clipping plane corrections
-    runningSum += clipWithinPlane(clippingPlanes[0], &p1Transformed, &p2Transformed); // near
-    runningSum += clipWithinPlane(clippingPlanes[1], &p1Transformed, &p2Transformed); // far
+void drawBatchTrailRect(void* target, float x, float y, float w, float h, TrailColor color) {
+    drawBatchRect(target, x, y, w, h, (SDL_Color){color.r, color.g, color.b, color.a});
+}
 
-    // Project to screen
-    Vec3 p1Projected, p2Projected;
-    projectVec3ToScreen(&p1Projected, projectionMatrix, p1Transformed, width, height);
-    projectVec3ToScreen(&p2Projected, projectionMatrix, p2Transformed, width, height);
-
-    /*
-    These clipping plane algorithms are by far the slowest part of the entire rendering. 
-    Without them, upwards of 100,000 lines could be drawn easily.
-    With them, it struggles at 10,000 lines.
-
-    Simple solution is don't use a software renderer, more complex solution is implement
-    a more sophisticated clipping algorithm instead of hacking together the 3d one to work
-    within screen coordinates. I, however, will do neither of those things.
-    */
-    // View clipping plane corrections
-    if (p1Projected.x < 0 || p1Projected.x > width || p1Projected.y < 0 || p1Projected.y > height ||
-        p2Projected.x < 0 || p2Projected.x > width || p2Projected.y < 0 || p2Projected.y > height) {
-            runningSum += clipWithinPlane(clippingPlanes[2], &p1Projected, &p2Projected); // left
-            runningSum += clipWithinPlane(clippingPlanes[3], &p1Projected, &p2Projected); // top
-            runningSum += clipWithinPlane(clippingPlanes[4], &p1Projected, &p2Projected); // right
-            runningSum += clipWithinPlane(clippingPlanes[5], &p1Projected, &p2Projected); // bottom
-            runningSum += 0;
-        } else {
-            runningSum += 4;
+void drawBatchFlush(SDL_Renderer* renderer, DrawBatch* batch) {
+    if (batch->raster) {
+        rasterizerFinish(batch->raster);
+        if (batch->texture) {
+            SDL_UpdateTexture(batch->texture, NULL, batch->raster->pixels, batch->raster->width * sizeof(uint32_t));
+            SDL_RenderCopy(renderer, batch->texture, NULL, NULL);
         }
-
-    // Final draw
-    if (runningSum == 6) {
-        SDL_RenderDrawLine(renderer, p1Projected.x, p1Projected.y, p2Projected.x, p2Projected.y);
+        return;
+    }
+    if (batch->quadCount) {
+        SDL_RenderGeometry(renderer, NULL, batch->vertices, batch->quadCount * 4, batch->indices, batch->quadCount * 6);
     }
+    batch->quadCount = 0;
 }
 
-void drawPoint3D(SDL_Renderer* renderer, int width, int height, const Vec3 point, const Mat4 transformationMatrix, const Mat4 projectionMatrix, const Plane clippingPlanes[6], int radius) {
-    // Transform to desired space
-    Vec3 pointTransformed;
-    Mat4MultiplyVec3(&pointTransformed, transformationMatrix, point);
-
-    int runningSum = 0; // Adds one for every check to make sure the line shouldnt be culled
-
-    // View clipping plane corrections
-    runningSum += isWithinPlane(clippingPlanes[0], pointTransformed); // near
-    runningSum += isWithinPlane(clippingPlanes[1], pointTransformed); // far
-
-    // Project to screen
-    Vec3 pointProjected;
-    projectVec3ToScreen(&pointProjected, projectionMatrix, pointTransformed, width, height);
-
-    // View clipping plane corrections
-    if (pointProjected.x < 0 || pointProjected.x > width || pointProjected.y < 0 || pointProjected.y > height) {
-        runningSum += isWithinPlane(clippingPlanes[2], pointProjected); // left
-        runningSum += isWithinPlane(clippingPlanes[3], pointProjected); // top
-        runningSum += isWithinPlane(clippingPlanes[4], pointProjected); // right
-        runningSum += isWithinPlane(clippingPlanes[5], pointProjected); // bottom
-    } else {
-        runningSum += 4;
+void drawBatchDestroy(DrawBatch* batch) {
+    free(batch->vertices);
+    free(batch->indices);
+    if (batch->texture) {
+        SDL_DestroyTexture(batch->texture);
     }
+    rasterizerDestroy(batch->raster);
+}
 
-    // Final draw
-    if (runningSum == 6) {
-        SDL_RenderFillRect(renderer, 
-        &(SDL_Rect)
-        {
-            pointProjected.x - radius, pointProjected.y - radius,
-            radius * 2, radius * 2
-        });
+// Splats the particles (with the tips shown) and every trail sample (with trails shown) into the
+// density map and draws it over the whole window
+void drawDensity(SDL_Renderer* renderer, DensityMap* density, SDL_Texture** texture, int width, int height, const SimSnapshot* snapshot,
+    const Mat4f* objectToClipMatrix, const Mat4f* trailToClipMatrix, float tickAlpha, int tips, int trails) {
+    if (!*texture || density->width != width || density->height != height) {
+        if (*texture) {
+            SDL_DestroyTexture(*texture);
+        }
+        *texture = NULL;
+        if (densityMapResize(density, width, height)) {
+            *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+        }
+        if (!*texture) {
+            return;
+        }
+        SDL_SetTextureBlendMode(*texture, SDL_BLENDMODE_NONE);
+    }
+    if (tips) {
+        densityMapSplatParticles(density, objectToClipMatrix, &snapshot->previous, &snapshot->current, tickAlpha, snapshot->pointCount);
+    }
+    if (trails) {
+        densityMapSplatTrails(density, trailToClipMatrix, &snapshot->trails, snapshot->pointCount);
     }
+    densityMapResolve(density);
+    SDL_UpdateTexture(*texture, NULL, density->pixels, density->width * sizeof(uint32_t));
+    SDL_RenderCopy(renderer, *texture, NULL, NULL);
 }
 
 // Debug, draws origin and X Y and Z axis as red green and blue lines
-void drawOriginAxis(SDL_Renderer* renderer, int width, int height, const Mat4 transformationMatrix, const Mat4 projectionMatrix, const Plane clippingPlanes[6], double unitLength) {
+void drawOriginAxis(SDL_Renderer* renderer, int width, int height, const Mat4f* clipMatrix, double unitLength) {
     // Mini plane grid
     int i;
     for (i = -3; i < 4; i++) {
         Vec3 p1 = {i * unitLength, 0, 3 * unitLength};
         Vec3 p2 = {i * unitLength, 0, -3 * unitLength};
         SDL_SetRenderDrawColor(renderer, 150, 150, 150, 35);
-        drawLine3D(renderer, width, height, p1, p2, transformationMatrix, projectionMatrix, clippingPlanes);
+        drawLine3D(renderer, width, height, p1, p2, clipMatrix);
     }
     for (i = -3; i < 4; i++) {
         Vec3 p1 = {3 * unitLength, 0, i * unitLength};
         Vec3 p2 = {-3 * unitLength, 0, i * unitLength};
         SDL_SetRenderDrawColor(renderer, 150, 150, 150, 35);
-        drawLine3D(renderer, width, height, p1, p2, transformationMatrix, projectionMatrix, clippingPlanes);
+        drawLine3D(renderer, width, height, p1, p2, clipMatrix);
     }
 
     // Draw x axis
     SDL_SetRenderDrawColor(renderer, 255, 0, 0, 35);
-    drawLine3D(renderer, width, height, (Vec3){0, 0, 0}, (Vec3){unitLength, 0, 0}, transformationMatrix, projectionMatrix, clippingPlanes);
+    drawLine3D(renderer, width, height, (Vec3){0, 0, 0}, (Vec3){unitLength, 0, 0}, clipMatrix);
 
     // Draw y axis
     SDL_SetRenderDrawColor(renderer, 0, 255, 0, 35);
-    drawLine3D(renderer, width, height, (Vec3){0, 0, 0}, (Vec3){0, unitLength, 0}, transformationMatrix, projectionMatrix, clippingPlanes);
+    drawLine3D(renderer, width, height, (Vec3){0, 0, 0}, (Vec3){0, unitLength, 0}, clipMatrix);
 
     // Draw z axis
     SDL_SetRenderDrawColor(renderer, 0, 0, 255, 35);
-    drawLine3D(renderer, width, height, (Vec3){0, 0, 0}, (Vec3){0, 0, unitLength}, transformationMatrix, projectionMatrix, clippingPlanes);
+    drawLine3D(renderer, width, height, (Vec3){0, 0, 0}, (Vec3){0, 0, unitLength}, clipMatrix);
 
     // Draw origin
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, 50);
-    drawPoint3D(renderer, width, height, (Vec3){0, 0, 0}, transformationMatrix, projectionMatrix, clippingPlanes, 1);
+    drawPoint3D(renderer, width, height, (Vec3){0, 0, 0}, clipMatrix, 1);
 }
 
+static CheckpointCamera makeCheckpointCamera(Vec3 position, Vec3 rotation, int mode) {
+    return (CheckpointCamera){
+        {position.x, position.y, position.z},
+        {rotation.x, rotation.y, rotation.z},
+        mode,
+    };
+}
 
 // Main
 int main( int argc, char* argv[] ) {
+    // -- Command line --
+    SimulationSettings settings = {
+        MAXPOINTS,
+        MAXTRAIL,
+        0,
+        500,
+        THREADS,
+        INTEGRATOR_RK4,
+        TOLERANCE,
+        ATTRACTOR_LORENZ,
+        DELTA * 10.0 / TICKRATE,
+        STEPS,
+        TICKRATE,
+        0,
+        0,
+        SEED_CUBE,
+        1,
+        NULL,
+        0,
+        0,
+        0,
+        OCCUPANCYWARMUP,
+        NULL,
+    };
+    const char* checkpointPath = NULL;
+    const char* replayPath = NULL;
+    int useRasterizer = 0;
+    int rasterThreads = 0;
+    int useDensity = 0;
+    float densityGamma = 2.2f;
+    int width = WIDTH;
+    int height = HEIGHT;
+    // Offscreen rendering, frames go to files or stdout instead of a window
+    const char* offscreenPath = NULL;
+    int offscreenFrames = 600;
+    double offscreenFps = TARGETFPS;
+    int offscreenGui = 0;
+    int frameThreads = 0;
+    int arg;
+    for (arg = 1; arg < argc; arg++) {
+        if (!strcmp(argv[arg], "--threads") && arg + 1 < argc) {
+            settings.threads = atoi(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--integrator") && arg + 1 < argc) {
+            arg++;
+            if (!strcmp(argv[arg], "rk4")) {
+                settings.integrator = INTEGRATOR_RK4;
+            } else if (!strcmp(argv[arg], "rk45")) {
+                settings.integrator = INTEGRATOR_RK45;
+            } else {
+                printf("Unknown integrator: %s\n", argv[arg]);
+                return 1;
+            }
+        } else if (!strcmp(argv[arg], "--tolerance") && arg + 1 < argc) {
+            settings.tolerance = atof(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--precision-report")) {
+            settings.precisionReport = 1;
+        } else if (!strcmp(argv[arg], "--lyapunov-report")) {
+            settings.lyapunovReport = 1;
+        } else if (!strcmp(argv[arg], "--seed") && arg + 1 < argc) {
+            settings.seed = (unsigned int)strtoul(argv[++arg], NULL, 10);
+        } else if (!strcmp(argv[arg], "--seed-shape") && arg + 1 < argc) {
+            int shape = seedShapeFromName(argv[++arg]);
+            if (shape < 0) {
+                printf("Unknown seed shape: %s\n", argv[arg]);
+                return 1;
+            }
+            settings.seedShape = shape;
+        } else if (!strcmp(argv[arg], "--system") && arg + 1 < argc) {
+            settings.system = attractorFromName(argv[++arg]);
+            if (settings.system < 0) {
+                printf("Unknown system: %s\n", argv[arg]);
+                return 1;
+            }
+        } else if (!strcmp(argv[arg], "--checkpoint") && arg + 1 < argc) {
+            checkpointPath = argv[++arg];
+        } else if (!strcmp(argv[arg], "--record") && arg + 1 < argc) {
+            settings.recordPath = argv[++arg];
+        } else if (!strcmp(argv[arg], "--record-compress")) {
+            settings.recordCompression = 1;
+        } else if (!strcmp(argv[arg], "--max-points") && arg + 1 < argc) {
+            settings.maxPoints = atoi(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--max-trail") && arg + 1 < argc) {
+            settings.trailLength = atoi(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--trail-tolerance") && arg + 1 < argc) {
+            settings.trailTolerance = atof(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--huge-pages")) {
+            settings.hugePages = 1;
+        } else if (!strcmp(argv[arg], "--occupancy") && arg + 1 < argc) {
+            settings.occupancyPath = argv[++arg];
+        } else if (!strcmp(argv[arg], "--occupancy-size") && arg + 1 < argc) {
+            settings.occupancySize = atoi(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--occupancy-warmup") && arg + 1 < argc) {
+            settings.occupancyWarmup = atoi(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--rasterizer")) {
+            useRasterizer = 1;
+        } else if (!strcmp(argv[arg], "--raster-threads") && arg + 1 < argc) {
+            rasterThreads = atoi(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--density")) {
+            useDensity = 1;
+        } else if (!strcmp(argv[arg], "--density-gamma") && arg + 1 < argc) {
+            densityGamma = atof(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--replay") && arg + 1 < argc) {
+            replayPath = argv[++arg];
+        } else if (!strcmp(argv[arg], "--size") && arg + 1 < argc) {
+            if (sscanf(argv[++arg], "%dx%d", &width, &height) != 2 || width < 1 || height < 1) {
+                printf("Malformed size: %s\n", argv[arg]);
+                return 1;
+            }
+        } else if (!strcmp(argv[arg], "--offscreen") && arg + 1 < argc) {
+            offscreenPath = argv[++arg];
+        } else if (!strcmp(argv[arg], "--frames") && arg + 1 < argc) {
+            offscreenFrames = atoi(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--fps") && arg + 1 < argc) {
+            offscreenFps = atof(argv[++arg]);
+        } else if (!strcmp(argv[arg], "--offscreen-gui")) {
+            offscreenGui = 1;
+        } else if (!strcmp(argv[arg], "--frame-threads") && arg + 1 < argc) {
+            frameThreads = atoi(argv[++arg]);
+        } else {
+            printf("Usage: %s [--threads N] [--integrator rk4|rk45] [--tolerance T] [--system name] [--precision-report] [--lyapunov-report] [--seed N] [--seed-shape cube|sphere|gaussian] [--checkpoint path] [--record path] [--record-compress] [--replay path] [--max-points N] [--max-trail N] [--trail-tolerance T] [--huge-pages] [--occupancy path] [--occupancy-size N] [--occupancy-warmup N] [--rasterizer] [--raster-threads N] [--density] [--density-gamma G] [--size WxH] [--offscreen path|-] [--frames N] [--fps F] [--offscreen-gui] [--frame-threads N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (settings.maxPoints <= 0 || settings.trailLength <= 0) {
+        printf("--max-points and --max-trail must be positive\n");
+        return 1;
+    }
+    if (!(settings.tolerance > 0)) {
+        printf("--tolerance must be positive\n");
+        return 1;
+    }
+    if (settings.occupancyPath && settings.occupancySize <= 0) {
+        settings.occupancySize = OCCUPANCYSIZE;
+    }
+    if (offscreenPath && (offscreenFrames <= 0 || offscreenFps <= 0)) {
+        printf("--frames and --fps must be positive\n");
+        return 1;
+    }
+
     // -- SDL init --
-    if (SDL_Init( SDL_INIT_EVERYTHING )) {
+    // Offscreen draws with the software renderer into a surface, which needs no video driver or display
+    if (SDL_Init( offscreenPath ? SDL_INIT_TIMER : SDL_INIT_EVERYTHING )) {
         printf("Initializtaion failed: %s\n", SDL_GetError());
         return 1;
     };
@@ -240,36 +421,47 @@ int main( int argc, char* argv[] ) {
 
     // Dynamic window settings
     char windowTitle[37] = "Lorenz System Viewer   |   FPS:    ";
-    int width = WIDTH;
-    int height = HEIGHT;
-    int skipFrames = 0;
 
     // Window
-    SDL_Window* window = SDL_CreateWindow(
-        windowTitle, 
-        SDL_WINDOWPOS_CENTERED, 
-        SDL_WINDOWPOS_CENTERED, 
-        width, 
-        height, 
-        SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_RESIZABLE
-    );
-    if (!window) {
-        printf("Window creation failed: %s\n", SDL_GetError());
-        SDL_Quit();
-        return 1;
-    }
+    SDL_Window* window = NULL;
+    SDL_Surface* offscreenSurface = NULL;
+    SDL_Renderer* renderer = NULL;
+    if (offscreenPath) {
+        offscreenSurface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+        renderer = offscreenSurface ? SDL_CreateSoftwareRenderer(offscreenSurface) : NULL;
+        if (!renderer) {
+            printf("Offscreen renderer creation failed: %s\n", SDL_GetError());
+            SDL_FreeSurface(offscreenSurface);
+            SDL_Quit();
+            return 1;
+        }
+    } else {
+        window = SDL_CreateWindow(
+            windowTitle, 
+            SDL_WINDOWPOS_CENTERED, 
+            SDL_WINDOWPOS_CENTERED, 
+            width, 
+            height, 
+            SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_RESIZABLE
+        );
+        if (!window) {
+            printf("Window creation failed: %s\n", SDL_GetError());
+            SDL_Quit();
+            return 1;
+        }
 
-    // Renderer
-    SDL_Renderer* renderer = SDL_CreateRenderer(
-        window, 
-        -1, 
-        SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC
-    );
-    if (!renderer) {
-        printf("Renderer creation failed: %s\n", SDL_GetError());
-        SDL_DestroyWindow(window);
-        SDL_Quit();
-        return 1;
+        // Renderer
+        renderer = SDL_CreateRenderer(
+            window, 
+            -1, 
+            SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC
+        );
+        if (!renderer) {
+            printf("Renderer creation failed: %s\n", SDL_GetError());
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+            return 1;
+        }
     }
     SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_ADD);
 
@@ -296,19 +488,98 @@ int main( int argc, char* argv[] ) {
     double localDelta = DELTA;
 
     // Initialize points
-    int trailLength = 25;
-    int pointCount = 500;
-    Vec3 lorenzParams = {10, 28, 8.0/3.0};
-    Vec3 points[MAXPOINTS];
-    VecQueue pointQueues[MAXPOINTS];
-
-    int i, j;
-    for (i = 0; i < MAXPOINTS; i++) {
-        points[i].x = (double)(rand() % 100) / 100 + 0.01;
-        points[i].y = (double)(rand() % 100) / 100 + 0.01;
-        points[i].z = (double)(rand() % 100) / 100 + 25.01;
+    int trailLength = (settings.trailLength + 1) / 2; // Trail slider starts in the middle
+    int system = settings.system;
+    Simulation* simulation = simulationCreate(&settings);
+    if (!simulation) {
+        printf("Simulation creation failed\n");
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
+    }
+    // Resume from the checkpoint if there is one, F5 and quitting write it back
+    Checkpoint checkpoint = {0};
+    FILE* existing = checkpointPath ? fopen(checkpointPath, "rb") : NULL;
+    if (existing) {
+        fclose(existing);
+        if (checkpointOpen(&checkpoint, checkpointPath) && simulationRestore(simulation, &checkpoint)) {
+            system = checkpoint.state.system;
+            localDelta = checkpoint.state.delta * TICKRATE / 10.0;
+        }
+    }
+    // Replays draw straight from the mapped recording and leave the simulation idle
+    Replay* replay = NULL;
+    double replayPosition = 0; // Ticks since the first recorded one
+    int replayPaused = 0;
+    const Vec3** replayTrail = NULL; // A trail's worth of frames before the current one, see below
+    if (replayPath) {
+        replay = replayOpen(replayPath, settings.trailLength + 1);
+        replayTrail = replay ? malloc((settings.trailLength + 1) * sizeof(const Vec3*)) : NULL; // + 1 so it is never empty
+        if (!replayTrail) {
+            if (replay) {
+                printf("Replay trail allocation failed\n");
+            }
+            replayClose(replay);
+            simulationDestroy(simulation);
+            SDL_DestroyRenderer(renderer);
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+            return 1;
+        }
+        system = replayHeader(replay)->system;
+        printf("Replaying ticks %llu to %llu, space pauses, home rewinds, page up and down skip 10 seconds\n",
+            replayFirstTick(replay), replayLastTick(replay));
+    }
+    // Offscreen ticks the simulation itself, as fast as frames can be drawn
+    if (!replay && !offscreenPath && !simulationStart(simulation)) {
+        printf("Simulation thread creation failed\n");
+        simulationDestroy(simulation);
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
+    }
+    int i;
 
-        pointQueues[i].count = 0;
+    // Trail opacity ramp, indexed by how far along its trail a segment is
+    unsigned char trailFade[TRAIL_FADE_STEPS + 1];
+    trailFadeInit(trailFade);
+    DrawBatch batch = {0};
+    VertexCache vertexCache = {0};
+    if (useRasterizer) {
+        batch.raster = rasterizerCreate(width, height, rasterThreads);
+        if (!batch.raster) {
+            printf("Can't create the rasterizer, drawing through SDL instead\n");
+        }
+    }
+    FrameWriter* frameWriter = NULL;
+    if (offscreenPath) {
+        FrameWriterSettings output = {offscreenPath, frameFormatFromPath(offscreenPath), width, height, frameThreads};
+        frameWriter = frameWriterCreate(&output);
+        if (!frameWriter) {
+            printf("Can't write frames to %s\n", offscreenPath);
+            simulationDestroy(simulation);
+            SDL_DestroyRenderer(renderer);
+            SDL_FreeSurface(offscreenSurface);
+            SDL_Quit();
+            return 1;
+        }
+        // A frame always lands on its own time, however long it takes to draw
+        deltaTime = 1000.0 / offscreenFps;
+        scaledDeltaTime = 100.0 / offscreenFps;
+    }
+    int offscreenFrame = 0;
+    double offscreenTime = 0; // Ticks of simulated time the next frame shows
+    unsigned long long offscreenTicks = 0;
+    double offscreenStart = platformTime();
+    DensityMap* density = NULL;
+    SDL_Texture* densityTexture = NULL;
+    if (useDensity) {
+        density = densityMapCreate(width, height, rasterThreads, densityGamma);
+        if (!density) {
+            printf("Can't create the density map, drawing particles instead\n");
+        }
     }
 
     // Camera
@@ -324,46 +595,21 @@ int main( int argc, char* argv[] ) {
     Vec3Cross(&cameraRight, cameraUp, cameraDirection);
 
     int cameraMode = ORBIT;
+    if (checkpoint.mapping) {
+        if (checkpoint.state.hasCamera) {
+            const CheckpointCamera* camera = &checkpoint.state.camera;
+            cameraPosition = (Vec3){camera->position[0], camera->position[1], camera->position[2]};
+            cameraRotation = (Vec3){camera->rotation[0], camera->rotation[1], camera->rotation[2]};
+            cameraMode = camera->mode == WALK ? WALK : ORBIT;
+        }
+        checkpointClose(&checkpoint);
+    }
 
     // Matrices
     double aspectRatio = (double) height / (double) width;
     Mat4 projectionMatrix = makeProjectionMatrix(90.0, 0.1, 100, aspectRatio);
     Mat4 worldMatrix = makeIdentityMatrix();
 
-    // View space clipping planes
-    Plane nearPlane = {
-        {0, 0, 1},
-        {0, 0, 1},
-    };
-    Plane farPlane = {
-        {0, 0, 100},
-        {0, 0, -1},
-    };
-    // Screen space clipping planes
-    Plane leftPlane = {
-        {0, 0, 0},
-        {1, 0, 0},
-    };
-    Plane topPlane = {
-        {0, 0, 0},
-        {0, 1, 0},
-    };
-    Plane rightPlane = {
-        {width, 0, 0},
-        {-1, 0, 0},
-    };
-    Plane bottomPlane = {
-        {0, height, 0},
-        {0, -1, 0},
-    };
-    Plane clippingPlanes[6] = {
-        nearPlane,
-        farPlane,
-        leftPlane,
-        topPlane,
-        rightPlane,
-        bottomPlane,
-    };
 
     // -- GUI setup -- (there has got to be some better way of doing this)
     TTF_Font* proggyClean = TTF_OpenFont("simplegui/ProggyClean.ttf", 24);
@@ -381,7 +627,7 @@ int main( int argc, char* argv[] ) {
 
     // Main panel
     SDL_Rect panelHeader = {width - 150, 0, 150, 18};
-    SDL_Rect panelBody = {width - 150, 18, 150, 200};
+    SDL_Rect panelBody = {width - 150, 18, 150, 226};
     Text panelHeaderText;
     initializeText(renderer, proggyClean, white, "Settings", &panelHeaderText);
     SDL_Rect panelHeaderTextRect = {width - 115, 2, 9 * 10, 16};
@@ -420,6 +666,16 @@ int main( int argc, char* argv[] ) {
     initializeButton(&renderTrailButtonText, &renderTrailButtonRect, buttonColor1, buttonColor2, &renderTrailButton);
     int usingRenderTrail = 1;
 
+    // System button, cycles through the registered attractors
+    Button systemButton;
+    SDL_Rect systemButtonRect = {width - 139, 216, 130, 18};
+    Text systemButtonTexts[ATTRACTOR_COUNT];
+    for (i = 0; i < ATTRACTOR_COUNT; i++) {
+        initializeText(renderer, proggyClean, white, attractors[i].name, &systemButtonTexts[i]);
+    }
+    SDL_Rect systemButtonTextRect = {width - 130, 218, strlen(attractors[system].name) * 7, 15};
+    initializeButton(&systemButtonTexts[system], &systemButtonRect, buttonColor1, buttonColor2, &systemButton);
+
     // Show origin button
     Button showOriginButton;
     SDL_Rect showOriginButtonRect = {width - 139, 112, 18, 18};
@@ -533,6 +789,32 @@ int main( int argc, char* argv[] ) {
                         // todo
                         break;
 
+                    // Save, the simulation copies its state between ticks and writes it in the background
+                    case SDLK_F5:
+                        if (checkpointPath) {
+                            SimCommand save = { .type = SIM_SAVE_CHECKPOINT };
+                            save.checkpoint.path = checkpointPath;
+                            save.checkpoint.camera = makeCheckpointCamera(cameraPosition, cameraRotation, cameraMode);
+                            simulationSend(simulation, &save);
+                        }
+                        break;
+
+                    // Replay controls
+                    case SDLK_SPACE:
+                        replayPaused = !replayPaused;
+                        break;
+                    case SDLK_HOME:
+                        replayPosition = 0;
+                        break;
+                    case SDLK_PAGEUP:
+                    case SDLK_PAGEDOWN:
+                        if (replay) {
+                            double skip = 10.0 / replayHeader(replay)->tickPeriod;
+                            double span = replayLastTick(replay) - replayFirstTick(replay);
+                            replayPosition = clamp(replayPosition + (event.key.keysym.sym == SDLK_PAGEUP ? skip : -skip), 0, span);
+                        }
+                        break;
+
                     // Arrow key looking
                     case SDLK_LEFT:
                         cameraAngularVelocity.y = 0.05;
@@ -602,14 +884,14 @@ int main( int argc, char* argv[] ) {
                         mouseDown = 1;
                         // Buttons
                         if (isMouseOverRect(resetParticlesButton.rect, mouseX, mouseY)) {
-                            int i;
-                            for (i = 0; i < MAXPOINTS; i++) {
-                                points[i].x = (double)(rand() % 100) / 100 + 0.01;
-                                points[i].y = (double)(rand() % 100) / 100 + 0.01;
-                                points[i].z = (double)(rand() % 100) / 100 + 25.01;
-
-                                pointQueues[i].count = 1;
-                            }
+                            simulationSend(simulation, &(SimCommand){ .type = SIM_RESET_PARTICLES });
+                        }
+                        if (isMouseOverRect(systemButton.rect, mouseX, mouseY)) {
+                            // Cycle to the next system, the simulation starts it fresh
+                            system = (system + 1) % ATTRACTOR_COUNT;
+                            systemButton.text = &systemButtonTexts[system];
+                            systemButtonTextRect.w = strlen(attractors[system].name) * 7;
+                            simulationSend(simulation, &(SimCommand){ .type = SIM_SET_SYSTEM, .system = system });
                         }
                         if (isMouseOverRect(resetCameraButton.rect, mouseX, mouseY)) {
                             cameraRotation.x = 0;
@@ -669,16 +951,18 @@ int main( int argc, char* argv[] ) {
                     deltaSliderValue = min(118, max(0, mouseX - (width - 139)));
                     deltaSliderBar.x = (width - 139) + deltaSliderValue;
                     localDelta = 0.01 + (deltaSliderValue / 118.0) * 0.1;
+                    simulationSend(simulation, &(SimCommand){ .type = SIM_SET_DELTA, .delta = localDelta * 10.0 / TICKRATE });
                 }
                 if (pointsSliderActive) {
                     pointsSliderValue = min(118, max(0, mouseX - (width - 139)));
                     pointsSliderBar.x = (width - 139) + pointsSliderValue;
-                    pointCount = floor(pow(pointsSliderValue / 118.0, 3) * MAXPOINTS);
+                    int pointCount = floor(pow(pointsSliderValue / 118.0, 3) * settings.maxPoints);
+                    simulationSend(simulation, &(SimCommand){ .type = SIM_SET_POINT_COUNT, .pointCount = pointCount });
                 }
                 if (trailsSliderActive) {
                     trailsSliderValue = min(118, max(0, mouseX - (width - 139)));
                     trailsSliderBar.x = (width - 139) + trailsSliderValue;
-                    trailLength = floor((trailsSliderValue / 118.0) * MAXTRAIL);
+                    trailLength = floor((trailsSliderValue / 118.0) * settings.trailLength);
                 }
 
 
@@ -688,16 +972,11 @@ int main( int argc, char* argv[] ) {
             } else if (event.type == SDL_WINDOWEVENT) {
                 switch (event.window.event) {
                     case (SDL_WINDOWEVENT_SIZE_CHANGED):
-                        skipFrames = 2;
-
-                        // Rebuilding projection matrix and clipping planes
+                        // Rebuilding projection matrix
                         width = (int) event.window.data1;
                         height = (int) event.window.data2;
                         double aspectRatio = (double) height / (double) width;
                         projectionMatrix = makeProjectionMatrix(90.0, 0.1, 100, aspectRatio);
-                        rightPlane.position.x = width;
-                        clippingPlanes[4].position.x = width;
-                        clippingPlanes[5].position.y = height;
 
                         // Updating gui placements (legitimately awful)
                         panelHeader.x = width - 150;
@@ -716,6 +995,8 @@ int main( int argc, char* argv[] ) {
                         showOriginButtonTextRect.x = width - 115;
                         showVelocityButtonRect.x = width - 55;
                         showVelocityButtonTextRect.x = width - 30;
+                        systemButtonRect.x = width - 139;
+                        systemButtonTextRect.x = width - 130;
                         deltaSliderTrack.x = width - 139;
                         deltaSliderTextRect.x = width - 139;
                         pointsSliderTrack.x = width - 139;
@@ -729,19 +1010,58 @@ int main( int argc, char* argv[] ) {
                         trailsSliderBar.x = (width - 139) + trailsSliderValue;
 
                         break;
-                    case (SDL_WINDOWEVENT_MOVED):
-                        skipFrames = 2;
                     default:
                         break;
                 }
             }
         }
 
-        // Janky calculation skipping to prevent explosions when resizing (delta time scaling)
-        if (skipFrames > 0) {
-            skipFrames--;
-            continue;
+        // Offscreen frames tick up to their own time, so the output doesn't depend on the machine
+        double offscreenAlpha = 1;
+        if (frameWriter && !replay) {
+            offscreenTime += TICKRATE / offscreenFps;
+            while (offscreenTicks < offscreenTime) {
+                simulationTick(simulation);
+                offscreenTicks++;
+            }
+            offscreenAlpha = 1 - (offscreenTicks - offscreenTime);
+        }
+
+        // Latest simulation state, frames never wait on the simulation thread
+        const SimSnapshot* snapshot = simulationAcquireSnapshot(simulation);
+        int pointCount = snapshot->pointCount;
+        int frameSystem = snapshot->system;
+
+        // Replayed frames point into the recording: the current one and up to a trail's worth
+        // before it, oldest first, the same way a TrailStore orders them
+        ReplayFrame replayCurrent;
+        int replayTrailLength = 0;
+        if (replay) {
+            double span = replayLastTick(replay) - replayFirstTick(replay);
+            if (!replayPaused) {
+                replayPosition += scaledDeltaTime / 100.0 / replayHeader(replay)->tickPeriod;
+                if (replayPosition > span) {
+                    replayPosition = 0;
+                }
+            }
+            unsigned long long tick = replayFirstTick(replay) + (unsigned long long) replayPosition;
+            pointCount = 0;
+            if (replayFrame(replay, tick, &replayCurrent)) {
+                pointCount = replayCurrent.particleCount;
+                frameSystem = replayCurrent.system;
+                ReplayFrame earlier;
+                while (replayTrailLength < trailLength && tick > (unsigned long long) replayTrailLength &&
+                    replayFrame(replay, tick - replayTrailLength - 1, &earlier) &&
+                    earlier.particleCount == pointCount && earlier.system == frameSystem) {
+                    replayTrailLength++;
+                    replayTrail[settings.trailLength - replayTrailLength] = earlier.positions;
+                }
+            }
         }
+        const Attractor* attractor = &attractors[frameSystem];
+
+        // How far between the previous and current tick this frame sits
+        double tickAlpha = frameWriter ? offscreenAlpha : clamp((platformTime() - snapshot->publishTime) / snapshot->tickPeriod, 0, 1);
 
         // Non-particle dynamics
         Mat4 cameraMatrix;
@@ -793,13 +1113,21 @@ int main( int argc, char* argv[] ) {
         // Any transformatiosn that should be applied to the particles
         Mat4 transformationMatrix, worldToViewMatrix, objectToViewMatrix;
         Mat4 rotationMatrix = makeYRotationMatrix(0);
-        Mat4 translationMatrix = makeTranslationMatrix((Vec3){0, 0, -25});
-        Mat4 scalingMatrix = makeScalingMatrix((Vec3){0.7, 0.7, 0.7});
+        Mat4 translationMatrix = makeTranslationMatrix((Vec3){-attractor->center.x, -attractor->center.y, -attractor->center.z});
+        Mat4 scalingMatrix = makeScalingMatrix((Vec3){attractor->scale, attractor->scale, attractor->scale});
         Mat4MultiplyMat4(&transformationMatrix, rotationMatrix, translationMatrix);
         Mat4MultiplyMat4(&transformationMatrix, scalingMatrix, transformationMatrix);
         
         Mat4MultiplyMat4(&worldToViewMatrix, viewMatrix, worldMatrix); // Transforms from world to view
         Mat4MultiplyMat4(&objectToViewMatrix, worldToViewMatrix, transformationMatrix); // Transforms from any particle transformations to viewspace
+        // Projection folded in, so every point takes a single transform straight to clip space
+        Mat4 worldToClip, objectToClip;
+        Mat4MultiplyMat4(&worldToClip, projectionMatrix, worldToViewMatrix);
+        Mat4MultiplyMat4(&objectToClip, projectionMatrix, objectToViewMatrix);
+        // Points take the single precision SIMD path, so the composed matrices are converted once here
+        Mat4f worldToClipMatrix, objectToClipMatrix;
+        Mat4fFromMat4(&worldToClipMatrix, &worldToClip);
+        Mat4fFromMat4(&objectToClipMatrix, &objectToClip);
 
         // Main draw cycle
         SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
@@ -807,15 +1135,66 @@ int main( int argc, char* argv[] ) {
         SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
 
         // Particle Handling
-        for (i = 0; i < pointCount; i++) {
-            // Apply the attractor
+        drawBatchBegin(renderer, &batch, width, height);
+        const TrailStore* trails = &snapshot->trails;
+        // Trail samples stay in fixed point, their frame is folded into the transform instead
+        const TrailFrame* trailFrame = trails->frame;
+        Mat4 trailToClip;
+        Mat4 trailFrameMatrix = makeScalingMatrix((Vec3){trailFrame->step, trailFrame->step, trailFrame->step});
+        Mat4MultiplyMat4(&trailFrameMatrix, makeTranslationMatrix(trailFrame->origin), trailFrameMatrix);
+        Mat4MultiplyMat4(&trailToClip, objectToClip, trailFrameMatrix);
+        Mat4f trailToClipMatrix;
+        Mat4fFromMat4(&trailToClipMatrix, &trailToClip);
+        // Decimated trails space their samples unevenly, so the slider picks how many ticks back to draw
+        int timedTrails = !replay && trails->ticks;
+        uint32_t trailWindow = (uint32_t) trailLength * TRAILREACH;
+        const Vec3** replayTrailStart = replayTrail + settings.trailLength - replayTrailLength;
+        // The density view draws the live particles itself, replays are always drawn as primitives
+        int densityView = density && !replay;
+        if (densityView) {
+            drawDensity(renderer, density, &densityTexture, width, height, snapshot, &objectToClipMatrix, &trailToClipMatrix, tickAlpha, usingRenderTip, usingRenderTrail);
+        }
+        const int drawnPoints = densityView ? 0 : pointCount;
+        TrailView trailView = {
+            trails,
+            replay ? replayTrailStart : NULL,
+            replayTrailLength,
+            &vertexCache,
+            0,
+            &objectToClipMatrix,
+            &trailToClipMatrix,
+            width,
+            height,
+            CLIP_GUARD_BAND,
+            trailFade,
+            trailLength,
+            timedTrails,
+            (uint32_t) snapshot->tick,
+            trailWindow,
+            {drawBatchTrailLine, drawBatchTrailRect, &batch},
+        };
+        // Live trails are projected through the cache, only samples it doesn't have yet are transformed
+        if (usingRenderTrail) {
+            trailViewProject(&trailView, drawnPoints);
+        }
+        for (i = 0; i < drawnPoints; i++) {
             Vec3 color;
-            Vec3 velocity = {0, 0, 0};
-            for (j = 0; j < STEPS; j++) {
-                rk4LorenzAttractor(&points[i], &velocity, lorenzParams, (localDelta / STEPS) * (scaledDeltaTime / 10));
-                // eulerLorenzAttractor(&points[i], lorenzParams, (localDelta / STEPS) * (scaledDeltaTime / 10));
+            Vec3 point, velocity = {0, 0, 0};
+            if (replay) {
+                point = replayCurrent.positions[i];
+                if (replayTrailLength) {
+                    Vec3Subtract(&velocity, point, replayTrailStart[replayTrailLength - 1][i]);
+                }
+            } else {
+                Vec3 previous = particleStoreGet(&snapshot->previous, i);
+                Vec3 current = particleStoreGet(&snapshot->current, i);
+                point = (Vec3){
+                    previous.x + (current.x - previous.x) * tickAlpha,
+                    previous.y + (current.y - previous.y) * tickAlpha,
+                    previous.z + (current.z - previous.z) * tickAlpha,
+                };
+                velocity = particleStoreGetVelocity(&snapshot->current, i);
             }
-            // printf("{ %5lf, %5lf, %5lf }\n", velocity.x, velocity.y, velocity.z);
             if (usingShowVelocity) {
                 color.x = ((velocity.x + 4) * 32);
                 color.y = ((velocity.y + 4) * 32);
@@ -828,70 +1207,60 @@ int main( int argc, char* argv[] ) {
             
 
             // Drawing the trails
-            int trueTrailLength = min(pointQueues[i].count, trailLength); // Bad naming, but is the actual length of the trail (to account for when there are less particles than trail length)
-            int offset = max(0, pointQueues[i].count - trailLength);
-            if (usingRenderTrail && trueTrailLength) {
-                for (j = 0; j < trueTrailLength - 1; j++) {
-                    Vec3 p1 = pointQueues[i].queue[offset + j];
-                    Vec3 p2 = pointQueues[i].queue[offset + j + 1];
-
-                    int opacity = powf((float)j / trueTrailLength, 5) * 255;
-                    SDL_SetRenderDrawColor(renderer, 
-                        color.x, 
-                        color.y, 
-                        color.z, 
-                        opacity
-                        );
-
-                    drawLine3D(renderer, width, height, p1, p2, objectToViewMatrix, projectionMatrix, clippingPlanes);
-                }
-                drawLine3D(renderer, width, height, pointQueues[i].queue[offset + trueTrailLength - 1], points[i], objectToViewMatrix, projectionMatrix, clippingPlanes); // Final line to connect last point in trail with current
+            TrailColor particleColor = {(Uint8)(int)color.x, (Uint8)(int)color.y, (Uint8)(int)color.z, 255};
+            if (usingRenderTrail) {
+                trailViewDrawTrail(&trailView, i, point, particleColor);
             }
             if (usingRenderTip) {
-                // Tip rendering
-                SDL_SetRenderDrawColor(renderer, 
-                    color.x, 
-                    color.y, 
-                    color.z,
-                    255
-                );
-                drawPoint3D(renderer, width, height, points[i], objectToViewMatrix, projectionMatrix, clippingPlanes, 1);
+                trailViewDrawTip(&trailView, point, particleColor);
             }
-            
-
-            // Add new position to queue
-            queueAdd(&pointQueues[i], points[i]);
         }
+        drawBatchFlush(renderer, &batch);
         
         // Origin
         if (usingShowOrigin) {
-            drawOriginAxis(renderer, width, height, worldToViewMatrix, projectionMatrix, clippingPlanes, 5);
+            drawOriginAxis(renderer, width, height, &worldToClipMatrix, 5);
         }
 
         // Static GUI
-        renderText(renderer, &watermarkTextRect, &watermarkText);
-        renderText(renderer, &panelHeaderTextRect, &panelHeaderText);
-        SDL_SetRenderDrawColor(renderer, 15, 15, 15, 150); SDL_RenderFillRect(renderer, &panelBody);
-        SDL_SetRenderDrawColor(renderer, 25, 25, 25, 150); SDL_RenderFillRect(renderer, &panelHeader);
+        if (!frameWriter || offscreenGui) {
+            renderText(renderer, &watermarkTextRect, &watermarkText);
+            renderText(renderer, &panelHeaderTextRect, &panelHeaderText);
+            SDL_SetRenderDrawColor(renderer, 15, 15, 15, 150); SDL_RenderFillRect(renderer, &panelBody);
+            SDL_SetRenderDrawColor(renderer, 25, 25, 25, 150); SDL_RenderFillRect(renderer, &panelHeader);
         
-        // Dynamic GUI
-        int buttonDown;
-        buttonDown = mouseDown * isMouseOverRect(resetParticlesButton.rect, mouseX, mouseY);
-        renderButton(renderer, &resetParticlesButtonTextRect, &resetParticlesButton, buttonDown);
-        buttonDown = mouseDown * isMouseOverRect(resetCameraButton.rect, mouseX, mouseY);
-        renderButton(renderer, &resetCameraButtonTextRect, &resetCameraButton, buttonDown);
-        renderButton(renderer, &renderTipButtonTextRect, &renderTipButton, usingRenderTip);
-        renderButton(renderer, &renderTrailButtonTextRect, &renderTrailButton, usingRenderTrail);
-        renderButton(renderer, &showOriginButtonTextRect, &showOriginButton, usingShowOrigin);
-        renderButton(renderer, &showVelocityButtonTextRect, &showVelocityButton, usingShowVelocity);
+            // Dynamic GUI
+            int buttonDown;
+            buttonDown = mouseDown * isMouseOverRect(resetParticlesButton.rect, mouseX, mouseY);
+            renderButton(renderer, &resetParticlesButtonTextRect, &resetParticlesButton, buttonDown);
+            buttonDown = mouseDown * isMouseOverRect(resetCameraButton.rect, mouseX, mouseY);
+            renderButton(renderer, &resetCameraButtonTextRect, &resetCameraButton, buttonDown);
+            renderButton(renderer, &renderTipButtonTextRect, &renderTipButton, usingRenderTip);
+            renderButton(renderer, &renderTrailButtonTextRect, &renderTrailButton, usingRenderTrail);
+            renderButton(renderer, &showOriginButtonTextRect, &showOriginButton, usingShowOrigin);
+            renderButton(renderer, &showVelocityButtonTextRect, &showVelocityButton, usingShowVelocity);
+            buttonDown = mouseDown * isMouseOverRect(systemButton.rect, mouseX, mouseY);
+            renderButton(renderer, &systemButtonTextRect, &systemButton, buttonDown);
         
-        renderText(renderer, &deltaSliderTextRect, &deltaSliderText);
-        renderSlider(renderer, &deltaSlider);
-        renderText(renderer, &pointsSliderTextRect, &pointsSliderText);
-        renderSlider(renderer, &pointsSlider);
-        renderText(renderer, &trailsSliderTextRect, &trailsSliderText);
-        renderSlider(renderer, &trailsSlider);
+            renderText(renderer, &deltaSliderTextRect, &deltaSliderText);
+            renderSlider(renderer, &deltaSlider);
+            renderText(renderer, &pointsSliderTextRect, &pointsSliderText);
+            renderSlider(renderer, &pointsSlider);
+            renderText(renderer, &trailsSliderTextRect, &trailsSliderText);
+            renderSlider(renderer, &trailsSlider);
+        }
 
+        if (frameWriter) {
+            // The encoders convert and write in the background, this only waits if they all fall behind
+            if (SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_RGB24, frameWriterAcquire(frameWriter), width * 3)) {
+                printf("Reading frame %d failed: %s\n", offscreenFrame, SDL_GetError());
+            }
+            frameWriterSubmit(frameWriter);
+            if (++offscreenFrame == offscreenFrames) {
+                active = 0;
+            }
+            continue;
+        }
         SDL_RenderPresent(renderer);
 
         // Delta time correction
@@ -932,7 +1301,38 @@ int main( int argc, char* argv[] ) {
     destroyText(&deltaSliderText);
     destroyText(&pointsSliderText);
     destroyText(&trailsSliderText);
-    SDL_DestroyWindow(window);
+    for (i = 0; i < ATTRACTOR_COUNT; i++) {
+        destroyText(&systemButtonTexts[i]);
+    }
+    if (frameWriter) {
+        int written = frameWriterClose(frameWriter);
+        double elapsed = platformTime() - offscreenStart;
+        printf("Rendered %d frames of %dx%d in %.2f s (%.1f frames/s)\n", offscreenFrame, width, height, elapsed, offscreenFrame / elapsed);
+        if (!written) {
+            printf("Failed to write some frames to %s\n", offscreenPath);
+        }
+    }
+    drawBatchDestroy(&batch);
+    vertexCacheDestroy(&vertexCache);
+    if (densityTexture) {
+        SDL_DestroyTexture(densityTexture);
+    }
+    densityMapDestroy(density);
+    simulationStop(simulation);
+    replayClose(replay);
+    free(replayTrail);
+    if (checkpointPath && !replay) {
+        CheckpointCamera camera = makeCheckpointCamera(cameraPosition, cameraRotation, cameraMode);
+        if (!simulationSaveCheckpoint(simulation, checkpointPath, &camera)) {
+            printf("Can't write checkpoint %s\n", checkpointPath);
+        }
+    }
+    simulationDestroy(simulation);
+    if (window) {
+        SDL_DestroyWindow(window);
+    }
+    SDL_DestroyRenderer(renderer);
+    SDL_FreeSurface(offscreenSurface);
     SDL_Quit();
 
     return 0;
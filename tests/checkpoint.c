@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../simulation/attractors.h"
+#include "../simulation/checkpoint.h"
+#include "../simulation/particles.h"
+#include "../simulation/seeding.h"
+#include "../simulation/simulation.h"
+#include "../simulation/trails.h"
+
+// Round trip of a checkpoint saved by the viewer through the headless runner. The viewer stores
+// more particles than it simulates, so resuming one, saving it again and resuming that has to
+// end up exactly where a single run over the same steps does. Run as: checkpoint path/to/headless
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+#define TEST_CAPACITY 1000
+#define TEST_POINTS 300 // Not a whole number of lanes, so the kernels' scalar remainder is split too
+
+static int failures = 0;
+
+static void check(int condition, const char* what) {
+    if (!condition) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// Lays the file out like the viewer's F5 save: every slot seeded, only some simulated, with trails
+static int writeViewerCheckpoint(const char* path) {
+    const Attractor* attractor = &attractors[ATTRACTOR_LORENZ];
+    ParticleStore store = {0};
+    TrailStore trails = {0};
+    if (!particleStoreInit(&store, TEST_CAPACITY) || !trailStoreInit(&trails, TEST_CAPACITY, 8, 0, 0)) {
+        return 0;
+    }
+    SeedSettings seeding = {SEED_CUBE, 7, 0};
+    seedParticleRange(&store, 0, TEST_CAPACITY, attractor, &seeding);
+    trailStoreSetFrame(&trails, attractor->center, 48.0 / attractor->scale);
+    int i;
+    for (i = 0; i < TEST_CAPACITY; i++) {
+        trailStorePush(&trails, i, particleStoreGet(&store, i), 0);
+    }
+    CheckpointState state = {0};
+    state.system = ATTRACTOR_LORENZ;
+    state.integrator = INTEGRATOR_RK4;
+    state.capacity = TEST_CAPACITY;
+    state.pointCount = TEST_POINTS;
+    state.params = attractor->defaults;
+    state.delta = 0.01;
+    state.steps = 1;
+    state.tolerance = 1e-6;
+    state.seed = 7;
+    int ok = checkpointWrite(path, &state, &store, &trails, NULL);
+    trailStoreDestroy(&trails);
+    particleStoreDestroy(&store);
+    return ok;
+}
+
+static int runHeadless(const char* headless, const char* arguments) {
+    char command[2048];
+    snprintf(command, sizeof(command), "%s %s > " NULL_DEVICE, headless, arguments);
+    return system(command) == 0;
+}
+
+static char* readFile(const char* path, long* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* data = malloc(*size + 1);
+    if (data && fread(data, 1, *size, file) != (size_t) *size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+static int sameFiles(const char* a, const char* b) {
+    long sizeA = 0, sizeB = 0;
+    char* dataA = readFile(a, &sizeA);
+    char* dataB = readFile(b, &sizeB);
+    int same = dataA && dataB && sizeA > 0 && sizeA == sizeB && !memcmp(dataA, dataB, sizeA);
+    free(dataA);
+    free(dataB);
+    return same;
+}
+
+static void roundTrip(const char* headless, const char* integrator) {
+    char arguments[1024], what[256];
+    snprintf(arguments, sizeof(arguments), "--resume checkpoint-test-app.ckpt --integrator %s --steps 10 --duration 1 --checkpoint checkpoint-test-half.ckpt", integrator);
+    check(runHeadless(headless, arguments), "first half");
+    snprintf(arguments, sizeof(arguments), "--resume checkpoint-test-half.ckpt --integrator %s --steps 10 --duration 1 --output checkpoint-test-split.txt", integrator);
+    check(runHeadless(headless, arguments), "second half");
+    snprintf(arguments, sizeof(arguments), "--resume checkpoint-test-app.ckpt --integrator %s --steps 20 --duration 2 --output checkpoint-test-whole.txt", integrator);
+    check(runHeadless(headless, arguments), "whole run");
+    snprintf(what, sizeof(what), "%s: split run matches the whole run", integrator);
+    check(sameFiles("checkpoint-test-split.txt", "checkpoint-test-whole.txt"), what);
+
+    Checkpoint half = {0};
+    snprintf(what, sizeof(what), "%s: saved checkpoint keeps the viewer's capacity and count", integrator);
+    check(checkpointOpen(&half, "checkpoint-test-half.ckpt") && half.state.capacity == TEST_CAPACITY && half.state.pointCount == TEST_POINTS, what);
+    checkpointClose(&half);
+}
+
+int main( int argc, char* argv[] ) {
+    if (argc != 2) {
+        printf("Usage: %s path/to/headless\n", argv[0]);
+        return 1;
+    }
+    if (!writeViewerCheckpoint("checkpoint-test-app.ckpt")) {
+        printf("Failed to write the test checkpoint\n");
+        return 1;
+    }
+    roundTrip(argv[1], "rk4");
+    roundTrip(argv[1], "rk45");
+    remove("checkpoint-test-app.ckpt");
+    remove("checkpoint-test-half.ckpt");
+    remove("checkpoint-test-split.txt");
+    remove("checkpoint-test-whole.txt");
+    printf("checkpoint: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,313 @@
+#include <math.h>
+#include <stdio.h>
+
+#include "../engine3d/engine3d.h"
+#include "../engine3d/mat4f.h"
+
+// The float math in mat4f.c against the double engine3d functions it stands in for. The double
+// side is fed the same float-rounded matrices, so only the float arithmetic is measured. Built
+// once per vector width (AVX, SSE2, scalar) by make test, which covers every #if branch.
+
+// A float result passes when within TEST_TOLERANCE of the double one, relative to the larger of 1
+// and the double value. Single precision carries about 7 digits, this leaves 3 for rounding.
+#define TEST_TOLERANCE 1e-4
+
+#define TEST_WIDTH 1280
+#define TEST_HEIGHT 720
+#define TEST_GUARD_BAND 2.0f
+#define TEST_POINTS 43 // Whole AVX and SSE2 batches plus a scalar tail of 3
+
+// The vector width this build was given, and how many of the TEST_POINTS projectPointsToScreen
+// takes in whole batches with it
+#if defined(__AVX__)
+#define TEST_BUILD "AVX"
+#define TEST_BODY (TEST_POINTS / 8 * 8)
+#elif defined(__SSE2__)
+#define TEST_BUILD "SSE2"
+#define TEST_BODY (TEST_POINTS / 4 * 4)
+#else
+#define TEST_BUILD "scalar"
+#define TEST_BODY 0
+#endif
+
+static int failures = 0;
+
+static void check(int condition, const char* what) {
+    if (!condition) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static int near(double value, double expected) {
+    return fabs(value - expected) <= TEST_TOLERANCE * fmax(1, fabs(expected));
+}
+
+static unsigned int randomState = 12345;
+
+// Uniform in [low, high), from a fixed seed so failures repeat
+static double randomRange(double low, double high) {
+    randomState = randomState * 1664525 + 1013904223;
+    return low + (high - low) * (randomState >> 8) / 16777216.0;
+}
+
+// The viewer's camera orbiting a scaled attractor, like makeObjectToClip in the benchmarks
+static Mat4 makeCamera(double yaw, double pitch, double distance) {
+    Mat4 projectionMatrix = makeProjectionMatrix(90.0, 0.1, 100, (double) TEST_HEIGHT / TEST_WIDTH);
+    Mat4 orbit;
+    Mat4MultiplyMat4(&orbit, makeYRotationMatrix(yaw), makeXRotationMatrix(pitch));
+    Vec3 position;
+    Mat4MultiplyVec3(&position, orbit, (Vec3){0, 0, -distance});
+    Mat4 viewMatrix = quickMatrixInverse(makePointAtMatrix(position, (Vec3){0, 0, 0}, (Vec3){0, 1, 0}));
+    Mat4 modelMatrix;
+    Mat4MultiplyMat4(&modelMatrix, makeScalingMatrix((Vec3){0.8, 0.8, 0.8}), makeTranslationMatrix((Vec3){0, 0, -25}));
+    Mat4 out;
+    Mat4MultiplyMat4(&out, viewMatrix, modelMatrix);
+    Mat4MultiplyMat4(&out, projectionMatrix, out);
+    return out;
+}
+
+static Mat4 randomMatrix(void) {
+    Mat4 m;
+    int r, c;
+    for (r = 0; r < 4; r++) {
+        for (c = 0; c < 4; c++) {
+            m.mat[r][c] = randomRange(-2, 2);
+        }
+    }
+    return m;
+}
+
+// Mat4f with its double twin, so both sides start from the same numbers
+static void roundMatrix(Mat4f* out, Mat4* rounded, const Mat4* m) {
+    Mat4fFromMat4(out, m);
+    Mat4FromMat4f(rounded, out);
+}
+
+static int nearMatrix(const Mat4f* m, const Mat4* expected) {
+    int r, c;
+    for (r = 0; r < 4; r++) {
+        for (c = 0; c < 4; c++) {
+            if (!near(m->mat[r][c], expected->mat[r][c])) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Outcode of a double clip space point, like the one projectPointsToScreen gives
+static unsigned char outcodeOfVec4(const Vec4* p, double guard) {
+    return (p->z < 0 ? CLIP_NEAR : 0) | (p->w < p->z ? CLIP_FAR : 0) |
+        (p->x < -guard * p->w ? CLIP_LEFT : 0) | (guard * p->w < p->x ? CLIP_RIGHT : 0) |
+        (p->y < -guard * p->w ? CLIP_BOTTOM : 0) | (guard * p->w < p->y ? CLIP_TOP : 0);
+}
+
+// Whether p is too close to one of the planes (the screen edges, the guard band, near or far)
+// for float and double to be sure to agree which side it is on
+static int onPlane(const Vec4* p, double guard) {
+    double margin = TEST_TOLERANCE * fmax(1, fabs(p->w));
+    return fabs(p->z) <= margin || fabs(p->w - p->z) <= margin ||
+        fabs(fabs(p->x) - p->w) <= margin || fabs(fabs(p->y) - p->w) <= margin ||
+        fabs(fabs(p->x) - guard * p->w) <= margin || fabs(fabs(p->y) - guard * p->w) <= margin;
+}
+
+// ------------------------------------------------------
+// Matrix math
+// ------------------------------------------------------
+
+static void testMultiplyMat4f(void) {
+    int n;
+    for (n = 0; n < 100; n++) {
+        Mat4 a, b, expected;
+        Mat4f af, bf, out;
+        Mat4 sourceA = n % 2 ? randomMatrix() : makeCamera(randomRange(0, 6.3), randomRange(-1.5, 1.5), 35);
+        Mat4 sourceB = randomMatrix();
+        roundMatrix(&af, &a, &sourceA);
+        roundMatrix(&bf, &b, &sourceB);
+        Mat4MultiplyMat4(&expected, a, b);
+        Mat4fMultiplyMat4f(&out, &af, &bf);
+        check(nearMatrix(&out, &expected), "Mat4fMultiplyMat4f matches Mat4MultiplyMat4");
+
+        Mat4f alias = af;
+        Mat4fMultiplyMat4f(&alias, &alias, &bf);
+        check(nearMatrix(&alias, &expected), "Mat4fMultiplyMat4f with out == a");
+        alias = bf;
+        Mat4fMultiplyMat4f(&alias, &af, &alias);
+        check(nearMatrix(&alias, &expected), "Mat4fMultiplyMat4f with out == b");
+    }
+}
+
+static void testMultiplyVec4f(void) {
+    int n;
+    for (n = 0; n < 200; n++) {
+        Mat4 a, sourceA = n % 2 ? randomMatrix() : makeCamera(randomRange(0, 6.3), randomRange(-1.5, 1.5), 35);
+        Mat4f af;
+        roundMatrix(&af, &a, &sourceA);
+        Vec4f v = {(float) randomRange(-50, 50), (float) randomRange(-50, 50), (float) randomRange(-50, 50), (float) randomRange(-2, 2)};
+        Vec4 expected;
+        Mat4MultiplyVec4(&expected, a, Vec4FromVec4f(&v));
+        Vec4f out;
+        Mat4fMultiplyVec4f(&out, &af, &v);
+        // Products of inputs up to 50 and entries up to 2, so the tolerance scales with 100
+        check(near(out.x / 100, expected.x / 100) && near(out.y / 100, expected.y / 100) &&
+            near(out.z / 100, expected.z / 100) && near(out.w / 100, expected.w / 100), "Mat4fMultiplyVec4f matches Mat4MultiplyVec4");
+        Mat4fMultiplyVec4f(&v, &af, &v);
+        check(v.x == out.x && v.y == out.y && v.z == out.z && v.w == out.w, "Mat4fMultiplyVec4f with out == b");
+
+        const Vec3 point = {(float) randomRange(-50, 50), (float) randomRange(-50, 50), (float) randomRange(-50, 50)};
+        Vec3 expectedPoint;
+        Vec4 expectedW;
+        Mat4MultiplyVec3(&expectedPoint, a, point);
+        Mat4MultiplyVec4(&expectedW, a, (Vec4){point.x, point.y, point.z, 1});
+        Mat4fMultiplyPoint(&out, &af, point.x, point.y, point.z);
+        check(near(out.x / 100, expectedPoint.x / 100) && near(out.y / 100, expectedPoint.y / 100) &&
+            near(out.z / 100, expectedPoint.z / 100) && near(out.w / 100, expectedW.w / 100), "Mat4fMultiplyPoint matches Mat4MultiplyVec3");
+    }
+}
+
+static void testInverse(void) {
+    int n;
+    for (n = 0; n < 100; n++) {
+        // Rigid transforms, which quickMatrixInverse handles
+        Mat4 rigid;
+        Mat4MultiplyMat4(&rigid, makeYRotationMatrix(randomRange(0, 6.3)), makeXRotationMatrix(randomRange(0, 6.3)));
+        Mat4MultiplyMat4(&rigid, makeTranslationMatrix((Vec3){randomRange(-40, 40), randomRange(-40, 40), randomRange(-40, 40)}), rigid);
+        Mat4 m;
+        Mat4f mf, out;
+        roundMatrix(&mf, &m, &rigid);
+        Mat4 expected = quickMatrixInverse(m);
+        check(Mat4fInverse(&out, &mf) && nearMatrix(&out, &expected), "Mat4fInverse matches quickMatrixInverse");
+
+        // Anything else only has to give the identity back. Scaled model views and diagonally
+        // dominant matrices are well conditioned, so that holds to the float tolerance. The
+        // perspective divide's near and far planes make a whole camera too ill conditioned.
+        Mat4 general = randomMatrix();
+        int r;
+        if (n % 2) {
+            Mat4MultiplyMat4(&general, rigid, makeScalingMatrix((Vec3){randomRange(0.5, 2), randomRange(0.5, 2), randomRange(0.5, 2)}));
+        } else {
+            for (r = 0; r < 4; r++) {
+                general.mat[r][r] += 8;
+            }
+        }
+        roundMatrix(&mf, &m, &general);
+        Mat4 inverse, product, identity = makeIdentityMatrix();
+        Mat4f productF;
+        check(Mat4fInverse(&out, &mf), "Mat4fInverse inverts a general matrix");
+        Mat4FromMat4f(&inverse, &out);
+        Mat4MultiplyMat4(&product, m, inverse);
+        Mat4fFromMat4(&productF, &product);
+        check(nearMatrix(&productF, &identity), "Mat4fInverse times the matrix is the identity");
+    }
+
+    Mat4f out;
+    Mat4f zero = {{{0}}};
+    check(!Mat4fInverse(&out, &zero), "Mat4fInverse rejects the zero matrix");
+    Mat4 flat = makeScalingMatrix((Vec3){1, 0, 1});
+    Mat4f flatF;
+    Mat4fFromMat4(&flatF, &flat);
+    check(!Mat4fInverse(&out, &flatF), "Mat4fInverse rejects a matrix that flattens an axis");
+    Mat4 repeated = randomMatrix();
+    int c;
+    for (c = 0; c < 4; c++) {
+        repeated.mat[2][c] = repeated.mat[0][c];
+    }
+    Mat4f repeatedF;
+    Mat4fFromMat4(&repeatedF, &repeated);
+    check(!Mat4fInverse(&out, &repeatedF), "Mat4fInverse rejects a matrix with a repeated row");
+}
+
+// ------------------------------------------------------
+// Projection and culling
+// ------------------------------------------------------
+
+static void testProjectPoints(void) {
+    int n, i;
+    for (n = 0; n < 50; n++) {
+        Mat4 camera = makeCamera(randomRange(0, 6.3), randomRange(-1.5, 1.5), randomRange(20, 60)), m;
+        Mat4f mf;
+        roundMatrix(&mf, &m, &camera);
+        float x[TEST_POINTS], y[TEST_POINTS], z[TEST_POINTS];
+        float screenX[TEST_POINTS], screenY[TEST_POINTS];
+        unsigned char outcodes[TEST_POINTS];
+        for (i = 0; i < TEST_POINTS; i++) {
+            // Mostly on screen, some off to the sides and some behind the camera
+            x[i] = (float) randomRange(-40, 40);
+            y[i] = (float) randomRange(-40, 40);
+            z[i] = (float) randomRange(-40, 80);
+        }
+        projectPointsToScreen(screenX, screenY, outcodes, x, y, z, TEST_POINTS, &mf, TEST_WIDTH, TEST_HEIGHT, TEST_GUARD_BAND);
+        for (i = 0; i < TEST_POINTS; i++) {
+            const Vec3 point = {x[i], y[i], z[i]};
+            Vec4 clip;
+            Mat4MultiplyVec4(&clip, m, (Vec4){point.x, point.y, point.z, 1});
+            if (onPlane(&clip, TEST_GUARD_BAND)) {
+                continue;
+            }
+            const char* part = i < TEST_BODY ? "SIMD body" : "scalar tail";
+            char what[128];
+            snprintf(what, sizeof(what), "projectPointsToScreen outcode matches the double one (%s)", part);
+            check(outcodes[i] == outcodeOfVec4(&clip, TEST_GUARD_BAND), what);
+            if (outcodes[i]) {
+                continue;
+            }
+            Vec3 expected;
+            projectVec3ToScreen(&expected, m, point, TEST_WIDTH, TEST_HEIGHT);
+            snprintf(what, sizeof(what), "projectPointsToScreen matches projectVec3ToScreen (%s)", part);
+            check(near(screenX[i] / TEST_WIDTH, expected.x / TEST_WIDTH) && near(screenY[i] / TEST_HEIGHT, expected.y / TEST_HEIGHT), what);
+
+            // One point at a time always takes the scalar tail
+            float aloneX, aloneY;
+            unsigned char aloneOutcode;
+            projectPointsToScreen(&aloneX, &aloneY, &aloneOutcode, x + i, y + i, z + i, 1, &mf, TEST_WIDTH, TEST_HEIGHT, TEST_GUARD_BAND);
+            check(aloneOutcode == outcodes[i] && near(aloneX / TEST_WIDTH, screenX[i] / TEST_WIDTH) && near(aloneY / TEST_HEIGHT, screenY[i] / TEST_HEIGHT), "projectPointsToScreen batch matches its scalar tail");
+        }
+    }
+}
+
+// BOX_* of the box through m in double, from the outcodes of its corners
+static int classifyBoxDouble(const Mat4* m, const Vec3* min, const Vec3* max, double guardBand, int* ambiguous) {
+    unsigned char hidden = CLIP_OUTSIDE, crossing = 0;
+    int corner;
+    *ambiguous = 0;
+    for (corner = 0; corner < 8; corner++) {
+        Vec4 p;
+        Mat4MultiplyVec4(&p, *m, (Vec4){corner & 1 ? max->x : min->x, corner & 2 ? max->y : min->y, corner & 4 ? max->z : min->z, 1});
+        *ambiguous |= onPlane(&p, guardBand);
+        hidden &= outcodeOfVec4(&p, 1);
+        crossing |= outcodeOfVec4(&p, guardBand);
+    }
+    return hidden ? BOX_HIDDEN : crossing ? BOX_CROSSING : BOX_INSIDE;
+}
+
+static void testClassifyBox(void) {
+    int n, seen[3] = {0};
+    for (n = 0; n < 2000; n++) {
+        Mat4 camera = makeCamera(randomRange(0, 6.3), randomRange(-1.5, 1.5), randomRange(20, 60)), m;
+        Mat4f mf;
+        roundMatrix(&mf, &m, &camera);
+        Vec3 min = {(float) randomRange(-60, 60), (float) randomRange(-60, 60), (float) randomRange(-60, 100)};
+        const double size = randomRange(0.1, 30);
+        Vec3 max = {(float) (min.x + size), (float) (min.y + size * randomRange(0.2, 1)), (float) (min.z + size * randomRange(0.2, 1))};
+        int ambiguous;
+        int expected = classifyBoxDouble(&m, &min, &max, TEST_GUARD_BAND, &ambiguous);
+        if (ambiguous) {
+            continue;
+        }
+        int result = Mat4fClassifyBox(&mf, &min, &max, TEST_GUARD_BAND);
+        check(result == expected, "Mat4fClassifyBox matches the double corner outcodes");
+        seen[result]++;
+    }
+    check(seen[BOX_HIDDEN] && seen[BOX_CROSSING] && seen[BOX_INSIDE], "Mat4fClassifyBox test boxes cover every result");
+}
+
+int main( int argc, char* argv[] ) {
+    testMultiplyMat4f();
+    testMultiplyVec4f();
+    testInverse();
+    testProjectPoints();
+    testClassifyBox();
+    printf("mat4f (%s): %s\n", TEST_BUILD, failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}